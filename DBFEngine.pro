@@ -11,12 +11,39 @@ QT       -= gui
 TARGET = DBFEngine
 CONFIG   += console
 CONFIG   -= app_bundle
+CONFIG   += c++17 thread
+
+# 64 bit off_t for fseeko / pread on 32 bit systems, tables can be larger than 2GB
+unix:DEFINES += _FILE_OFFSET_BITS=64
+
+# the DBF::getStats() counters are compiled in, this takes them out of every hot path
+# DEFINES += DBF_NO_STATS
 
 TEMPLATE = app
 
 
 SOURCES += main.cpp \
-    dbf.cpp
+    dbf.cpp \
+    dbfnumeric.cpp \
+    dbfdate.cpp \
+    dbfparallel.cpp \
+    dbffilter.cpp \
+    dbfindex.cpp \
+    dbfcsv.cpp \
+    dbfaggregate.cpp \
+    dbfmemo.cpp \
+    dbfcatalog.cpp \
+    dbfstats.cpp
 
 HEADERS += \
-    dbf.h
+    dbf.h \
+    dbfnumeric.h \
+    dbfdate.h \
+    dbfparallel.h \
+    dbffilter.h \
+    dbfindex.h \
+    dbfcsv.h \
+    dbfaggregate.h \
+    dbfmemo.h \
+    dbfcatalog.h \
+    dbfstats.h
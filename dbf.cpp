@@ -1,4 +1,27 @@
 #include "dbf.h"
+#include "dbfnumeric.h"
+#include "dbfparallel.h"
+#include "dbffilter.h"
+#include "dbfindex.h"
+#include "dbfcsv.h"
+#include "dbfmemo.h"
+#include "dbfdate.h"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#else
+#include <io.h>
+#endif
 
 // Copyright (C) 2012 Ron Ostafichuk
 //
@@ -14,6 +37,179 @@
 // LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR
 // IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
+// push everything written through stdio to the disk. bDataOnly skips metadata that is not needed to read the data back
+// (fdatasync), pack uses the full fsync for the file it renames
+static int syncFile(FILE *pFile,bool bDataOnly=false)
+{
+    if( fflush(pFile) != 0 )
+        return 1;
+#if defined(_WIN32)
+    (void) bDataOnly;
+    return _commit(_fileno(pFile)) == 0 ? 0 : 1;
+#elif defined(__APPLE__)
+    (void) bDataOnly; // no fdatasync
+    return fsync(fileno(pFile)) == 0 ? 0 : 1;
+#else
+    return (bDataOnly ? fdatasync(fileno(pFile)) : fsync(fileno(pFile))) == 0 ? 0 : 1;
+#endif
+}
+
+static inline bool isMemoType(char cType)
+{
+    return cType == 'M' || cType == 'G' || cType == 'P';
+}
+
+// 'L' field values that read as true
+static inline bool isTrueLogical(char c)
+{
+    return c == 'T' || c == 't' || c == 'Y' || c == 'y';
+}
+
+// slot of a field type in DBFStats::nFieldDecodes
+static inline int statTypeSlot(char cType)
+{
+    return cType >= 'A' && cType <= 'Z' ? cType - 'A' : DBF_STATS_TYPES - 1;
+}
+
+#ifndef DBF_NO_STATS
+// adds the time from construction to destruction to a log2 histogram of DBF_STATS_BUCKETS, does nothing without one
+class StatTimer
+{
+public:
+    StatTimer(std::atomic<int64> *pHistogram) : m_pHistogram(pHistogram)
+    {
+        if( m_pHistogram != NULL )
+            m_Start = std::chrono::steady_clock::now();
+    }
+    ~StatTimer()
+    {
+        if( m_pHistogram == NULL )
+            return;
+        int64 nNs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_Start).count();
+        int nBucket = 0;
+        while( nBucket < DBF_STATS_BUCKETS - 1 && (nNs >> (nBucket + 1)) > 0 )
+            nBucket++;
+        m_pHistogram[nBucket].store(m_pHistogram[nBucket].load(std::memory_order_relaxed) + 1,std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<int64> *m_pHistogram;
+    std::chrono::steady_clock::time_point m_Start;
+};
+#define DBF_STAT_TIMER(nHistogram) StatTimer statTimer(m_bTrackLatency ? m_pLatency + (nHistogram)*DBF_STATS_BUCKETS : NULL)
+#else
+#define DBF_STAT_TIMER(nHistogram)
+#endif
+
+// the memo file sits next to the table with the same name, extension in the same case as the table's
+static string memoFileName(const string &sTable,const char *pExtension)
+{
+    size_t nDot = sTable.find_last_of('.');
+    size_t nSlash = sTable.find_last_of("/\\");
+    string sBase = (nDot == string::npos || (nSlash != string::npos && nDot < nSlash)) ? sTable : sTable.substr(0,nDot);
+    string sExtension = pExtension;
+    if( nDot != string::npos && sBase.size() < sTable.size() && sTable.size() > nDot + 1 && isupper((unsigned char) sTable[nDot + 1]) )
+        std::transform(sExtension.begin(),sExtension.end(),sExtension.begin(),::toupper);
+    return sBase + sExtension;
+}
+
+static int64 steadyMilliseconds()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// locate the text of a field, stops at the first NUL (appendRecord zero fills) and trims the space padding
+static void trimFieldText(const char *pField,int nLen,const char **ppStart,int *pnLen)
+{
+    const char *pEnd = (const char *) memchr(pField,0,nLen);
+    if( pEnd == NULL )
+        pEnd = pField + nLen;
+    while( pField < pEnd && *pField == ' ' )
+        pField++;
+    while( pEnd > pField && pEnd[-1] == ' ' )
+        pEnd--;
+    *ppStart = pField;
+    *pnLen = (int) (pEnd - pField);
+}
+
+// read a little endian signed integer of 1 to 8 bytes
+static int64 decodeIntField(const char *pField,int nLen)
+{
+    uint64 u = 0;
+    if( nLen > 8 )
+        nLen = 8;
+    for( int i = 0 ; i < nLen ; i++ )
+        u |= ((uint64) (uint8) pField[i]) << (i*8);
+    if( nLen > 0 && nLen < 8 && (pField[nLen-1] & 0x80) )
+        u |= ~(uint64) 0 << (nLen*8); // sign extend
+    return (int64) u;
+}
+
+// read a 'B' field, 4 byte float or 8 byte double
+static bool decodeBinaryFloat(const char *pField,int nLen,double *pdValue)
+{
+    if( nLen == 4 )
+    {
+        float f;
+        memcpy(&f,pField,4);
+        *pdValue = f;
+        return true;
+    } else if( nLen == 8 )
+    {
+        memcpy(pdValue,pField,8);
+        return true;
+    }
+    return false;
+}
+
+// Visual FoxPro 'T' and 'Y' are 8 binary bytes, other lengths hold text
+static inline bool isBinaryDateTime(const fieldDefinition &fd)
+{
+    return fd.cFieldType == 'T' && fd.uLength == 8;
+}
+
+static inline bool isBinaryCurrency(const fieldDefinition &fd)
+{
+    return fd.cFieldType == 'Y' && fd.uLength == 8;
+}
+
+// value*10^4 to value*10^nDecimals, rounded half away from zero
+static int64 rescaleCurrency(int64 nScaled, int nDecimals)
+{
+    for( ; nDecimals > DBF_CURRENCY_SCALE ; nDecimals-- )
+        nScaled *= 10;
+    int64 nDivisor = 1;
+    for( ; nDecimals < DBF_CURRENCY_SCALE ; nDecimals++ )
+        nDivisor *= 10;
+    if( nDivisor == 1 )
+        return nScaled;
+    int64 nHalf = nDivisor/2;
+    return nScaled >= 0 ? (nScaled + nHalf)/nDivisor : -((-nScaled + nHalf)/nDivisor);
+}
+
+int dbfSeekFile(FILE *pFile,int64 nPos,int nOrigin)
+{
+#ifdef _WIN32
+    return _fseeki64(pFile,nPos,nOrigin);
+#else
+    return fseeko(pFile,(off_t) nPos,nOrigin);
+#endif
+}
+
+int64 dbfFileSize(FILE *pFile)
+{
+    if( pFile == NULL || fflush(pFile) != 0 )
+        return -1;
+#ifdef _WIN32
+    return _filelengthi64(_fileno(pFile));
+#else
+    struct stat st;
+    if( fstat(fileno(pFile),&st) != 0 )
+        return -1;
+    return (int64) st.st_size;
+#endif
+}
+
 DBF::DBF()
 {
     m_pFileHandle = NULL;
@@ -31,19 +227,179 @@ DBF::DBF()
         m_bStructSizesOK = false;
     }
 
-    m_pRecord = new char[MAX_RECORD_SIZE];
+    // the record buffer is sized by open / create, so an idle DBF costs a few hundred bytes
+    m_pRecordBuffer = NULL;
+    m_nRecordBufferSize = 0;
+    m_pBufferPool = NULL;
+    m_pRecord = m_pRecordBuffer;
+    m_bVerbose = true;
+    m_pMapping = NULL;
+    m_nMapSize = 0;
+    m_nAccessHint = DBF_ACCESS_NORMAL;
+    m_bAppendSession = false;
+    m_nAppendPending = 0;
+    m_nAppendBufferRecords = 0;
+    m_bDeletionBitmap = false;
+    m_nDeletedCount = 0;
+    m_nMaxDirtyPages = 4096;
+    m_nSyncPolicy = DBF_SYNC_FLUSH;
+    m_nSyncValue = 1;
+    m_nWritesSinceFlush = 0;
+    m_nLastFlushMs = 0;
+    m_bUnsynced = false;
+    m_bUnflushed = false;
+    m_nCachePageSize = DBF_CACHE_PAGE_SIZE;
+    m_nCacheHand = 0;
+    m_nCacheHits = 0;
+    m_nCacheMisses = 0;
+    m_pMemo = NULL;
+#ifndef DBF_NO_STATS
+    for( int i = 0 ; i < STAT_SLOTS ; i++ )
+        m_Stats[i] = 0;
+    m_pLatency = NULL;
+    m_bTrackLatency = false;
+    m_nStatsIntervalMs = 0;
+    m_nNextStatsMs = 0;
+#endif
 }
 
 DBF::~DBF()
 {
+    if( m_pFileHandle != NULL )
+        commit(); // do not lose buffered records, sync as the policy says
+    delete m_pMemo;
+    unmapFile();
     if( m_pFileHandle != NULL )
         fclose(m_pFileHandle);
 
     m_pFileHandle = NULL;
-    delete [] m_pRecord;
+    freeRecordBuffer();
+#ifndef DBF_NO_STATS
+    delete [] m_pLatency;
+#endif
+}
+
+static int poolSizeClass(size_t nBytes)
+{
+    int nClass = 6; // 64 bytes and up
+    while( ((size_t) 1 << nClass) < nBytes )
+        nClass++;
+    return nClass;
+}
+
+DBFBufferPool::DBFBufferPool(size_t nMaxFreeBytes)
+{
+    m_nFreeBytes = 0;
+    m_nMaxFreeBytes = nMaxFreeBytes;
+}
+
+DBFBufferPool::~DBFBufferPool()
+{
+    for( size_t c = 0 ; c < m_FreeLists.size() ; c++ )
+    {
+        for( size_t i = 0 ; i < m_FreeLists[c].size() ; i++ )
+            delete [] m_FreeLists[c][i];
+    }
+}
+
+char *DBFBufferPool::acquire(size_t nBytes,size_t *pnCapacity)
+{
+    int nClass = poolSizeClass(nBytes);
+    *pnCapacity = (size_t) 1 << nClass;
+    {
+        std::lock_guard<std::mutex> guard(m_Lock);
+        if( nClass < (int) m_FreeLists.size() && !m_FreeLists[nClass].empty() )
+        {
+            char *p = m_FreeLists[nClass].back();
+            m_FreeLists[nClass].pop_back();
+            m_nFreeBytes -= *pnCapacity;
+            return p;
+        }
+    }
+    return new char[*pnCapacity];
+}
+
+void DBFBufferPool::release(char *pBuffer,size_t nCapacity)
+{
+    if( pBuffer == NULL )
+        return;
+    {
+        std::lock_guard<std::mutex> guard(m_Lock);
+        int nClass = poolSizeClass(nCapacity);
+        if( m_nFreeBytes + nCapacity <= m_nMaxFreeBytes )
+        {
+            if( nClass >= (int) m_FreeLists.size() )
+                m_FreeLists.resize(nClass + 1);
+            m_FreeLists[nClass].push_back(pBuffer);
+            m_nFreeBytes += nCapacity;
+            return;
+        }
+    }
+    delete [] pBuffer;
+}
+
+size_t DBFBufferPool::getFreeBytes()
+{
+    std::lock_guard<std::mutex> guard(m_Lock);
+    return m_nFreeBytes;
+}
+
+int DBF::sizeRecordBuffer(size_t nBytes)
+{
+    nBytes = max(nBytes,(size_t) 1);
+    if( nBytes <= m_nRecordBufferSize )
+        return 0;
+    size_t nCapacity = nBytes;
+    char *pBuffer = m_pBufferPool != NULL ? m_pBufferPool->acquire(nBytes,&nCapacity) : new char[nBytes];
+    memset(pBuffer,0,nCapacity);
+    if( m_pRecordBuffer != NULL )
+        memcpy(pBuffer,m_pRecordBuffer,m_nRecordBufferSize);
+    bool bLoaded = (m_pRecord == m_pRecordBuffer);
+    freeRecordBuffer();
+    m_pRecordBuffer = pBuffer;
+    m_nRecordBufferSize = nCapacity;
+    if( bLoaded )
+        m_pRecord = m_pRecordBuffer;
+    return 0;
+}
+
+void DBF::freeRecordBuffer()
+{
+    if( m_pRecord == m_pRecordBuffer )
+        m_pRecord = NULL;
+    if( m_pBufferPool != NULL )
+        m_pBufferPool->release(m_pRecordBuffer,m_nRecordBufferSize);
+    else
+        delete [] m_pRecordBuffer;
+    m_pRecordBuffer = NULL;
+    m_nRecordBufferSize = 0;
+}
+
+void DBF::setBufferPool(DBFBufferPool *pPool)
+{
+    if( pPool == m_pBufferPool )
+        return;
+    // move the current record over to a buffer from the new source
+    vector<char> record(m_pRecordBuffer,m_pRecordBuffer + m_nRecordBufferSize);
+    bool bLoaded = (m_pRecord == m_pRecordBuffer);
+    freeRecordBuffer();
+    m_pBufferPool = pPool;
+    if( !record.empty() )
+    {
+        sizeRecordBuffer(record.size());
+        memcpy(m_pRecordBuffer,&record[0],record.size());
+    }
+    if( bLoaded )
+        m_pRecord = m_pRecordBuffer;
 }
 
-int DBF::open(string sFileName,bool bAllowWrite)
+int DBF::open(string sFileName,bool bAllowWrite,bool bMemoryMap,int nAccessHint)
+{
+    resetStats(); // the counters are per table
+    return openFile(sFileName,bAllowWrite,bMemoryMap,nAccessHint,m_bVerbose);
+}
+
+int DBF::openFile(string sFileName,bool bAllowWrite,bool bMemoryMap,int nAccessHint,bool bVerbose)
 {
     // open a dbf file for reading only
     m_sFileName = sFileName;
@@ -64,14 +420,15 @@ int DBF::open(string sFileName,bool bAllowWrite)
 
     // open is ok, so read in the File Header
 
-    int nBytesRead = fread (&m_FileHeader,1,32,m_pFileHandle);
+    int nBytesRead = (int) readFile(&m_FileHeader,32);
     if( nBytesRead != 32 )
     {
         std::cerr << __FUNCTION__ << " Bad read for Header, wanted 32, got " << nBytesRead << std::endl;
         return 1; // fail
     }
 
-    std::cout << "Header: Type=" << m_FileHeader.u8FileType << std::endl
+    if( bVerbose )
+        std::cout << "Header: Type=" << m_FileHeader.u8FileType << std::endl
       << "  Last Update=" << (int) m_FileHeader.u8LastUpdateDay << "/" << (int) m_FileHeader.u8LastUpdateMonth << "/" << (int) m_FileHeader.u8LastUpdateYear << std::endl
       << "  Num Recs=" << m_FileHeader.uRecordsInFile << std::endl
       << "  Rec0 position=" << m_FileHeader.uPositionOfFirstRecord << std::endl
@@ -80,27 +437,37 @@ int DBF::open(string sFileName,bool bAllowWrite)
       << "  TableFlags=" << (int) m_FileHeader.uTableFlags << std::endl;
 
     m_nNumFields = 0;
+    m_FieldDefinitions.clear();
     // now read in all the field definitions
-    std::cout << "Fields: " << std::endl;
+    if( bVerbose )
+        std::cout << "Fields: " << std::endl;
     do
     {
-        int nBytesRead = fread(&(m_FieldDefinitions[m_nNumFields]),1,32,m_pFileHandle);
+        fieldDefinition fd;
+        int nBytesRead = (int) readFile(&fd,32);
         if( nBytesRead != 32 )
         {
             std::cerr << __FUNCTION__ << " Bad read for Field, wanted 32, got " << nBytesRead << std::endl;
             return 1;
         }
 
-        if( m_FieldDefinitions[m_nNumFields].cFieldName[0] == 0x0D || strlen(m_FieldDefinitions[m_nNumFields].cFieldName) <= 1 )
+        if( fd.cFieldName[0] == 0x0D || strnlen(fd.cFieldName,sizeof(fd.cFieldName)) <= 1 )
         {
             // end of fields
             break;
         }
+        if( m_nNumFields >= MAX_FIELDS )
+        {
+            std::cerr << __FUNCTION__ << " More than " << MAX_FIELDS << " fields" << std::endl;
+            return 1;
+        }
         // show field in std out
-        std::cout << "  " << m_FieldDefinitions[m_nNumFields].cFieldName << ", Type=" << m_FieldDefinitions[m_nNumFields].cFieldType
-              << ", Offset=" << (int) m_FieldDefinitions[m_nNumFields].uFieldOffset << ", len=" << (int) m_FieldDefinitions[m_nNumFields].uLength
-              << ", Dec=" << (int) m_FieldDefinitions[m_nNumFields].uNumberOfDecimalPlaces << ", Flag=" << (int) m_FieldDefinitions[m_nNumFields].FieldFlags << std::endl;
+        if( bVerbose )
+            std::cout << "  " << fd.cFieldName << ", Type=" << fd.cFieldType
+              << ", Offset=" << (int) fd.uFieldOffset << ", len=" << (int) fd.uLength
+              << ", Dec=" << (int) fd.uNumberOfDecimalPlaces << ", Flag=" << (int) fd.FieldFlags << std::endl;
 
+        m_FieldDefinitions.push_back(fd);
         m_nNumFields++;
     }while(!feof(m_pFileHandle));
 
@@ -117,6 +484,7 @@ int DBF::open(string sFileName,bool bAllowWrite)
         std::cerr << __FUNCTION__ << " Bad Record length calculated from field sizes " << uFieldOffset << ", header says " << m_FileHeader.uRecordLength << std::endl;
         return 1;
     }
+    sizeRecordBuffer(m_FileHeader.uRecordLength);
 
     // move to start of first record
     int nFilePosForRec0 = 32+32*m_nNumFields+264;
@@ -127,21 +495,132 @@ int DBF::open(string sFileName,bool bAllowWrite)
         return 1;
     }
 
+    // record numbers are int, and the header count must fit in the file (a crash during an append can leave it too high)
+    if( m_FileHeader.uRecordsInFile > 2147483647u )
+    {
+        // the first 2^31-1 records stay readable, writing would store the clamped count back in the header
+        std::cerr << __FUNCTION__ << " " << m_FileHeader.uRecordsInFile << " records is more than this engine can address, only the first "
+                  << 2147483647u << " are used and the table is opened read only" << std::endl;
+        m_FileHeader.uRecordsInFile = 2147483647u;
+        m_bAllowWrite = false;
+    }
+    int64 nFileSize = dbfFileSize(m_pFileHandle);
+    if( nFileSize >= 0 && nFileSize < recordPosition(m_FileHeader.uRecordsInFile) && m_FileHeader.uRecordLength > 0 )
+    {
+        uint32 uRecords = (uint32) max((int64) 0,(nFileSize - m_FileHeader.uPositionOfFirstRecord)/m_FileHeader.uRecordLength);
+        std::cerr << __FUNCTION__ << " Header says " << m_FileHeader.uRecordsInFile << " records but the file only holds "
+                  << uRecords << ", using " << uRecords << std::endl;
+        m_FileHeader.uRecordsInFile = uRecords;
+    }
+
+    // memo blobs are only read when a memo field is asked for, opening the file reads nothing but its header
+    bool bMemoFields = false;
+    for( int i = 0 ; i < m_nNumFields ; i++ )
+        bMemoFields = bMemoFields || isMemoType(m_FieldDefinitions[i].cFieldType);
+    if( (m_FileHeader.uTableFlags & 0x02) || bMemoFields )
+        openMemo();
+
+    // the mapping is optional, if it can not be created loadRec just keeps using fseek/fread
+    m_nAccessHint = nAccessHint;
+    if( bMemoryMap )
+        mapFile();
+    setAccessHint(nAccessHint);
+
     return 0; // ok
 }
 
+int DBF::mapFile()
+{
+    unmapFile();
+#ifndef _WIN32
+    int fd = fileno(m_pFileHandle);
+    struct stat st;
+    if( fstat(fd,&st) != 0 || st.st_size <= 0 )
+        return 1;
+
+    size_t nSize = (size_t) st.st_size;
+    void *p = mmap(NULL,nSize,PROT_READ,MAP_SHARED,fd,0);
+    if( p == MAP_FAILED )
+        return 1; // fall back to stdio
+
+    m_pMapping = (char *) p;
+    m_nMapSize = nSize;
+    return 0;
+#else
+    return 1; // not supported, stdio only
+#endif
+}
+
+void DBF::unmapFile()
+{
+#ifndef _WIN32
+    if( m_pMapping != NULL )
+        munmap(m_pMapping,m_nMapSize);
+#endif
+    m_pMapping = NULL;
+    m_nMapSize = 0;
+    m_pRecord = m_pRecordBuffer;
+}
+
+int DBF::setAccessHint(int nAccessHint)
+{
+    // tell the kernel how the records will be read, only a hint so failures are ignored
+    m_nAccessHint = nAccessHint;
+#ifndef _WIN32
+    if( m_pMapping != NULL )
+    {
+        int nAdvice = MADV_NORMAL;
+        if( nAccessHint == DBF_ACCESS_SEQUENTIAL )
+            nAdvice = MADV_SEQUENTIAL;
+        else if( nAccessHint == DBF_ACCESS_RANDOM )
+            nAdvice = MADV_RANDOM;
+        return madvise(m_pMapping,m_nMapSize,nAdvice) == 0 ? 0 : 1;
+    }
+#if defined(POSIX_FADV_SEQUENTIAL)
+    if( m_pFileHandle != NULL )
+    {
+        int nAdvice = POSIX_FADV_NORMAL;
+        if( nAccessHint == DBF_ACCESS_SEQUENTIAL )
+            nAdvice = POSIX_FADV_SEQUENTIAL;
+        else if( nAccessHint == DBF_ACCESS_RANDOM )
+            nAdvice = POSIX_FADV_RANDOM;
+        return posix_fadvise(fileno(m_pFileHandle),0,0,nAdvice) == 0 ? 0 : 1;
+    }
+#endif
+#endif
+    return 0;
+}
+
 int DBF::close()
 {
+    commit();
+#ifndef DBF_NO_STATS
+    if( m_StatsHook )
+        m_StatsHook(*this,getStats()); // the final numbers
+#endif
+    return closeFile();
+}
+
+int DBF::closeFile()
+{
+    delete m_pMemo; // writes any staged blobs
+    m_pMemo = NULL;
+    m_Indexes.clear();
+    dropDeletionBitmap();
+    clearReadCache();
+    unmapFile();
     int nRet = fclose(m_pFileHandle);
     m_pFileHandle = NULL;
     m_sFileName = "";
     m_nNumFields = 0;
+    m_FieldDefinitions.clear();
+    freeRecordBuffer();
     m_bAllowWrite = false;
     m_FileHeader.u8FileType = 0;
     return nRet;
 }
 
-int DBF::getFieldIndex(string sFieldName)
+int DBF::getFieldIndex(string sFieldName) const
 {
     for( int i = 0 ; i < m_nNumFields ; i++ )
     {
@@ -153,9 +632,53 @@ int DBF::getFieldIndex(string sFieldName)
 
 int DBF::loadRec(int nRecord)
 {
+    DBF_STAT_TIMER(0);
+    if( !m_DirtyPages.empty() && nRecord >= 0 && nRecord < (int) m_FileHeader.uRecordsInFile )
+    {
+        // updated but not written yet, the copy in the write-back cache is the current one
+        int nPageRecords = max(1,DBF_UPDATE_PAGE_SIZE/(int) m_FileHeader.uRecordLength);
+        std::map<int,DirtyPage>::const_iterator it = m_DirtyPages.find(nRecord/nPageRecords);
+        size_t nOffset = (size_t) (nRecord % nPageRecords)*m_FileHeader.uRecordLength;
+        if( it != m_DirtyPages.end() && nOffset < it->second.records.size() )
+        {
+            m_pRecord = m_pRecordBuffer;
+            memcpy(m_pRecordBuffer,&it->second.records[nOffset],m_FileHeader.uRecordLength);
+            countTick(STAT_RECORDS_LOADED);
+            return 0;
+        }
+    }
+
+    if( m_pMapping != NULL && nRecord >= 0 )
+    {
+        // zero copy, just point at the record inside the mapping
+        flushPending();
+        size_t nMapPos = (size_t) recordPosition(nRecord);
+        if( nMapPos + m_FileHeader.uRecordLength <= m_nMapSize )
+        {
+            m_pRecord = m_pMapping + nMapPos;
+            countTick(STAT_RECORDS_LOADED);
+            return 0;
+        }
+        // record was appended after the file was mapped, read it the normal way
+    }
+    if( !m_CachePages.empty() )
+    {
+        const char *pRecord = cachedRecord(nRecord);
+        if( pRecord == NULL )
+        {
+            m_pRecord = m_pRecordBuffer;
+            m_pRecordBuffer[0] = 0; // mark as invalid
+            return 1;
+        }
+        m_pRecord = pRecord;
+        countTick(STAT_RECORDS_LOADED);
+        return 0;
+    }
+    m_pRecord = m_pRecordBuffer;
+
     // read as a string always!  All modern languages can convert it later
-    int nPos = m_FileHeader.uPositionOfFirstRecord + m_FileHeader.uRecordLength*nRecord;
-    int nRes = fseek(m_pFileHandle,nPos,SEEK_SET);
+    int64 nPos = recordPosition(nRecord);
+    int nRes = seekFile(nPos);
     if ( nRes != 0 )
     {
         std::cerr << __FUNCTION__ << " Error seeking to record " << nRecord << " at " << nPos << " err=" << ferror (m_pFileHandle) << std::endl;
@@ -164,187 +687,1455 @@ int DBF::loadRec(int nRecord)
 
     if( nRes != 0)
     {
-        for( unsigned int i=0;i<sizeof(m_pRecord);i++)
-            m_pRecord[i]=0; // clear record to indicate it is invalid
+        memset(m_pRecordBuffer,0,m_nRecordBufferSize); // clear record to indicate it is invalid
         return 1; //fail
     }
-    int nBytesRead = fread(&m_pRecord[0],1,m_FileHeader.uRecordLength,m_pFileHandle);
+    int nBytesRead = (int) readFile(&m_pRecordBuffer[0],m_FileHeader.uRecordLength);
     if( nBytesRead != m_FileHeader.uRecordLength )
     {
         std::cerr << __FUNCTION__ << " read(" << nRecord << ") failed, wanted " << m_FileHeader.uRecordLength << ", but got " << nBytesRead << " bytes";
-        for( unsigned int i=0;i<sizeof(m_pRecord);i++)
-            m_pRecord[i]=0; // clear record to indicate it is invalid
+        memset(m_pRecordBuffer,0,m_nRecordBufferSize); // clear record to indicate it is invalid
         return 1; //fail
     }
 
     // record is now ready to be used
+    countTick(STAT_RECORDS_LOADED);
     return 0;
 }
 
-bool DBF::isRecordDeleted()
+const char *DBF::loadRecPointer(int nRecord)
 {
-    // works on currently loaded record
-    if( m_pRecord[0] != ' ' )
-        return true;
-    else
-        return false;
+    if( loadRec(nRecord) != 0 )
+        return NULL;
+    return m_pRecord;
 }
 
-string DBF::readField(int nField)
+int DBF::setReadCache(size_t nBytes,int nPageSize)
 {
-    // read the field from the record, and output as a string because all modern languages can use a string
+    // CLOCK cache of file aligned pages for loadRec, nBytes=0 turns it off
+    if( nPageSize < 512 )
+    {
+        std::cerr << __FUNCTION__ << " page size " << nPageSize << " is too small" << std::endl;
+        return 1;
+    }
+    m_CacheMap.clear();
+    m_nCachePageSize = nPageSize;
+    m_nCacheHand = 0;
+    size_t nPages = nBytes/nPageSize;
+    if( nBytes > 0 && nPages < 2 )
+        nPages = 2; // a record can straddle two pages
+    m_CachePages.assign(nPages,CachePage());
+    vector<char>(nPages*nPageSize).swap(m_CacheData);
+    for( size_t i = 0 ; i < nPages ; i++ )
+        m_CachePages[i].pData = &m_CacheData[i*nPageSize];
+    return 0;
+}
 
-    // depending on the field type, get the field and convert to a string  ( do not have documentation on the types, so this is all guesswork)
-    char cType = m_FieldDefinitions[nField].cFieldType;
-    int nOffset = m_FieldDefinitions[nField].uFieldOffset;
-    int nMaxSize = m_FieldDefinitions[nField].uLength;
+void DBF::clearReadCache()
+{
+    m_CacheMap.clear();
+    for( size_t i = 0 ; i < m_CachePages.size() ; i++ )
+        m_CachePages[i].nPage = -1;
+}
 
-    /* possible types
-      C=char
-      Y=Currency (? format unknown, probably char)
-      N=Numeric (really just a char)
-      F=Float (really just a char)
-      D=Date (? format unknown, probably char)
-      T=Date Time (? format unknown, probably char)
-      B=Double (an actual double)
-      I=Integer (4 byte int)
-      L=Logical (char[1] with T=true,?=Null,F=False)
-      M=memo (big char field?)
-      G=General (?)
-      P=Picture (?)
-      ... others?  really no idea
-      treat all unhandled field types as C for now
-    */
+const char *DBF::cachePage(int64 nPage,size_t *pnValid)
+{
+    std::unordered_map<int64,int>::const_iterator it = m_CacheMap.find(nPage);
+    if( it != m_CacheMap.end() )
+    {
+        CachePage &page = m_CachePages[it->second];
+        page.bReferenced = true;
+        m_nCacheHits++;
+        *pnValid = page.nValid;
+        return page.pData;
+    }
+    m_nCacheMisses++;
 
-    if( cType == 'I' )
+    // CLOCK: pass over the pages used since the hand last came by, take the first one that was not
+    while( m_CachePages[m_nCacheHand].nPage >= 0 && m_CachePages[m_nCacheHand].bReferenced )
     {
-        // convert integer numbers up to 16 bytes long into a string
-        uint8 n[16];
-        for( int i = 0 ; i < nMaxSize ; i++ )
-            n[i] = (uint8 ) m_pRecord[nOffset+i];
+        m_CachePages[m_nCacheHand].bReferenced = false;
+        m_nCacheHand = (m_nCacheHand + 1) % m_CachePages.size();
+    }
+    int nFrame = (int) m_nCacheHand;
+    m_nCacheHand = (m_nCacheHand + 1) % m_CachePages.size();
+    CachePage &page = m_CachePages[nFrame];
+    if( page.nPage >= 0 )
+        m_CacheMap.erase(page.nPage);
+    page.nPage = -1;
+
+    // the last page of the file is short
+    int64 nStart = nPage*m_nCachePageSize;
+    int64 nEnd = min(nStart + m_nCachePageSize,recordPosition(m_FileHeader.uRecordsInFile));
+    if( nEnd <= nStart )
+        return NULL;
+    if( readAt(page.pData,(size_t) (nEnd - nStart),nStart) != 0 )
+        return NULL;
+    page.nPage = nPage;
+    page.nValid = (size_t) (nEnd - nStart);
+    page.bReferenced = true;
+    m_CacheMap[nPage] = nFrame;
+    *pnValid = page.nValid;
+    return page.pData;
+}
 
-        return convertNumber(&n[0],nMaxSize);
+const char *DBF::cachedRecord(int nRecord)
+{
+    // point into the page holding the record, or put a record that straddles pages together in the record buffer
+    if( nRecord < 0 || nRecord >= (int) m_FileHeader.uRecordsInFile )
+    {
+        std::cerr << __FUNCTION__ << " record " << nRecord << " is out of range" << std::endl;
+        return NULL;
     }
-    else if( cType == 'B' )
+    int64 nPos = recordPosition(nRecord);
+    size_t nLength = m_FileHeader.uRecordLength;
+    size_t nDone = 0;
+    while( nDone < nLength )
     {
-        // handle real float or double
-        if( nMaxSize == 4)
+        int64 nPage = (nPos + nDone)/m_nCachePageSize;
+        size_t nOffset = (size_t) ((nPos + nDone) % m_nCachePageSize);
+        size_t nValid;
+        const char *pPage = cachePage(nPage,&nValid);
+        size_t nPart = min(nLength - nDone,(size_t) m_nCachePageSize - nOffset);
+        if( pPage == NULL || nOffset + nPart > nValid )
         {
-            // float
-            union name1
-            {
-                uint8   n[4];
-                float     f;
-            } uvar;
-            uvar.f = 0;
-
-            uvar.n[0] = (uint8 ) m_pRecord[nOffset];
-            uvar.n[1] = (uint8 ) m_pRecord[nOffset+1];
-            uvar.n[2] = (uint8 ) m_pRecord[nOffset+2];
-            uvar.n[3] = (uint8 ) m_pRecord[nOffset+3];
+            std::cerr << __FUNCTION__ << " read(" << nRecord << ") failed" << std::endl;
+            return NULL;
+        }
+        if( nDone == 0 && nPart == nLength )
+            return pPage + nOffset; // zero copy
+        memcpy(m_pRecordBuffer + nDone,pPage + nOffset,nPart);
+        nDone += nPart;
+    }
+    return m_pRecordBuffer;
+}
 
-            stringstream ss;
-            ss.precision(8); // ensure string conversion maintains single precision
-            ss << uvar.f;
-            return ss.str();
-        } else if( nMaxSize == 8)
+void DBF::cacheWrite(int64 nPos,const char *pData,size_t nBytes)
+{
+    // keep cached pages equal to the file, a write past the end of a short page drops that page
+    if( m_CacheMap.empty() || nBytes == 0 )
+        return;
+    for( int64 nPage = nPos/m_nCachePageSize ; nPage*m_nCachePageSize < nPos + (int64) nBytes ; nPage++ )
+    {
+        std::unordered_map<int64,int>::iterator it = m_CacheMap.find(nPage);
+        if( it == m_CacheMap.end() )
+            continue;
+        CachePage &page = m_CachePages[it->second];
+        int64 nStart = max(nPos,nPage*m_nCachePageSize);
+        int64 nEnd = min(nPos + (int64) nBytes,(nPage + 1)*m_nCachePageSize);
+        size_t nOffset = (size_t) (nStart - nPage*m_nCachePageSize);
+        if( nOffset + (size_t) (nEnd - nStart) > page.nValid )
         {
-            // double
-            union name1
-            {
-                uint8   n[8];
-                double     d;
-            } uvar;
-            uvar.d = 0;
-
-            uvar.n[0] = (uint8 ) m_pRecord[nOffset];
-            uvar.n[1] = (uint8 ) m_pRecord[nOffset+1];
-            uvar.n[2] = (uint8 ) m_pRecord[nOffset+2];
-            uvar.n[3] = (uint8 ) m_pRecord[nOffset+3];
-            uvar.n[4] = (uint8 ) m_pRecord[nOffset+4];
-            uvar.n[5] = (uint8 ) m_pRecord[nOffset+5];
-            uvar.n[6] = (uint8 ) m_pRecord[nOffset+6];
-            uvar.n[7] = (uint8 ) m_pRecord[nOffset+7];
-
-            stringstream ss;
-            ss.precision(17); // ensure string conversion maintains double precision
-            ss << uvar.d;
-            return ss.str();
+            page.nPage = -1;
+            m_CacheMap.erase(it);
+            continue;
         }
+        memcpy(page.pData + nOffset,pData + (nStart - nPos),(size_t) (nEnd - nStart));
     }
-    else if( cType == 'L' )
+}
+
+DBFStats DBF::getStats() const
+{
+    DBFStats stats;
+    stats.nCacheHits = m_nCacheHits;
+    stats.nCacheMisses = m_nCacheMisses;
+#ifndef DBF_NO_STATS
+    stats.nRecordsLoaded = m_Stats[STAT_RECORDS_LOADED];
+    stats.nRecordsAppended = m_Stats[STAT_RECORDS_APPENDED];
+    stats.nBytesRead = m_Stats[STAT_BYTES_READ];
+    stats.nBytesWritten = m_Stats[STAT_BYTES_WRITTEN];
+    stats.nReadCalls = m_Stats[STAT_READ_CALLS];
+    stats.nWriteCalls = m_Stats[STAT_WRITE_CALLS];
+    stats.nSeeks = m_Stats[STAT_SEEKS];
+    stats.nFlushes = m_Stats[STAT_FLUSHES];
+    stats.nSyncs = m_Stats[STAT_SYNCS];
+    stats.nHeaderWrites = m_Stats[STAT_HEADER_WRITES];
+    stats.nConversionFailures = m_Stats[STAT_CONVERSION_FAILURES];
+    for( int i = 0 ; i < DBF_STATS_TYPES ; i++ )
+        stats.nFieldDecodes[i] = m_Stats[STAT_DECODES + i];
+    if( m_pLatency != NULL )
     {
-        // Logical ,T = true, ?=NULL, F=False
-        if( strncmp(&(m_pRecord[nOffset]),"T",1) == 0 )
-            return "T";
-        else if( strncmp(&(m_pRecord[nOffset]),"?",1) == 0 )
-            return "?";
-        else
-            return "F";
-    } else
+        for( int i = 0 ; i < DBF_STATS_BUCKETS ; i++ )
+        {
+            stats.nLoadRecNs[i] = m_pLatency[i];
+            stats.nAppendRecordNs[i] = m_pLatency[DBF_STATS_BUCKETS + i];
+        }
+    }
+#endif
+    return stats;
+}
+
+void DBF::resetStats()
+{
+    resetCacheCounters();
+#ifndef DBF_NO_STATS
+    for( int i = 0 ; i < STAT_SLOTS ; i++ )
+        m_Stats[i] = 0;
+    if( m_pLatency != NULL )
     {
-        // Character type fields (default)
-        char dest[256]; // Fields can not exceed 255 chars
-        for( int i = 0 ; i < min(nMaxSize+1,256) ; i++ )
-            dest[i] = 0; // clear past end of usable string in case it is missing a terminator
-        strncpy(&dest[0],&m_pRecord[nOffset],nMaxSize);
+        for( int i = 0 ; i < 2*DBF_STATS_BUCKETS ; i++ )
+            m_pLatency[i] = 0;
+    }
+#endif
+}
 
-        stringstream ss;
-        ss << dest;
-        return ss.str();
+void DBF::setLatencyTracking(bool bTrack)
+{
+#ifndef DBF_NO_STATS
+    if( bTrack && m_pLatency == NULL )
+    {
+        // only tables that are timed pay for the histograms
+        m_pLatency = new std::atomic<int64>[2*DBF_STATS_BUCKETS];
+        for( int i = 0 ; i < 2*DBF_STATS_BUCKETS ; i++ )
+            m_pLatency[i] = 0;
     }
-    return "FAIL";
+    m_bTrackLatency = bTrack;
+#else
+    (void) bTrack;
+#endif
 }
 
-double DBF::readFieldAsDouble(int nField)
+void DBF::setStatsHook(const DBFStatsHook &hook,int nIntervalMs)
 {
-    // read the request field as a double to get higher performance for 'B' type fields only!
-    char cType = m_FieldDefinitions[nField].cFieldType;
-    int nOffset = m_FieldDefinitions[nField].uFieldOffset;
-    int nMaxSize = m_FieldDefinitions[nField].uLength;
+#ifndef DBF_NO_STATS
+    m_StatsHook = hook;
+    m_nStatsIntervalMs = max(0,nIntervalMs);
+    m_nNextStatsMs = steadyMilliseconds() + m_nStatsIntervalMs;
+#else
+    (void) hook;
+    (void) nIntervalMs;
+#endif
+}
 
-    if( cType == 'B' )
-    {
-        // handle real float or double
-        if( nMaxSize == 4)
-        {
-            // float
-            union name1
+#ifndef DBF_NO_STATS
+void DBF::countTick(int nSlot)
+{
+    int64 n = m_Stats[nSlot].load(std::memory_order_relaxed) + 1;
+    m_Stats[nSlot].store(n,std::memory_order_relaxed);
+    if( (n & 4095) == 0 && m_StatsHook )
+        checkStatsHook(); // the clock is only read once in a while
+}
+
+void DBF::checkStatsHook()
+{
+    int64 nNow = steadyMilliseconds();
+    if( nNow < m_nNextStatsMs )
+        return;
+    m_nNextStatsMs = nNow + m_nStatsIntervalMs;
+    m_StatsHook(*this,getStats());
+}
+#endif
+
+int DBF::readAt(void *pBuffer,size_t nBytes,int64 nPos) const
+{
+    // positional read that does not move the shared file position, safe to call from many threads
+    flushPending();
+    if( m_pMapping != NULL && nPos >= 0 && (size_t) nPos + nBytes <= m_nMapSize )
+        memcpy(pBuffer,m_pMapping + nPos,nBytes);
+    else if( readFileAt(pBuffer,nBytes,nPos) != 0 )
+        return 1;
+    applyPending((char *) pBuffer,nPos,nBytes);
+    return 0;
+}
+
+bool DBF::applyPending(char *pBuffer,int64 nPos,size_t nBytes) const
+{
+    // updates wait in the write-back cache until commit(), readers must see them like loadRec does
+    int64 nStart = m_FileHeader.uPositionOfFirstRecord;
+    int64 nEnd = nPos + (int64) nBytes;
+    if( m_DirtyPages.empty() || nEnd <= nStart || nBytes == 0 )
+        return false;
+    int nRecordLength = m_FileHeader.uRecordLength;
+    int nPageRecords = max(1,DBF_UPDATE_PAGE_SIZE/nRecordLength);
+    int nFirst = (int) ((max(nPos,nStart) - nStart)/nRecordLength);
+    int nLast = (int) min((int64) 2147483646,(nEnd - 1 - nStart)/nRecordLength);
+    bool bFound = false;
+    for( std::map<int,DirtyPage>::const_iterator it = m_DirtyPages.lower_bound(nFirst/nPageRecords) ;
+         it != m_DirtyPages.end() && it->first <= nLast/nPageRecords ; ++it )
+    {
+        const DirtyPage &page = it->second;
+        if( page.records.empty() )
+            continue; // dirtyRecord is still reading this page
+        int nPageFirst = it->first*nPageRecords;
+        int nLow = max(nPageFirst + page.nLow,nFirst);
+        int nHigh = min(nPageFirst + page.nHigh,nLast);
+        if( nHigh < nLow )
+            continue; // read but never changed, or outside the range
+        bFound = true;
+        if( pBuffer == NULL )
+            break;
+        int64 nFrom = max(recordPosition(nLow),nPos);
+        int64 nTo = min(recordPosition(nHigh + 1),nEnd);
+        memcpy(pBuffer + (nFrom - nPos),&page.records[(size_t) (nFrom - recordPosition(nPageFirst))],(size_t) (nTo - nFrom));
+    }
+    return bFound;
+}
+
+int DBF::readFileAt(void *pBuffer,size_t nBytes,int64 nPos) const
+{
+    // pread straight from the file, used where the mapping would fault in pages one at a time
+    flushPending();
+    if( m_pFileHandle == NULL )
+        return 1;
+#ifndef _WIN32
+    int fd = fileno(m_pFileHandle);
+    size_t nDone = 0;
+    while( nDone < nBytes )
+    {
+        ssize_t n = pread(fd,(char *) pBuffer + nDone,nBytes - nDone,(off_t) (nPos + nDone));
+        statAdd(STAT_READ_CALLS,1);
+        if( n < 0 && errno == EINTR )
+            continue;
+        if( n <= 0 )
+        {
+            std::cerr << __FUNCTION__ << " read at " << nPos << " failed, wanted " << nBytes << ", but got " << nDone << " bytes" << std::endl;
+            return 1;
+        }
+        nDone += n;
+        statAdd(STAT_BYTES_READ,n);
+    }
+    return 0;
+#else
+    // no pread, serialise access to the shared FILE
+    static std::mutex s_ReadLock;
+    std::lock_guard<std::mutex> guard(s_ReadLock);
+    statAdd(STAT_SEEKS,1);
+    if( dbfSeekFile(m_pFileHandle,nPos) != 0 )
+        return 1;
+    size_t nRead = fread(pBuffer,1,nBytes,m_pFileHandle);
+    statAdd(STAT_READ_CALLS,1);
+    statAdd(STAT_BYTES_READ,(int64) nRead);
+    return nRead == nBytes ? 0 : 1;
+#endif
+}
+
+int DBF::parallelScan(int nThreads,const DBFScanCallback &callback,int nChunkRecords,const DBFFilter *pFilter)
+{
+    // split [0,uRecordsInFile) into chunks, each worker reads a whole chunk with one positional read
+    // and hands the records to the callback through its own cursor
+    if( m_pFileHandle == NULL || !checkFilter(pFilter) )
+        return 1;
+    if( nChunkRecords < 1 )
+        nChunkRecords = 1;
+
+    int nRecords = m_FileHeader.uRecordsInFile;
+    int nChunks = (int) (((int64) nRecords + nChunkRecords - 1) / nChunkRecords);
+    nThreads = dbfDefaultThreadCount(nThreads);
+    int nRecordLength = m_FileHeader.uRecordLength;
+
+    vector<DBFCursor> cursors(nThreads,DBFCursor(*this));
+    vector< vector<char> > buffers(nThreads);
+    std::atomic<int> nErrors(0);
+
+    dbfParallelFor(nChunks,nThreads,[&](int nChunk,int nThread)
+    {
+        int nFirst = nChunk*nChunkRecords;
+        int nCount = min(nChunkRecords,nRecords - nFirst);
+
+        const char *pBlock = readBlock(nFirst,nCount,buffers[nThread]);
+        if( pBlock == NULL )
+        {
+            nErrors++;
+            return;
+        }
+
+        DBFCursor &cursor = cursors[nThread];
+        for( int r = 0 ; r < nCount ; r++ )
+        {
+            if( pFilter != NULL && !pFilter->matches(pBlock + (size_t) r*nRecordLength) )
+                continue;
+            cursor.m_pRecord = pBlock + (size_t) r*nRecordLength;
+            cursor.m_nRecord = nFirst + r;
+            callback(cursor,nFirst + r,nThread);
+        }
+    });
+
+    return nErrors == 0 ? 0 : 1;
+}
+
+const char *DBF::readBlock(int nFirst,int nCount,vector<char> &buffer) const
+{
+    // get nCount consecutive records, straight from the mapping when possible otherwise with one positional read
+    size_t nBytes = (size_t) nCount*m_FileHeader.uRecordLength;
+    int64 nPos = recordPosition(nFirst);
+    if( m_pMapping != NULL && (size_t) nPos + nBytes <= m_nMapSize && !applyPending(NULL,nPos,nBytes) )
+    {
+        flushPending();
+        return m_pMapping + nPos;
+    }
+
+    if( buffer.size() < nBytes )
+        buffer.resize(nBytes);
+    if( readAt(&buffer[0],nBytes,nPos) != 0 )
+        return NULL;
+    return &buffer[0];
+}
+
+bool DBF::checkFilter(const DBFFilter *pFilter) const
+{
+    if( pFilter != NULL && !pFilter->isCompiled() )
+    {
+        std::cerr << "Filter must be compiled against the table before scanning" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int DBF::scan(const DBFRecordCallback &callback,const DBFFilter *pFilter,int nBlockRecords,int nFirst,int nCount)
+{
+    // sequential scan reading nBlockRecords records at a time, the filter is tested on the raw bytes
+    if( m_pFileHandle == NULL || !checkFilter(pFilter) )
+        return 1;
+    if( nBlockRecords < 1 )
+        nBlockRecords = 1;
+    int nEnd = m_FileHeader.uRecordsInFile;
+    if( nFirst < 0 )
+        nFirst = 0;
+    if( nCount >= 0 && nFirst + nCount < nEnd )
+        nEnd = nFirst + nCount;
+    int nRecordLength = m_FileHeader.uRecordLength;
+
+    vector<char> buffer;
+    for( int nBlockFirst = nFirst ; nBlockFirst < nEnd ; nBlockFirst += nBlockRecords )
+    {
+        int nRecords = min(nBlockRecords,nEnd - nBlockFirst);
+        const char *pData = readBlock(nBlockFirst,nRecords,buffer);
+        if( pData == NULL )
+            return 1;
+        for( int r = 0 ; r < nRecords ; r++ )
+        {
+            const char *pRecord = pData + (size_t) r*nRecordLength;
+            if( pFilter != NULL && !pFilter->matches(pRecord) )
+                continue;
+            if( !callback(pRecord,nBlockFirst + r) )
+                return 0;
+        }
+    }
+    return 0;
+}
+
+int DBF::scanReadAhead(const DBFRecordCallback &callback,const DBFFilter *pFilter,int nBlockRecords,int nFirst,int nCount,int nDepth)
+{
+    // a reader thread fills a ring of nDepth block buffers with one large pread each while this thread runs the
+    // callback on the blocks already read, so block k is decoded while block k+1 is still coming from the disk
+    if( m_pFileHandle == NULL || !checkFilter(pFilter) )
+        return 1;
+    int nRecordLength = m_FileHeader.uRecordLength;
+    if( nBlockRecords < 1 )
+        nBlockRecords = max(1,(4 << 20)/nRecordLength);
+    if( nDepth < 2 )
+        nDepth = 2;
+    int nEnd = m_FileHeader.uRecordsInFile;
+    if( nFirst < 0 )
+        nFirst = 0;
+    if( nCount >= 0 && nFirst + nCount < nEnd )
+        nEnd = nFirst + nCount;
+    if( nFirst >= nEnd )
+        return 0;
+    int nBlocks = (int) (((int64) nEnd - nFirst + nBlockRecords - 1)/nBlockRecords);
+
+    struct Slot
+    {
+        vector<char> data;
+        int nBlock; // block held, -1 when free
+        bool bFailed;
+    };
+    vector<Slot> slots(nDepth);
+    for( int i = 0 ; i < nDepth ; i++ )
+    {
+        slots[i].data.resize((size_t) nBlockRecords*nRecordLength);
+        slots[i].nBlock = -1;
+        slots[i].bFailed = false;
+    }
+    std::mutex lock;
+    std::condition_variable filled, freed;
+    bool bStop = false;
+
+    std::thread reader([&]()
+    {
+        for( int nBlock = 0 ; nBlock < nBlocks ; nBlock++ )
+        {
+            Slot &slot = slots[nBlock % nDepth];
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                freed.wait(guard,[&]() { return bStop || slot.nBlock < 0; });
+                if( bStop )
+                    return;
+            }
+            int nBlockFirst = nFirst + nBlock*nBlockRecords;
+            int nRecords = min(nBlockRecords,nEnd - nBlockFirst);
+            bool bFailed = readFileAt(&slot.data[0],(size_t) nRecords*nRecordLength,recordPosition(nBlockFirst)) != 0;
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                slot.bFailed = bFailed;
+                slot.nBlock = nBlock;
+            }
+            filled.notify_one();
+            if( bFailed )
+                return;
+        }
+    });
+    // the reader is stopped and joined however this function is left, a callback that throws included
+    struct ReaderGuard
+    {
+        std::thread &reader;
+        std::mutex &lock;
+        std::condition_variable &freed;
+        bool &bStop;
+        ~ReaderGuard()
+        {
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                bStop = true;
+            }
+            freed.notify_one();
+            reader.join();
+        }
+    } stopReader = {reader,lock,freed,bStop};
+
+    int nRet = 0;
+    for( int nBlock = 0 ; nBlock < nBlocks ; nBlock++ )
+    {
+        Slot &slot = slots[nBlock % nDepth];
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            filled.wait(guard,[&]() { return slot.nBlock == nBlock; });
+        }
+        if( slot.bFailed )
+        {
+            nRet = 1;
+            break;
+        }
+        int nBlockFirst = nFirst + nBlock*nBlockRecords;
+        int nRecords = min(nBlockRecords,nEnd - nBlockFirst);
+        applyPending(&slot.data[0],recordPosition(nBlockFirst),(size_t) nRecords*nRecordLength); // on this thread, the callback may update
+        bool bContinue = true;
+        for( int r = 0 ; r < nRecords && bContinue ; r++ )
+        {
+            const char *pRecord = &slot.data[(size_t) r*nRecordLength];
+            if( pFilter != NULL && !pFilter->matches(pRecord) )
+                continue;
+            bContinue = callback(pRecord,nBlockFirst + r);
+        }
+        if( !bContinue )
+            break;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            slot.nBlock = -1;
+        }
+        freed.notify_one();
+    }
+    return nRet;
+}
+
+int DBF::scanColumns(const vector<int> &nFields,const DBFBlockCallback &callback,int nBlockRecords,int nFirst,int nCount,const DBFFilter *pFilter)
+{
+    // read the records in big blocks and decode only the projected fields, one column at a time
+    if( m_pFileHandle == NULL || !checkFilter(pFilter) )
+        return 1;
+    for( size_t c = 0 ; c < nFields.size() ; c++ )
+    {
+        if( nFields[c] < 0 || nFields[c] >= m_nNumFields )
+        {
+            std::cerr << __FUNCTION__ << " Bad field index " << nFields[c] << std::endl;
+            return 1;
+        }
+    }
+    if( nBlockRecords < 1 )
+        nBlockRecords = 1;
+    int nEnd = m_FileHeader.uRecordsInFile;
+    if( nFirst < 0 )
+        nFirst = 0;
+    if( nCount >= 0 && nFirst + nCount < nEnd )
+        nEnd = nFirst + nCount;
+
+    DBFColumnBlock block;
+    block.nRecordLength = m_FileHeader.uRecordLength;
+    block.columns.resize(nFields.size());
+    for( size_t c = 0 ; c < nFields.size() ; c++ )
+    {
+        block.columns[c].nField = nFields[c];
+        block.columns[c].cFieldType = m_FieldDefinitions[nFields[c]].cFieldType;
+    }
+
+    vector<char> buffer;
+    for( int nBlockFirst = nFirst ; nBlockFirst < nEnd ; nBlockFirst += nBlockRecords )
+    {
+        int nRecords = min(nBlockRecords,nEnd - nBlockFirst);
+        const char *pData = readBlock(nBlockFirst,nRecords,buffer);
+        if( pData == NULL )
+            return 1;
+
+        block.nFirstRecord = nBlockFirst;
+        block.nRecords = nRecords;
+        block.pData = pData;
+        decodeBlock(block,pFilter);
+
+        if( !callback(block) )
+            break; // caller has seen enough
+    }
+    return 0;
+}
+
+void DBF::decodeBlock(DBFColumnBlock &block,const DBFFilter *pFilter) const
+{
+    // transpose the raw records of the block into the column arrays
+    int nRecords = block.nRecords;
+    size_t nStride = block.nRecordLength;
+    const char *pData = block.pData;
+
+    block.uDeleted.assign((nRecords + 63)/64,0);
+    for( int r = 0 ; r < nRecords ; r++ )
+    {
+        if( pData[r*nStride] == DBF_DELETED_RECORD_FLAG )
+            block.uDeleted[r >> 6] |= 1ULL << (r & 63);
+    }
+
+    // evaluate the filter on the raw bytes first, rows that fail are skipped by the column decoders
+    block.uMatched.assign((nRecords + 63)/64,0);
+    block.nMatched = 0;
+    for( int r = 0 ; r < nRecords ; r++ )
+    {
+        if( pFilter == NULL || pFilter->matches(pData + r*nStride) )
+        {
+            block.uMatched[r >> 6] |= 1ULL << (r & 63);
+            block.nMatched++;
+        }
+    }
+    bool bAll = (block.nMatched == nRecords);
+
+    for( size_t c = 0 ; c < block.columns.size() ; c++ )
+    {
+        DBFColumn &col = block.columns[c];
+        const fieldDefinition &fd = m_FieldDefinitions[col.nField];
+        const char *pField = pData + fd.uFieldOffset;
+        int nLength = fd.uLength;
+        statAdd(STAT_DECODES + statTypeSlot(col.cFieldType),block.nMatched);
+
+        if( col.cFieldType == 'I' )
+        {
+            col.nValues.resize(nRecords);
+            int64 *pOut = &col.nValues[0];
+            if( nLength == 4 )
+            {
+                for( int r = 0 ; r < nRecords ; r++ )
+                {
+                    if( !bAll && !block.isMatched(r) )
+                    {
+                        pOut[r] = 0;
+                        continue;
+                    }
+                    int32_t n;
+                    memcpy(&n,pField + r*nStride,4);
+                    pOut[r] = n;
+                }
+            } else
+            {
+                for( int r = 0 ; r < nRecords ; r++ )
+                    pOut[r] = (bAll || block.isMatched(r)) ? decodeIntField(pField + r*nStride,nLength) : 0;
+            }
+        }
+        else if( col.cFieldType == 'B' )
+        {
+            col.dValues.resize(nRecords);
+            double *pOut = &col.dValues[0];
+            for( int r = 0 ; r < nRecords ; r++ )
+            {
+                if( (!bAll && !block.isMatched(r)) || !decodeBinaryFloat(pField + r*nStride,nLength,&pOut[r]) )
+                    pOut[r] = NAN;
+            }
+        }
+        else if( col.cFieldType == 'N' || col.cFieldType == 'F' )
+        {
+            col.dValues.resize(nRecords);
+            double *pOut = &col.dValues[0];
+            for( int r = 0 ; r < nRecords ; r++ )
+            {
+                if( (!bAll && !block.isMatched(r)) || dbfNumericToDouble(pField + r*nStride,nLength,&pOut[r]) != DBF_NUM_OK )
+                    pOut[r] = NAN; // empty or not a number
+            }
+        }
+        else if( isBinaryDateTime(fd) || isBinaryCurrency(fd) )
+        {
+            col.nValues.resize(nRecords);
+            int64 *pOut = &col.nValues[0];
+            bool bCurrency = col.cFieldType == 'Y';
+            for( int r = 0 ; r < nRecords ; r++ )
+            {
+                if( !bAll && !block.isMatched(r) )
+                    pOut[r] = DBF_COLUMN_EMPTY;
+                else if( bCurrency )
+                    dbfDecodeCurrency(pField + r*nStride,nLength,&pOut[r]);
+                else if( dbfDecodeDateTime(pField + r*nStride,nLength,&pOut[r]) != DBF_NUM_OK )
+                    pOut[r] = DBF_COLUMN_EMPTY;
+            }
+        }
+        else if( col.cFieldType == 'L' )
+        {
+            col.nValues.resize(nRecords);
+            int64 *pOut = &col.nValues[0];
+            for( int r = 0 ; r < nRecords ; r++ )
+            {
+                if( !bAll && !block.isMatched(r) )
+                {
+                    pOut[r] = 0;
+                    continue;
+                }
+                char ch = pField[r*nStride];
+                pOut[r] = (ch == 'T' || ch == 't' || ch == 'Y' || ch == 'y') ? 1 : (ch == '?' ? -1 : 0);
+            }
+        } else
+        {
+            // text, keep where the trimmed text is inside the block
+            col.uOffsets.resize(nRecords);
+            col.uLengths.resize(nRecords);
+            for( int r = 0 ; r < nRecords ; r++ )
+            {
+                if( !bAll && !block.isMatched(r) )
+                {
+                    col.uOffsets[r] = 0;
+                    col.uLengths[r] = 0;
+                    continue;
+                }
+                const char *pStart;
+                int nTextLen;
+                trimFieldText(pField + r*nStride,nLength,&pStart,&nTextLen);
+                col.uOffsets[r] = (unsigned int) (pStart - pData);
+                col.uLengths[r] = (unsigned short) nTextLen;
+            }
+            if( col.cFieldType == 'D' )
+            {
+                // dates also as day numbers, so time windows are integer compares
+                col.nValues.resize(nRecords);
+                for( int r = 0 ; r < nRecords ; r++ )
+                {
+                    if( col.uLengths[r] == 0 || dbfDecodeDate(pData + col.uOffsets[r],col.uLengths[r],&col.nValues[r]) != DBF_NUM_OK )
+                        col.nValues[r] = DBF_COLUMN_EMPTY;
+                }
+            }
+        }
+    }
+}
+
+DBFCursor::DBFCursor(const DBF &dbf)
+{
+    m_pDBF = &dbf;
+    m_Buffer.resize(max((int) dbf.m_FileHeader.uRecordLength,1),0);
+    m_pRecord = &m_Buffer[0];
+    m_nRecord = -1;
+}
+
+DBFCursor::DBFCursor(const DBFCursor &other)
+{
+    m_pDBF = other.m_pDBF;
+    m_Buffer = other.m_Buffer;
+    m_pRecord = &m_Buffer[0];
+    m_nRecord = -1;
+}
+
+int DBFCursor::loadRec(int nRecord)
+{
+    // like DBF::loadRec but with pread into this cursor's own buffer, so cursors can be used from different threads
+    if( nRecord < 0 || nRecord >= (int) m_pDBF->m_FileHeader.uRecordsInFile )
+        return 1;
+    int64 nPos = m_pDBF->recordPosition(nRecord);
+    size_t nLength = m_pDBF->m_FileHeader.uRecordLength;
+    if( m_pDBF->m_pMapping != NULL && (size_t) nPos + nLength <= m_pDBF->m_nMapSize && !m_pDBF->applyPending(NULL,nPos,nLength) )
+    {
+        m_pDBF->flushPending();
+        m_pRecord = m_pDBF->m_pMapping + nPos; // zero copy
+    }
+    else
+    {
+        m_pRecord = &m_Buffer[0];
+        if( m_pDBF->readAt(&m_Buffer[0],nLength,nPos) != 0 )
+        {
+            m_Buffer[0] = 0; // mark as invalid
+            m_nRecord = -1;
+            return 1;
+        }
+    }
+    m_nRecord = nRecord;
+    return 0;
+}
+
+bool DBF::isRecordDeleted()
+{
+    // works on currently loaded record, only the '*' flag means deleted
+    return m_pRecord[0] == DBF_DELETED_RECORD_FLAG;
+}
+
+static inline int lowestBit(uint64 u)
+{
+#if defined(__GNUC__)
+    return __builtin_ctzll(u);
+#else
+    int n = 0;
+    while( !(u & 1) )
+    {
+        u >>= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+int DBF::buildDeletionBitmap()
+{
+    // strided scan of byte 0 of every record, read in blocks (straight from the mapping when there is one)
+    if( m_pFileHandle == NULL )
+        return 1;
+    int nRecords = m_FileHeader.uRecordsInFile;
+    int nRecordLength = m_FileHeader.uRecordLength;
+    m_DeletedBits.assign(((size_t) nRecords + 63)/64,0);
+    m_nDeletedCount = 0;
+    m_bDeletionBitmap = true;
+
+    const int nBlockRecords = max(64,((4 << 20)/nRecordLength) & ~63); // whole bitmap words per block
+    vector<char> buffer;
+    for( int nFirst = 0 ; nFirst < nRecords ; nFirst += nBlockRecords )
+    {
+        int nCount = min(nBlockRecords,nRecords - nFirst);
+        const char *pData = readBlock(nFirst,nCount,buffer);
+        if( pData == NULL )
+        {
+            dropDeletionBitmap();
+            return 1;
+        }
+        for( int r = 0 ; r < nCount ; r++ )
+        {
+            if( pData[(size_t) r*nRecordLength] == DBF_DELETED_RECORD_FLAG )
+            {
+                int nRecord = nFirst + r;
+                m_DeletedBits[nRecord >> 6] |= 1ULL << (nRecord & 63);
+                m_nDeletedCount++;
+            }
+        }
+    }
+    return 0;
+}
+
+void DBF::dropDeletionBitmap()
+{
+    m_bDeletionBitmap = false;
+    vector<uint64>().swap(m_DeletedBits);
+    m_nDeletedCount = 0;
+}
+
+void DBF::growDeletionBitmap()
+{
+    // appended records are live, they only need room in the bitmap
+    if( m_bDeletionBitmap )
+        m_DeletedBits.resize(((size_t) m_FileHeader.uRecordsInFile + 63)/64,0);
+}
+
+void DBF::setDeletedBit(int nRecord, bool bDeleted)
+{
+    if( !m_bDeletionBitmap || nRecord < 0 || nRecord >= (int) m_FileHeader.uRecordsInFile )
+        return;
+    uint64 &uWord = m_DeletedBits[nRecord >> 6];
+    uint64 uBit = 1ULL << (nRecord & 63);
+    if( bDeleted && !(uWord & uBit) )
+    {
+        uWord |= uBit;
+        m_nDeletedCount++;
+    }
+    else if( !bDeleted && (uWord & uBit) )
+    {
+        uWord &= ~uBit;
+        m_nDeletedCount--;
+    }
+}
+
+int64 DBF::countLiveRecords()
+{
+    if( !m_bDeletionBitmap && buildDeletionBitmap() != 0 )
+        return -1;
+    return (int64) m_FileHeader.uRecordsInFile - m_nDeletedCount;
+}
+
+bool DBF::isDeleted(int nRecord)
+{
+    if( !m_bDeletionBitmap && buildDeletionBitmap() != 0 )
+        return false;
+    if( nRecord < 0 || nRecord >= (int) m_FileHeader.uRecordsInFile )
+        return false;
+    return (m_DeletedBits[nRecord >> 6] >> (nRecord & 63)) & 1;
+}
+
+int DBF::nextLiveRecord(int nRecord)
+{
+    // first live record >= nRecord, -1 when there is none. Whole words of deleted records are skipped at once
+    if( !m_bDeletionBitmap && buildDeletionBitmap() != 0 )
+        return -1;
+    if( nRecord < 0 )
+        nRecord = 0;
+    int nRecords = m_FileHeader.uRecordsInFile;
+    if( nRecord >= nRecords )
+        return -1;
+    size_t nWord = nRecord >> 6;
+    uint64 uLive = ~m_DeletedBits[nWord] & (~0ULL << (nRecord & 63));
+    while( uLive == 0 )
+    {
+        if( ++nWord >= m_DeletedBits.size() )
+            return -1;
+        uLive = ~m_DeletedBits[nWord];
+    }
+    int nNext = (int) (nWord*64 + lowestBit(uLive));
+    return nNext < nRecords ? nNext : -1;
+}
+
+int DBF::forEachLiveRecord(const std::function<bool(int nRecord)> &callback, int nFirst, int nCount)
+{
+    // walk the bitmap only, the records themselves are not read
+    if( !m_bDeletionBitmap && buildDeletionBitmap() != 0 )
+        return 1;
+    int nEnd = m_FileHeader.uRecordsInFile;
+    if( nFirst < 0 )
+        nFirst = 0;
+    if( nCount >= 0 && nFirst + nCount < nEnd )
+        nEnd = nFirst + nCount;
+    for( int nWordFirst = nFirst & ~63 ; nWordFirst < nEnd ; nWordFirst += 64 )
+    {
+        uint64 uLive = ~m_DeletedBits[nWordFirst >> 6];
+        if( nWordFirst < nFirst )
+            uLive &= ~0ULL << (nFirst - nWordFirst);
+        if( nEnd - nWordFirst < 64 )
+            uLive &= (1ULL << (nEnd - nWordFirst)) - 1;
+        while( uLive != 0 )
+        {
+            if( !callback(nWordFirst + lowestBit(uLive)) )
+                return 0;
+            uLive &= uLive - 1;
+        }
+    }
+    return 0;
+}
+
+int DBF::openMemo()
+{
+    // .fpt for FoxPro, .dbt for dBase (III when the table type says so, IV otherwise)
+    delete m_pMemo;
+    m_pMemo = NULL;
+    const char *pExtensions[] = {".fpt",".dbt"};
+    for( int i = 0 ; i < 2 ; i++ )
+    {
+        string sMemoFile = memoFileName(m_sFileName,pExtensions[i]);
+        FILE *pFile = fopen(sMemoFile.c_str(),"rb");
+        if( pFile == NULL )
+            continue;
+        fclose(pFile);
+        int nFormat = i == 0 ? DBF_MEMO_FPT : (m_FileHeader.u8FileType == 0x83 ? DBF_MEMO_DBT3 : DBF_MEMO_DBT4);
+        m_pMemo = new DBFMemo();
+        if( m_pMemo->open(sMemoFile,m_bAllowWrite,nFormat) == 0 )
+            return 0;
+        delete m_pMemo;
+        m_pMemo = NULL;
+        return 1;
+    }
+    std::cerr << __FUNCTION__ << " No memo file found for " << m_sFileName << ", memo fields can not be read" << std::endl;
+    return 1;
+}
+
+bool DBF::isMemoField(int nField) const
+{
+    return nField >= 0 && nField < m_nNumFields && isMemoType(m_FieldDefinitions[nField].cFieldType);
+}
+
+uint32 DBF::memoBlock(const char *pRecord,int nField) const
+{
+    // 4 byte little endian block number (Visual FoxPro) or ASCII digits, 0 / blank means no blob
+    const fieldDefinition &fd = m_FieldDefinitions[nField];
+    const uint8 *pField = (const uint8 *) pRecord + fd.uFieldOffset;
+    if( fd.uLength == 4 )
+        return (uint32) pField[0] | ((uint32) pField[1] << 8) | ((uint32) pField[2] << 16) | ((uint32) pField[3] << 24);
+    uint32 uBlock = 0;
+    for( int i = 0 ; i < fd.uLength ; i++ )
+    {
+        if( pField[i] >= '0' && pField[i] <= '9' )
+            uBlock = uBlock*10 + (pField[i] - '0');
+    }
+    return uBlock;
+}
+
+int DBF::readMemo(const char *pRecord,int nField,string_view &blob,vector<char> &buffer) const
+{
+    blob = string_view();
+    if( !isMemoField(nField) )
+    {
+        std::cerr << __FUNCTION__ << " field " << nField << " is not a memo field" << std::endl;
+        return 1;
+    }
+    if( m_pMemo == NULL )
+        return 1;
+    return m_pMemo->read(memoBlock(pRecord,nField),blob,buffer);
+}
+
+int DBF::encodeMemoValue(const char *pText,int nLen,int nField,char *pRecord,const char *pCurrent)
+{
+    // stage the blob in the memo file and store its first block in the record
+    const fieldDefinition &fd = m_FieldDefinitions[nField];
+    uint32 uCurrent = pCurrent != NULL ? memoBlock(pCurrent,nField) : 0;
+    if( uCurrent != 0 && nLen > 0 && m_pMemo != NULL )
+    {
+        // an unchanged value keeps its block, staging it again would leave the old block unused in the memo file
+        string_view blob;
+        vector<char> buffer;
+        if( m_pMemo->read(uCurrent,blob,buffer) == 0 && blob == string_view(pText,nLen) )
+        {
+            memcpy(pRecord + fd.uFieldOffset,pCurrent + fd.uFieldOffset,fd.uLength);
+            return 0;
+        }
+    }
+    uint32 uBlock = 0;
+    if( nLen > 0 )
+    {
+        uint32 uType = fd.cFieldType == 'M' ? DBF_MEMO_TYPE_TEXT : (fd.cFieldType == 'P' ? DBF_MEMO_TYPE_PICTURE : DBF_MEMO_TYPE_OBJECT);
+        if( m_pMemo != NULL )
+            uBlock = m_pMemo->stage(pText,nLen,uType);
+        if( uBlock == 0 )
+        {
+            std::cerr << __FUNCTION__ << " Unable to store memo for field " << fd.cFieldName << std::endl;
+            return 1;
+        }
+    }
+    char *pField = pRecord + fd.uFieldOffset;
+    if( fd.uLength == 4 )
+    {
+        for( int i = 0 ; i < 4 ; i++ )
+            pField[i] = (char) (uBlock >> (i*8));
+        return 0;
+    }
+    memset(pField,' ',fd.uLength);
+    for( int i = fd.uLength - 1 ; i >= 0 && uBlock != 0 ; i-- , uBlock /= 10 )
+        pField[i] = (char) ('0' + uBlock % 10);
+    return 0;
+}
+
+string DBF::readField(const char *pRecord,int nField) const
+{
+    // read the field from the given record, and output as a string because all modern languages can use a string
+
+    // depending on the field type, get the field and convert to a string  ( do not have documentation on the types, so this is all guesswork)
+    char cType = m_FieldDefinitions[nField].cFieldType;
+    int nOffset = m_FieldDefinitions[nField].uFieldOffset;
+    int nMaxSize = m_FieldDefinitions[nField].uLength;
+
+    /* possible types
+      C=char
+      Y=Currency (? format unknown, probably char)
+      N=Numeric (really just a char)
+      F=Float (really just a char)
+      D=Date (? format unknown, probably char)
+      T=Date Time (? format unknown, probably char)
+      B=Double (an actual double)
+      I=Integer (4 byte int)
+      L=Logical (char[1] with T=true,?=Null,F=False)
+      M=memo (big char field?)
+      G=General (?)
+      P=Picture (?)
+      ... others?  really no idea
+      treat all unhandled field types as C for now
+    */
+
+    if( isMemoType(cType) && m_pMemo != NULL )
+    {
+        // the text of the blob from the memo file
+        statAdd(STAT_DECODES + statTypeSlot(cType),1);
+        string_view blob;
+        vector<char> buffer;
+        if( m_pMemo->read(memoBlock(pRecord,nField),blob,buffer) != 0 )
+            return "";
+        return string(blob);
+    }
+
+    if( isBinaryDateTime(m_FieldDefinitions[nField]) || isBinaryCurrency(m_FieldDefinitions[nField]) )
+    {
+        // formatted by readFieldInto, "YYYY-MM-DD HH:MM:SS" or "1234.5600"
+        char buffer[32];
+        int nLen = readFieldInto(pRecord,nField,buffer,sizeof(buffer));
+        return string(buffer,nLen > 0 ? nLen : 0);
+    }
+    statAdd(STAT_DECODES + statTypeSlot(cType),1);
+    if( cType == 'I' )
+    {
+        // convert integer numbers up to 16 bytes long into a string
+        uint8 n[16];
+        for( int i = 0 ; i < nMaxSize ; i++ )
+            n[i] = (uint8 ) pRecord[nOffset+i];
+
+        return convertNumber(&n[0],nMaxSize);
+    }
+    else if( cType == 'B' )
+    {
+        // handle real float or double
+        if( nMaxSize == 4)
+        {
+            // float
+            union name1
             {
                 uint8   n[4];
                 float     f;
             } uvar;
             uvar.f = 0;
 
-            uvar.n[0] = (uint8 ) m_pRecord[nOffset];
-            uvar.n[1] = (uint8 ) m_pRecord[nOffset+1];
-            uvar.n[2] = (uint8 ) m_pRecord[nOffset+2];
-            uvar.n[3] = (uint8 ) m_pRecord[nOffset+3];
+            uvar.n[0] = (uint8 ) pRecord[nOffset];
+            uvar.n[1] = (uint8 ) pRecord[nOffset+1];
+            uvar.n[2] = (uint8 ) pRecord[nOffset+2];
+            uvar.n[3] = (uint8 ) pRecord[nOffset+3];
+
+            stringstream ss;
+            ss.precision(8); // ensure string conversion maintains single precision
+            ss << uvar.f;
+            return ss.str();
+        } else if( nMaxSize == 8)
+        {
+            // double
+            union name1
+            {
+                uint8   n[8];
+                double     d;
+            } uvar;
+            uvar.d = 0;
+
+            uvar.n[0] = (uint8 ) pRecord[nOffset];
+            uvar.n[1] = (uint8 ) pRecord[nOffset+1];
+            uvar.n[2] = (uint8 ) pRecord[nOffset+2];
+            uvar.n[3] = (uint8 ) pRecord[nOffset+3];
+            uvar.n[4] = (uint8 ) pRecord[nOffset+4];
+            uvar.n[5] = (uint8 ) pRecord[nOffset+5];
+            uvar.n[6] = (uint8 ) pRecord[nOffset+6];
+            uvar.n[7] = (uint8 ) pRecord[nOffset+7];
+
+            stringstream ss;
+            ss.precision(17); // ensure string conversion maintains double precision
+            ss << uvar.d;
+            return ss.str();
+        }
+    }
+    else if( cType == 'L' )
+    {
+        // Logical ,T = true, ?=NULL, F=False
+        if( strncmp(&(pRecord[nOffset]),"T",1) == 0 )
+            return "T";
+        else if( strncmp(&(pRecord[nOffset]),"?",1) == 0 )
+            return "?";
+        else
+            return "F";
+    } else
+    {
+        // Character type fields (default), text stops at the first NUL
+        const char *pField = &pRecord[nOffset];
+        const char *pEnd = (const char *) memchr(pField,0,nMaxSize);
+        return string(pField,pEnd ? pEnd - pField : nMaxSize);
+    }
+    return "FAIL";
+}
+
+double DBF::readFieldAsDouble(const char *pRecord,int nField) const
+{
+    // read the request field as a double without building a string, works for all field types
+    char cType = m_FieldDefinitions[nField].cFieldType;
+    const char *pField = &pRecord[m_FieldDefinitions[nField].uFieldOffset];
+    int nMaxSize = m_FieldDefinitions[nField].uLength;
+    statAdd(STAT_DECODES + statTypeSlot(cType),1);
+
+    if( cType == 'B' )
+    {
+        double d;
+        if( decodeBinaryFloat(pField,nMaxSize,&d) )
+            return d;
+    }
+    else if( cType == 'I' )
+    {
+        return (double) decodeIntField(pField,nMaxSize);
+    }
+    else if( cType == 'L' )
+    {
+        return isTrueLogical(pField[0]) ? 1.0 : 0.0;
+    }
+    else if( isBinaryCurrency(m_FieldDefinitions[nField]) )
+    {
+        int64 n;
+        dbfDecodeCurrency(pField,nMaxSize,&n);
+        return dbfScaledToDouble(n,DBF_CURRENCY_SCALE);
+    }
+    else if( isBinaryDateTime(m_FieldDefinitions[nField]) )
+    {
+        int64 nMs;
+        if( dbfDecodeDateTime(pField,nMaxSize,&nMs) == DBF_NUM_OK )
+            return (double) nMs; // milliseconds since 1970-01-01
+    } else
+    {
+        // 'N', 'F' and all the text types
+        double d;
+        if( dbfNumericToDouble(pField,nMaxSize,&d) == DBF_NUM_OK )
+            return d;
+    }
+    return -9e99; // fail !!!
+}
+
+int64 DBF::readFieldAsInt64(const char *pRecord,int nField) const
+{
+    // read the request field as an integer, fractions are rounded, 0 if the field is empty or not a number
+    char cType = m_FieldDefinitions[nField].cFieldType;
+    const char *pField = &pRecord[m_FieldDefinitions[nField].uFieldOffset];
+    int nMaxSize = m_FieldDefinitions[nField].uLength;
+    statAdd(STAT_DECODES + statTypeSlot(cType),1);
+
+    if( cType == 'I' )
+        return decodeIntField(pField,nMaxSize);
+    else if( cType == 'B' )
+    {
+        double d;
+        if( decodeBinaryFloat(pField,nMaxSize,&d) )
+            return llround(d);
+        return 0;
+    }
+    else if( cType == 'L' )
+        return isTrueLogical(pField[0]) ? 1 : 0;
+
+    int64 n;
+    if( isBinaryCurrency(m_FieldDefinitions[nField]) )
+    {
+        dbfDecodeCurrency(pField,nMaxSize,&n);
+        return rescaleCurrency(n,0);
+    }
+    if( isBinaryDateTime(m_FieldDefinitions[nField]) )
+        return dbfDecodeDateTime(pField,nMaxSize,&n) == DBF_NUM_OK ? n : 0; // milliseconds since 1970-01-01
+    if( dbfNumericToInt64(pField,nMaxSize,&n) == DBF_NUM_OK )
+        return n;
+    return 0;
+}
+
+int DBF::readFieldAsScaled(const char *pRecord,int nField,int64 *pnValue) const
+{
+    // exact fixed point value, scaled by 10^uNumberOfDecimalPlaces so 'N' money columns can be summed without drift
+    // returns one of the DBF_NUM_ codes, pnValue is untouched unless it is DBF_NUM_OK
+    char cType = m_FieldDefinitions[nField].cFieldType;
+    const char *pField = &pRecord[m_FieldDefinitions[nField].uFieldOffset];
+    int nMaxSize = m_FieldDefinitions[nField].uLength;
+    int nDecimals = m_FieldDefinitions[nField].uNumberOfDecimalPlaces;
+    statAdd(STAT_DECODES + statTypeSlot(cType),1);
+
+    if( cType == 'I' )
+    {
+        int64 n = decodeIntField(pField,nMaxSize);
+        for( int i = 0 ; i < nDecimals ; i++ )
+            n *= 10;
+        *pnValue = n;
+        return DBF_NUM_OK;
+    }
+    else if( cType == 'B' )
+    {
+        double d;
+        if( !decodeBinaryFloat(pField,nMaxSize,&d) )
+            return DBF_NUM_INVALID;
+        *pnValue = llround(d*pow(10.0,nDecimals));
+        return DBF_NUM_OK;
+    }
+    else if( cType == 'L' )
+    {
+        *pnValue = isTrueLogical(pField[0]) ? 1 : 0;
+        return DBF_NUM_OK;
+    }
+    else if( isBinaryCurrency(m_FieldDefinitions[nField]) )
+    {
+        int64 n;
+        dbfDecodeCurrency(pField,nMaxSize,&n);
+        *pnValue = rescaleCurrency(n,nDecimals);
+        return DBF_NUM_OK;
+    }
+    else if( isBinaryDateTime(m_FieldDefinitions[nField]) )
+        return dbfDecodeDateTime(pField,nMaxSize,pnValue);
+    return dbfNumericToScaled(pField,nMaxSize,nDecimals,pnValue);
+}
+
+int DBF::readFieldAsDate(const char *pRecord,int nField,int64 *pnDays) const
+{
+    // day number of a 'D' field, the date part of a 'T' field, or a date written as text in any other field
+    const fieldDefinition &fd = m_FieldDefinitions[nField];
+    const char *pField = &pRecord[fd.uFieldOffset];
+    statAdd(STAT_DECODES + statTypeSlot(fd.cFieldType),1);
 
-            return uvar.f;
-        } else if( nMaxSize == 8)
-        {
-            // double
-            union name1
-            {
-                uint8   n[8];
-                double     d;
-            } uvar;
-            uvar.d = 0;
+    if( fd.cFieldType == 'T' )
+    {
+        int64 nMs;
+        int nRes = dbfDecodeDateTime(pField,fd.uLength,&nMs);
+        if( nRes == DBF_NUM_OK )
+            *pnDays = nMs >= 0 ? nMs/DBF_MS_PER_DAY : -((-nMs + DBF_MS_PER_DAY - 1)/DBF_MS_PER_DAY);
+        return nRes;
+    }
+    if( fd.cFieldType == 'I' || fd.cFieldType == 'B' || fd.cFieldType == 'L' || isBinaryCurrency(fd) || isMemoType(fd.cFieldType) )
+        return DBF_NUM_INVALID;
+    return dbfDecodeDate(pField,fd.uLength,pnDays);
+}
+
+int DBF::readFieldAsDateTime(const char *pRecord,int nField,int64 *pnEpochMs) const
+{
+    // milliseconds since 1970-01-01 of a 'T' field, a 'D' field at midnight, or a date time written as text
+    const fieldDefinition &fd = m_FieldDefinitions[nField];
+    const char *pField = &pRecord[fd.uFieldOffset];
+    statAdd(STAT_DECODES + statTypeSlot(fd.cFieldType),1);
+
+    if( fd.cFieldType == 'T' )
+        return dbfDecodeDateTime(pField,fd.uLength,pnEpochMs);
+    if( fd.cFieldType == 'D' )
+    {
+        int64 nDays;
+        int nRes = dbfDecodeDate(pField,fd.uLength,&nDays);
+        if( nRes == DBF_NUM_OK )
+            *pnEpochMs = nDays*DBF_MS_PER_DAY;
+        return nRes;
+    }
+    if( fd.cFieldType == 'I' || fd.cFieldType == 'B' || fd.cFieldType == 'L' || isBinaryCurrency(fd) || isMemoType(fd.cFieldType) )
+        return DBF_NUM_INVALID;
+    return dbfParseDateTime(pField,fd.uLength,pnEpochMs);
+}
+
+int DBF::readFieldAsCurrency(const char *pRecord,int nField,int64 *pnScaled) const
+{
+    // exact money value*10^4, straight from the bytes of a 'Y' field, any other number is scaled to 4 places
+    const fieldDefinition &fd = m_FieldDefinitions[nField];
+    const char *pField = &pRecord[fd.uFieldOffset];
+    statAdd(STAT_DECODES + statTypeSlot(fd.cFieldType),1);
+
+    if( fd.cFieldType == 'Y' )
+        return dbfDecodeCurrency(pField,fd.uLength,pnScaled);
+    if( fd.cFieldType == 'I' )
+    {
+        *pnScaled = decodeIntField(pField,fd.uLength)*10000;
+        return DBF_NUM_OK;
+    }
+    if( fd.cFieldType == 'B' )
+    {
+        double d;
+        if( !decodeBinaryFloat(pField,fd.uLength,&d) )
+            return DBF_NUM_INVALID;
+        *pnScaled = llround(d*10000.0);
+        return DBF_NUM_OK;
+    }
+    if( fd.cFieldType == 'L' || fd.cFieldType == 'T' || isMemoType(fd.cFieldType) )
+        return DBF_NUM_INVALID;
+    return dbfNumericToScaled(pField,fd.uLength,DBF_CURRENCY_SCALE,pnScaled);
+}
+
+bool DBF::readFieldAsBool(const char *pRecord,int nField) const
+{
+    // 'L' fields are true for T or Y (any case), other types are true when non zero
+    char cType = m_FieldDefinitions[nField].cFieldType;
+    const char *pField = &pRecord[m_FieldDefinitions[nField].uFieldOffset];
+
+    if( cType == 'L' )
+    {
+        statAdd(STAT_DECODES + statTypeSlot(cType),1);
+        return isTrueLogical(pField[0]);
+    }
+    if( cType == 'C' )
+    {
+        statAdd(STAT_DECODES + statTypeSlot(cType),1);
+        const char *pStart;
+        int nLen;
+        trimFieldText(pField,m_FieldDefinitions[nField].uLength,&pStart,&nLen);
+        return nLen > 0 && (pStart[0] == 'T' || pStart[0] == 't' || pStart[0] == 'Y' || pStart[0] == 'y');
+    }
+    double d = readFieldAsDouble(pRecord,nField); // counts the decode
+    return d != 0.0 && d != -9e99;
+}
+
+string_view DBF::readFieldView(const char *pRecord,int nField) const
+{
+    // trimmed text of the field, pointing into the record. Binary fields ('I','B') have no text and give an empty view
+    char cType = m_FieldDefinitions[nField].cFieldType;
+    statAdd(STAT_DECODES + statTypeSlot(cType),1);
+    if( cType == 'I' || cType == 'B' || isBinaryDateTime(m_FieldDefinitions[nField]) || isBinaryCurrency(m_FieldDefinitions[nField]) )
+        return string_view();
+
+    const char *pStart;
+    int nLen;
+    trimFieldText(&pRecord[m_FieldDefinitions[nField].uFieldOffset],m_FieldDefinitions[nField].uLength,&pStart,&nLen);
+    return string_view(pStart,nLen);
+}
 
-            uvar.n[0] = (uint8 ) m_pRecord[nOffset];
-            uvar.n[1] = (uint8 ) m_pRecord[nOffset+1];
-            uvar.n[2] = (uint8 ) m_pRecord[nOffset+2];
-            uvar.n[3] = (uint8 ) m_pRecord[nOffset+3];
-            uvar.n[4] = (uint8 ) m_pRecord[nOffset+4];
-            uvar.n[5] = (uint8 ) m_pRecord[nOffset+5];
-            uvar.n[6] = (uint8 ) m_pRecord[nOffset+6];
-            uvar.n[7] = (uint8 ) m_pRecord[nOffset+7];
+int DBF::readFieldInto(const char *pRecord,int nField,char *pDest,size_t nDestSize) const
+{
+    // same text as readField() but written into the callers buffer, returns the length or -1 if it did not fit
+    if( pDest == NULL || nDestSize == 0 )
+        return -1;
+
+    char cType = m_FieldDefinitions[nField].cFieldType;
+    const char *pField = &pRecord[m_FieldDefinitions[nField].uFieldOffset];
+    int nMaxSize = m_FieldDefinitions[nField].uLength;
+    int nLen = 0;
+    statAdd(STAT_DECODES + statTypeSlot(cType),1);
 
-            return uvar.d;
+    if( cType == 'I' )
+    {
+        // readField shows the bytes as an unsigned number
+        uint64 u = 0;
+        for( int i = 0 ; i < nMaxSize && i < 8 ; i++ )
+            u |= ((uint64) (uint8) pField[i]) << (i*8);
+        nLen = snprintf(pDest,nDestSize,"%lld",(long long) u);
+    }
+    else if( cType == 'B' )
+    {
+        double d;
+        if( !decodeBinaryFloat(pField,nMaxSize,&d) )
+            nLen = snprintf(pDest,nDestSize,"FAIL");
+        else if( nMaxSize == 4 )
+            nLen = snprintf(pDest,nDestSize,"%.8g",d); // same precision as readField
+        else
+            nLen = snprintf(pDest,nDestSize,"%.17g",d);
+    }
+    else if( isBinaryDateTime(m_FieldDefinitions[nField]) || isBinaryCurrency(m_FieldDefinitions[nField]) )
+    {
+        char buffer[32];
+        int64 n;
+        if( cType == 'Y' )
+            nLen = dbfDecodeCurrency(pField,nMaxSize,&n) == DBF_NUM_OK ? dbfFormatCurrency(n,buffer) : 0;
+        else
+            nLen = dbfDecodeDateTime(pField,nMaxSize,&n) == DBF_NUM_OK ? dbfFormatDateTime(n,buffer) : 0; // empty is ""
+        if( (size_t) nLen >= nDestSize )
+        {
+            pDest[0] = 0;
+            return -1;
         }
+        memcpy(pDest,buffer,nLen);
+        pDest[nLen] = 0;
+        return nLen;
     }
-    return -9e99; // fail !!!
+    else if( cType == 'L' )
+    {
+        char c = pField[0];
+        if( c != 'T' && c != '?' )
+            c = 'F';
+        pDest[0] = c;
+        if( nDestSize < 2 )
+        {
+            pDest[0] = 0;
+            return -1;
+        }
+        pDest[1] = 0;
+        return 1;
+    } else
+    {
+        // character type, up to the first NUL
+        const char *pEnd = (const char *) memchr(pField,0,nMaxSize);
+        nLen = pEnd ? (int) (pEnd - pField) : nMaxSize;
+        if( (size_t) nLen >= nDestSize )
+        {
+            memcpy(pDest,pField,nDestSize-1);
+            pDest[nDestSize-1] = 0;
+            return -1;
+        }
+        memcpy(pDest,pField,nLen);
+        pDest[nLen] = 0;
+        return nLen;
+    }
+
+    if( nLen < 0 || (size_t) nLen >= nDestSize )
+        return -1; // snprintf truncated
+    return nLen;
 }
 
 int DBF::create(string sFileName,int nNumFields)
@@ -360,9 +2151,16 @@ int DBF::create(string sFileName,int nNumFields)
     {
         close();
     }
+    if( nNumFields < 1 || nNumFields > MAX_FIELDS )
+    {
+        std::cerr << __FUNCTION__ << " A table has 1 to " << MAX_FIELDS << " fields, not " << nNumFields << std::endl;
+        return 1;
+    }
     m_sFileName = sFileName;
     m_bAllowWrite = true;
     m_nNumFields = nNumFields;
+    m_FieldDefinitions.assign(nNumFields,fieldDefinition());
+    sizeRecordBuffer(1);
 
     m_pFileHandle = fopen(sFileName.c_str(),"wb+"); // create a new empty file for binary writing
     if( m_pFileHandle == NULL )
@@ -393,7 +2191,7 @@ int DBF::create(string sFileName,int nNumFields)
     m_FileHeader.uTableFlags = 0; // bit fields, copied from another db , 0x01=has a .cdx?, 0x02=Has Memo Fields, 0x04=is a .dbc?
 
     // write the File Header for the first time!
-    fwrite(&m_FileHeader,1,sizeof(m_FileHeader),m_pFileHandle);
+    writeFile(&m_FileHeader,sizeof(m_FileHeader));
 
     // now write dummy field definition records until the real ones can be specified
     for( int i = 0; i < nNumFields ; i++ )
@@ -409,36 +2207,35 @@ int DBF::create(string sFileName,int nNumFields)
         m_FieldDefinitions[i].uNextAutoIncrementValue[3]=0;
         m_FieldDefinitions[i].uLength=0;
         m_FieldDefinitions[i].uNumberOfDecimalPlaces=0;
-        m_FieldDefinitions[i].Reserved8[i]=0;
+        memset(m_FieldDefinitions[i].Reserved8,0,sizeof(m_FieldDefinitions[i].Reserved8));
 
         // write the definitions
-        fwrite(&m_FieldDefinitions[i],1,sizeof(fieldDefinition),m_pFileHandle);
+        writeFile(&m_FieldDefinitions[i],sizeof(fieldDefinition));
     }
     // write the field definition termination character
     char FieldDefTermination[2];
     FieldDefTermination[0] = 0x0D;
     FieldDefTermination[1] = 0;
 
-    fwrite(FieldDefTermination,1,1,m_pFileHandle);
+    writeFile(FieldDefTermination,1);
     // write the 263 bytes of 0
     char cZero[263];
     for( int j=0; j<263;j++)
         cZero[j]=0;
 
-    fwrite(&cZero[0],1,263,m_pFileHandle);
+    writeFile(&cZero[0],263);
     // this is now the starting point for the first record
     // ready to assign the field definitions!
 
-    // make sure change is made permanent, we are not looking for speed, just reliability and compatibility
-    fflush(m_pFileHandle);
-
-    return 0;
+    m_bUnsynced = true;
+    return writeDone();
 }
 
 int DBF::updateFileHeader()
 {
     // move to file start
-    int nRes = fseek(m_pFileHandle,0,SEEK_SET);
+    statAdd(STAT_HEADER_WRITES,1);
+    int nRes = seekFile(0);
     if( nRes != 0)
         return 1; //fail
 
@@ -451,7 +2248,9 @@ int DBF::updateFileHeader()
     m_FileHeader.u8LastUpdateYear = nYear;
 
     // write the current header info
-    int nBytesWritten = fwrite(&m_FileHeader,1,sizeof(m_FileHeader),m_pFileHandle);
+    m_bUnsynced = true;
+    cacheWrite(0,(const char *) &m_FileHeader,sizeof(m_FileHeader));
+    int nBytesWritten = (int) writeFile(&m_FileHeader,sizeof(m_FileHeader));
     if( nBytesWritten != sizeof(m_FileHeader) )
     {
         // error!
@@ -464,6 +2263,11 @@ int DBF::updateFileHeader()
 int DBF::assignField(fieldDefinition fd,int nField)
 {
     // used to assign the field info ONLY if num records in file = 0 !!!
+    if( nField < 0 || nField >= m_nNumFields )
+    {
+        std::cerr << __FUNCTION__ << " invalid field " << nField << std::endl;
+        return 1;
+    }
     if( m_FileHeader.uRecordsInFile != 0)
     {
         std::cerr << __FUNCTION__ << " Failed to AssignField Can not change Fields once the File has records in it!" << std::endl;
@@ -494,136 +2298,695 @@ int DBF::assignField(fieldDefinition fd,int nField)
         fd.uLength = 8; // actual double, not text!
     }else if( fd.cFieldType=='L' )
     {
-        fd.uLength = 1;
-    } else
+        fd.uLength = 1;
+    }else if( isMemoType(fd.cFieldType) )
+    {
+        fd.uLength = 4; // binary block number into the .fpt
+    } else
+    {
+        //default case
+        if( fd.uLength < 1 )
+            fd.uLength=1;
+    }
+
+    // calculate the proper field offset based on corrected data
+    if( nField == 0 )
+        fd.uFieldOffset = 1;
+    else
+    {
+        fd.uFieldOffset = 1;
+        for( int i=0;i<nField;i++ )
+            fd.uFieldOffset += m_FieldDefinitions[i].uLength;
+    }
+
+    int nPosOfFieldDef = 32+nField*32;
+    int nRes = seekFile(nPosOfFieldDef);
+    if( nRes != 0)
+        return 1; //fail
+    m_bUnsynced = true;
+    cacheWrite(nPosOfFieldDef,(const char *) &fd,sizeof(fieldDefinition));
+    int nBytesWritten = (int) writeFile(&fd,sizeof(fieldDefinition));
+    if( nBytesWritten != sizeof(m_FileHeader) )
+    {
+        // error!
+        std::cerr << __FUNCTION__ << " Failed to update Field Definition!" << std::endl;
+        return 1;
+    }
+    // update the in memory definition too
+    m_FieldDefinitions[nField] = fd;
+
+    if( isMemoType(fd.cFieldType) && m_pMemo == NULL )
+    {
+        // first memo field, the table gets its .fpt
+        m_pMemo = new DBFMemo();
+        if( m_pMemo->create(memoFileName(m_sFileName,".fpt")) != 0 )
+        {
+            delete m_pMemo;
+            m_pMemo = NULL;
+            return 1;
+        }
+        m_FileHeader.uTableFlags |= 0x02;
+        if( updateFileHeader() != 0 )
+            return 1;
+    }
+
+    // update the total record length, and the header record!
+    m_FileHeader.uRecordLength = 1; // 1 byte for delete flag
+    for( int i=0;i<= nField ;i++ )
+        m_FileHeader.uRecordLength += m_FieldDefinitions[i].uLength;
+    sizeRecordBuffer(m_FileHeader.uRecordLength);
+    updateFileHeader();
+
+    return 0;
+}
+
+int DBF::encodeRecord(string *sValues,char *pRecord,const char *pCurrent)
+{
+    // convert the string values into the binary record layout, shared by all the append paths
+    // clear record
+    for( int i = 0 ; i < m_FileHeader.uRecordLength ; i++ )
+        pRecord[i] = 0;
+    pRecord[0] = ' '; // clear the deleted flag for the new record
+
+    for( int f=0;f<m_nNumFields;f++)
+    {
+        // pull field value out of string record
+        const string &sFieldValue = sValues[f];
+        if( isMemoType(m_FieldDefinitions[f].cFieldType) )
+        {
+            encodeMemoValue(sFieldValue.data(),(int) sFieldValue.length(),f,pRecord,pCurrent);
+            continue;
+        }
+        int res = encodeFieldValue(sFieldValue.data(),(int) sFieldValue.length(),f,pRecord);
+        if( res > 0 )
+            std::cerr << "Unable to convert '" << sFieldValue << "' to " << m_FieldDefinitions[f].cFieldType << " field of "
+                      << (int) m_FieldDefinitions[f].uLength << " bytes" << std::endl;
+    }
+    return 0;
+}
+
+// leading integer of the text like stream >> int does: skips white space, stops at the first non digit,
+// clamps to the range of the target and gives 0 when there are no digits
+static int64 parseLeadingInt(const char *pText,int nLen,int64 nMin,int64 nMax)
+{
+    int i = 0;
+    while( i < nLen && isspace((unsigned char) pText[i]) )
+        i++;
+    bool bNegative = false;
+    if( i < nLen && (pText[i] == '-' || pText[i] == '+') )
+        bNegative = pText[i++] == '-';
+    uint64 u = 0;
+    bool bOverflow = false;
+    for( ; i < nLen && pText[i] >= '0' && pText[i] <= '9' ; i++ )
+    {
+        if( u > (~0ULL - 9)/10 )
+            bOverflow = true;
+        else
+            u = u*10 + (pText[i] - '0');
+    }
+    if( bNegative )
+    {
+        if( bOverflow || u > (uint64) -(nMin + 1) + 1 )
+            return nMin;
+        return (int64) (0 - u);
+    }
+    if( bOverflow || u > (uint64) nMax )
+        return nMax;
+    return (int64) u;
+}
+
+int DBF::encodeFieldValue(const char *pText,int nLen,int nField,char *pRecord) const
+{
+    int nRes = encodeField(pText,nLen,nField,pRecord);
+    if( nRes != 0 )
+        statAdd(STAT_CONVERSION_FAILURES,1);
+    return nRes;
+}
+
+int DBF::encodeField(const char *pText,int nLen,int nField,char *pRecord) const
+{
+    // same conversions as ConvertStringToInt / ConvertStringToFloat but without stringstream or a string,
+    // writes every byte of the field so the record does not have to be cleared first
+    const fieldDefinition &fd = m_FieldDefinitions[nField];
+    char *pField = &pRecord[fd.uFieldOffset];
+    int nSize = fd.uLength;
+    char cType = fd.cFieldType;
+
+    if( isMemoType(cType) )
+    {
+        // blobs need the memo file, only appendRecord / updateRecord / updateField store them
+        memset(pField,nSize == 4 ? 0 : ' ',nSize);
+        return nLen > 0 ? 1 : 0;
+    }
+    if( cType == 'I' )
+    {
+        int64 n;
+        if( nSize == 2 )
+            n = parseLeadingInt(pText,nLen,-32768,32767);
+        else if( nSize == 4 )
+            n = parseLeadingInt(pText,nLen,-2147483647LL - 1,2147483647LL);
+        else if( nSize == 8 )
+            n = parseLeadingInt(pText,nLen,-9223372036854775807LL - 1,9223372036854775807LL);
+        else
+        {
+            memset(pField,0,nSize);
+            return 1; // fail
+        }
+        for( int i = 0 ; i < nSize ; i++ )
+            pField[i] = (char) ((uint64) n >> (i*8)); // little endian
+        return 0;
+    }
+    else if( cType == 'B' )
+    {
+        if( nSize != 4 && nSize != 8 )
+        {
+            memset(pField,0,nSize);
+            return 1; // fail
+        }
+        int i = 0;
+        while( i < nLen && isspace((unsigned char) pText[i]) )
+            i++;
+        if( i < nLen && pText[i] == '+' && i + 1 < nLen && pText[i+1] != '-' )
+            i++; // from_chars does not take a plus sign
+        if( nSize == 4 )
+        {
+            float f = 0;
+            if( std::from_chars(pText + i,pText + nLen,f).ec != std::errc() )
+                f = 0;
+            memcpy(pField,&f,4);
+        } else
+        {
+            double d = 0;
+            if( std::from_chars(pText + i,pText + nLen,d).ec != std::errc() )
+                d = 0;
+            memcpy(pField,&d,8);
+        }
+        return 0;
+    }
+    else if( cType == 'D' && nSize == 8 )
+    {
+        // stored as YYYYMMDD, also takes YYYY-MM-DD. Empty dates are blank like FoxPro writes them
+        int64 nDays;
+        int nRes = dbfParseDate(pText,nLen,&nDays);
+        if( nRes == DBF_NUM_OK )
+            dbfEncodeDate(nDays,pField);
+        else
+            memset(pField,' ',8);
+        return nRes == DBF_NUM_INVALID ? 1 : 0;
+    }
+    else if( isBinaryDateTime(fd) )
+    {
+        // julian day and milliseconds, both zero when empty
+        int64 nMs;
+        int nRes = dbfParseDateTime(pText,nLen,&nMs);
+        if( nRes == DBF_NUM_OK )
+            dbfEncodeDateTime(nMs,pField);
+        else
+            memset(pField,0,8);
+        return nRes == DBF_NUM_INVALID ? 1 : 0;
+    }
+    else if( isBinaryCurrency(fd) )
+    {
+        int64 nScaled = 0;
+        int nRes = dbfNumericToScaled(pText,nLen,DBF_CURRENCY_SCALE,&nScaled);
+        dbfEncodeCurrency(nRes == DBF_NUM_OK ? nScaled : 0,pField);
+        return nRes == DBF_NUM_OK || nRes == DBF_NUM_EMPTY ? 0 : 1;
+    }
+    else if( cType == 'L' )
+    {
+        // logical
+        if( (nLen == 1 && pText[0] == 'T') || (nLen == 4 && memcmp(pText,"TRUE",4) == 0) )
+            pField[0] = 'T';
+        else if( nLen == 1 && pText[0] == '?' )
+            pField[0] = '?';
+        else
+            pField[0] = 'F';
+        return 0;
+    }
+
+    // default for character type fields (and all unhandled field types), zero fill remainder of field
+    int nCopy = min(nLen,nSize);
+    memcpy(pField,pText,nCopy);
+    memset(pField + nCopy,0,nSize - nCopy);
+    return 0;
+}
+
+int DBF::appendRecord(string *sValues,int nNumValues)
+{
+    // used to add records to the dbf file (append to end of file only)
+    DBF_STAT_TIMER(1);
+    if( nNumValues != m_nNumFields )
+    {
+        std::cerr << "Can not add new record, wrong number of Values given, expected " << m_nNumFields << std::endl;
+        return 1;
+    }
+
+    if( m_bAppendSession )
+    {
+        // encode straight into the session buffer, it is written when full or at commitAppend()
+        char *pRecord = &m_AppendBuffer[m_nAppendPending*m_FileHeader.uRecordLength];
+        encodeRecord(sValues,pRecord);
+        for( size_t i = 0 ; i < m_Indexes.size() ; i++ )
+            m_Indexes[i]->insert(pRecord,m_FileHeader.uRecordsInFile + m_nAppendPending);
+        m_nAppendPending++;
+        countTick(STAT_RECORDS_APPENDED);
+        if( m_nAppendPending >= m_nAppendBufferRecords )
+            return flushAppendBuffer();
+        return 0;
+    }
+
+    // calculate the proper location for this record
+    if( m_FileHeader.uRecordsInFile >= 2147483647u )
+    {
+        std::cerr << __FUNCTION__ << " Table is full, record numbers would pass 2^31" << std::endl;
+        return 1;
+    }
+    int64 nRecPos = recordPosition(m_FileHeader.uRecordsInFile);
+    int nRes = seekFile(nRecPos);
+    if (nRes != 0 )
+    {
+        std::cerr << __FUNCTION__ << " Error seeking to new Record position " << std::endl;
+        return 1; //fail
+    }
+
+    // file position is now at end of file
+    encodeRecord(sValues,m_pRecordBuffer);
+
+    // write the record at the end of the file, after the memo blobs it points at
+    if( m_pMemo != NULL && m_pMemo->flush() != 0 )
+        return 1;
+    cacheWrite(nRecPos,m_pRecordBuffer,m_FileHeader.uRecordLength);
+    int nBytesWritten = (int) writeFile(&m_pRecordBuffer[0],m_FileHeader.uRecordLength);
+    if( nBytesWritten != m_FileHeader.uRecordLength )
+    {
+        std::cerr << __FUNCTION__ << " Failed to write new record ! wrote " << nBytesWritten
+                  << " bytes but wanted to write " <<  m_FileHeader.uRecordLength << "bytes" << std::endl;
+        return 1;
+    }
+
+    for( size_t i = 0 ; i < m_Indexes.size() ; i++ )
+        m_Indexes[i]->insert(m_pRecordBuffer,m_FileHeader.uRecordsInFile);
+
+    // update the header to reflect the New record count
+    m_FileHeader.uRecordsInFile++;
+    growDeletionBitmap();
+    updateFileHeader();
+    countTick(STAT_RECORDS_APPENDED);
+
+    return writeDone();
+}
+
+int DBF::beginAppend(int nBufferRecords)
+{
+    // start an append session, appendRecord() now encodes into one contiguous buffer
+    // that is written with a single fwrite when full, the header is only rewritten at commitAppend()
+    if( m_pFileHandle == NULL || !m_bAllowWrite )
+    {
+        std::cerr << __FUNCTION__ << " Can not append records to a read only or closed DBF!" << std::endl;
+        return 1;
+    }
+    if( m_bAppendSession )
+        return 0; // already started, keep buffering
+    if( nBufferRecords < 1 )
+        nBufferRecords = 1;
+
+    m_AppendBuffer.resize((size_t) nBufferRecords*m_FileHeader.uRecordLength);
+    m_nAppendBufferRecords = nBufferRecords;
+    m_nAppendPending = 0;
+    m_bAppendSession = true;
+    return 0;
+}
+
+int DBF::appendRecords(string *sValues,int nNumValues,int nNumRecords)
+{
+    // append nNumRecords rows, sValues holds nNumValues strings per row one row after the other
+    if( nNumValues != m_nNumFields )
+    {
+        std::cerr << "Can not add new records, wrong number of Values given, expected " << m_nNumFields << std::endl;
+        return 1;
+    }
+
+    bool bOwnSession = !m_bAppendSession;
+    if( bOwnSession && beginAppend(min(max(nNumRecords,1),4096)) != 0 )
+        return 1;
+
+    int nRet = 0;
+    for( int r = 0 ; r < nNumRecords && nRet == 0 ; r++ )
+        nRet = appendRecord(&sValues[r*nNumValues],nNumValues);
+
+    if( bOwnSession )
+    {
+        int nCommit = commitAppend();
+        if( nRet == 0 )
+            nRet = nCommit;
+    }
+    return nRet;
+}
+
+int DBF::attachIndex(DBFIndex *pIndex)
+{
+    if( pIndex == NULL || !pIndex->isOpen() )
+        return 1;
+    if( std::find(m_Indexes.begin(),m_Indexes.end(),pIndex) == m_Indexes.end() )
+        m_Indexes.push_back(pIndex);
+    return 0;
+}
+
+int DBF::detachIndex(DBFIndex *pIndex)
+{
+    vector<DBFIndex *>::iterator it = std::find(m_Indexes.begin(),m_Indexes.end(),pIndex);
+    if( it == m_Indexes.end() )
+        return 1;
+    m_Indexes.erase(it);
+    return 0;
+}
+
+int DBF::flushAppendBuffer()
+{
+    // write all the buffered records at the end of the file with one call
+    if( m_nAppendPending == 0 )
+        return 0;
+    if( writeRecordsAtEnd(&m_AppendBuffer[0],m_nAppendPending) != 0 )
+        return 1;
+    m_nAppendPending = 0;
+    return 0;
+}
+
+int DBF::writeRecordsAtEnd(const char *pRecords,int nNumRecords)
+{
+    if( (int64) m_FileHeader.uRecordsInFile + nNumRecords > 2147483647 )
+    {
+        std::cerr << __FUNCTION__ << " Table is full, record numbers would pass 2^31" << std::endl;
+        return 1;
+    }
+    int64 nRecPos = recordPosition(m_FileHeader.uRecordsInFile);
+    int nRes = seekFile(nRecPos);
+    if (nRes != 0 )
     {
-        //default case
-        if( fd.uLength < 1 )
-            fd.uLength=1;
+        std::cerr << __FUNCTION__ << " Error seeking to new Record position " << std::endl;
+        return 1; //fail
     }
 
-    // calculate the proper field offset based on corrected data
-    if( nField == 0 )
-        fd.uFieldOffset = 1;
-    else
+    size_t nBytes = (size_t) nNumRecords*m_FileHeader.uRecordLength;
+    if( m_pMemo != NULL && m_pMemo->flush() != 0 ) // the blobs go before the records that point at them
+        return 1;
+    m_bUnsynced = true;
+    cacheWrite(nRecPos,pRecords,nBytes);
+    size_t nBytesWritten = writeFile(pRecords,nBytes);
+    if( nBytesWritten != nBytes )
     {
-        fd.uFieldOffset = 1;
-        for( int i=0;i<nField;i++ )
-            fd.uFieldOffset += m_FieldDefinitions[i].uLength;
+        std::cerr << __FUNCTION__ << " Failed to write new records ! wrote " << nBytesWritten
+                  << " bytes but wanted to write " << nBytes << "bytes" << std::endl;
+        return 1;
     }
 
-    int nPosOfFieldDef = 32+nField*32;
-    int nRes = fseek(m_pFileHandle,nPosOfFieldDef,SEEK_SET);
-    if( nRes != 0)
-        return 1; //fail
-    int nBytesWritten = fwrite(&fd,1,sizeof(fieldDefinition),m_pFileHandle);
-    if( nBytesWritten != sizeof(m_FileHeader) )
+    m_FileHeader.uRecordsInFile += nNumRecords;
+    growDeletionBitmap();
+    return 0;
+}
+
+int DBF::appendRawRecords(const char *pRecords,int nNumRecords)
+{
+    // records that are already encoded (see encodeFieldValue) are written as one block
+    if( m_pFileHandle == NULL || !m_bAllowWrite )
     {
-        // error!
-        std::cerr << __FUNCTION__ << " Failed to update Field Definition!" << std::endl;
+        std::cerr << __FUNCTION__ << " Can not append records to a read only or closed DBF!" << std::endl;
         return 1;
     }
-    // update the in memory definition too
-    m_FieldDefinitions[nField] = fd;
+    if( nNumRecords <= 0 )
+        return 0;
+    if( flushAppendBuffer() != 0 ) // records buffered by appendRecord go first
+        return 1;
 
-    // update the total record length, and the header record!
-    m_FileHeader.uRecordLength = 1; // 1 byte for delete flag
-    for( int i=0;i<= nField ;i++ )
-        m_FileHeader.uRecordLength += m_FieldDefinitions[i].uLength;
-    updateFileHeader();
+    int nFirst = m_FileHeader.uRecordsInFile;
+    if( writeRecordsAtEnd(pRecords,nNumRecords) != 0 )
+        return 1;
+    statAdd(STAT_RECORDS_APPENDED,nNumRecords);
+    for( size_t i = 0 ; i < m_Indexes.size() ; i++ )
+    {
+        for( int r = 0 ; r < nNumRecords ; r++ )
+            m_Indexes[i]->insert(pRecords + (size_t) r*m_FileHeader.uRecordLength,nFirst + r);
+    }
 
-    return 0;
+    if( m_bAppendSession )
+        return 0; // header is written by commitAppend
+    int nRet = updateFileHeader();
+    if( writeDone() != 0 )
+        nRet = 1;
+    return nRet;
 }
 
-int DBF::appendRecord(string *sValues,int nNumValues)
+int DBF::commitAppend()
 {
-    // used to add records to the dbf file (append to end of file only)
+    int nRet = endAppendSession();
+    // make sure change is made permanent, once for the whole batch
+    if( syncCommit() != 0 )
+        nRet = 1;
+    return nRet;
+}
+
+int DBF::endAppendSession()
+{
+    // end the append session, write anything still buffered then the header once
+    if( !m_bAppendSession )
+        return 0;
+
+    int nRet = flushAppendBuffer();
+    m_bAppendSession = false;
+    m_nAppendPending = 0;
+    vector<char>().swap(m_AppendBuffer); // release the buffer
+
+    if( updateFileHeader() != 0 )
+        nRet = 1;
+    return nRet;
+}
+
+int DBF::updateRecord(int nRecord,string *sValues,int nNumValues)
+{
+    // same encoding as appendRecord, the delete flag of the record is kept
     if( nNumValues != m_nNumFields )
     {
-        std::cerr << "Can not add new record, wrong number of Values given, expected " << m_nNumFields << std::endl;
+        std::cerr << "Can not update record, wrong number of Values given, expected " << m_nNumFields << std::endl;
         return 1;
     }
+    char *pCached = dirtyRecord(nRecord);
+    if( pCached == NULL )
+        return 1;
+    vector<char> record(m_FileHeader.uRecordLength);
+    encodeRecord(sValues,&record[0],pCached);
+    record[0] = pCached[0];
+    return replaceRecord(nRecord,pCached,&record[0]);
+}
 
-    // calculate the proper location for this record
-    int nRecPos = 32 + 32*m_nNumFields + 264 + m_FileHeader.uRecordLength * m_FileHeader.uRecordsInFile;
-    int nRes = fseek(m_pFileHandle,nRecPos,SEEK_SET);
-    if (nRes != 0 )
+int DBF::updateField(int nRecord,int nField,string sValue)
+{
+    if( nField < 0 || nField >= m_nNumFields )
     {
-        std::cerr << __FUNCTION__ << " Error seeking to new Record position " << std::endl;
-        return 1; //fail
+        std::cerr << __FUNCTION__ << " invalid field " << nField << std::endl;
+        return 1;
+    }
+    char *pCached = dirtyRecord(nRecord);
+    if( pCached == NULL )
+        return 1;
+    vector<char> record(pCached,pCached + m_FileHeader.uRecordLength);
+    if( isMemoType(m_FieldDefinitions[nField].cFieldType) )
+    {
+        if( encodeMemoValue(sValue.data(),(int) sValue.length(),nField,&record[0],pCached) != 0 )
+            return 1;
     }
+    else if( encodeFieldValue(sValue.data(),(int) sValue.length(),nField,&record[0]) > 0 )
+        std::cerr << "Unable to convert '" << sValue << "' to " << m_FieldDefinitions[nField].cFieldType << " field of "
+                  << (int) m_FieldDefinitions[nField].uLength << " bytes" << std::endl;
+    return replaceRecord(nRecord,pCached,&record[0]);
+}
 
-    // clear record
-    for( int i = 0 ; i < m_FileHeader.uRecordLength ; i++ )
-        m_pRecord[i] = 0;
-    m_pRecord[0] = ' '; // clear the deleted flag for the new record
+int DBF::setUpdateCacheSize(int nPages)
+{
+    m_nMaxDirtyPages = max(1,nPages);
+    if( (int) m_DirtyPages.size() > m_nMaxDirtyPages )
+        return flushUpdates();
+    return 0;
+}
 
-    // file position is now at end of file
+int DBF::commit()
+{
+    // everything buffered goes to the file: the append session, then the updated pages, and then one sync for all
+    // of it as the sync policy says. Writes since the last commit share that sync
+    int nRet = endAppendSession();
+    if( flushUpdates() != 0 )
+        nRet = 1;
+    if( syncCommit() != 0 )
+        nRet = 1;
+    return nRet;
+}
+
+int DBF::setSyncPolicy(int nPolicy,int nValue)
+{
+    if( nPolicy < DBF_SYNC_NONE || nPolicy > DBF_SYNC_FSYNC_COMMIT )
+    {
+        std::cerr << __FUNCTION__ << " unknown sync policy " << nPolicy << std::endl;
+        return 1;
+    }
+    m_nSyncPolicy = nPolicy;
+    m_nSyncValue = max(1,nValue);
+    m_nWritesSinceFlush = 0;
+    m_nLastFlushMs = steadyMilliseconds();
+    return 0;
+}
 
+int DBF::writeDone()
+{
+    // one logical write is finished (an appendRecord, a delete call, ...), flush if the policy asks for it now
+#ifndef DBF_NO_STATS
+    if( m_StatsHook )
+        checkStatsHook();
+#endif
+    m_nWritesSinceFlush++;
+    if( m_nSyncPolicy == DBF_SYNC_FLUSH && m_nWritesSinceFlush < m_nSyncValue )
+        return 0;
+    if( m_nSyncPolicy == DBF_SYNC_INTERVAL && steadyMilliseconds() - m_nLastFlushMs < m_nSyncValue )
+        return 0;
+    if( m_nSyncPolicy != DBF_SYNC_FLUSH && m_nSyncPolicy != DBF_SYNC_INTERVAL )
+        return 0; // left for commit() or the OS
+    m_nWritesSinceFlush = 0;
+    m_nLastFlushMs = steadyMilliseconds();
+    return flushFile() == 0 ? 0 : 1;
+}
 
-    for( int f=0;f<m_nNumFields;f++)
+int DBF::syncCommit()
+{
+    // the end of a group of writes: flush them, and with DBF_SYNC_FSYNC_COMMIT wait until they are on the disk
+    if( m_nSyncPolicy == DBF_SYNC_NONE || !m_bUnsynced || m_pFileHandle == NULL )
+        return 0;
+    m_nWritesSinceFlush = 0;
+    m_nLastFlushMs = steadyMilliseconds();
+    if( m_nSyncPolicy == DBF_SYNC_FSYNC_COMMIT )
     {
-        // pull field value out of string record
-        string sFieldValue = sValues[f];
-        char cType = m_FieldDefinitions[f].cFieldType;
-        if( cType == 'I' )
+        statAdd(STAT_FLUSHES,1);
+        statAdd(STAT_SYNCS,1);
+        if( syncFile(m_pFileHandle,true) != 0 || (m_pMemo != NULL && m_pMemo->sync() != 0) )
         {
-            // convert string version of INT, into actual int, and save into the record
-            int res = ConvertStringToInt(sFieldValue,m_FieldDefinitions[f].uLength,&m_pRecord[m_FieldDefinitions[f].uFieldOffset]);
-            if( res > 0 )
-                std::cerr << "Unable to convert '" << sFieldValue << "' to int "
-                          << m_FieldDefinitions[f].uLength << " bytes" << std::endl;
+            std::cerr << __FUNCTION__ << " sync of " << m_sFileName << " failed, errno=" << errno << std::endl;
+            return 1;
         }
-        else if( cType== 'B' )
+        m_bUnflushed = false;
+    }
+    else if( flushFile() != 0 )
+        return 1;
+    m_bUnsynced = false;
+    return 0;
+}
+
+char *DBF::dirtyRecord(int nRecord)
+{
+    // the record inside its page in the write-back cache, the page is read on first touch
+    if( !m_bAllowWrite )
+    {
+        std::cerr << "Can not update records in a read only DBF!" << std::endl;
+        return NULL;
+    }
+    if( nRecord < 0 || nRecord >= (int) m_FileHeader.uRecordsInFile )
+    {
+        std::cerr << __FUNCTION__ << " record " << nRecord << " is out of range" << std::endl;
+        return NULL;
+    }
+    int nRecordLength = m_FileHeader.uRecordLength;
+    int nPageRecords = max(1,DBF_UPDATE_PAGE_SIZE/nRecordLength);
+    int nPage = nRecord/nPageRecords;
+    int nFirst = nPage*nPageRecords;
+    DirtyPage &page = m_DirtyPages[nPage];
+    int nHave = (int) (page.records.size()/nRecordLength);
+    if( nRecord - nFirst >= nHave )
+    {
+        // new page, or records were appended to a partial last page since it was cached
+        int nCount = min(nPageRecords,(int) m_FileHeader.uRecordsInFile - nFirst) - nHave;
+        vector<char> buffer;
+        const char *pData = readBlock(nFirst + nHave,nCount,buffer);
+        if( pData == NULL )
         {
-            // float or double
-            int res = ConvertStringToFloat(sFieldValue,m_FieldDefinitions[f].uLength,&m_pRecord[m_FieldDefinitions[f].uFieldOffset]);
-            if( res > 0 )
-            {
-                std::cerr << "Unable to convert '" << sFieldValue << "' to float "
-                          << m_FieldDefinitions[f].uLength << " bytes" << std::endl;
-            }
+            if( nHave == 0 )
+                m_DirtyPages.erase(nPage);
+            return NULL;
         }
-        else if( cType== 'L' )
+        page.records.insert(page.records.end(),pData,pData + (size_t) nCount*nRecordLength);
+        if( nHave == 0 )
         {
-            // logical
-            if( sFieldValue=="T" || sFieldValue=="TRUE" )
-                m_pRecord[m_FieldDefinitions[f].uFieldOffset] = 'T';
-            else if( sFieldValue=="?")
-                m_pRecord[m_FieldDefinitions[f].uFieldOffset] = '?';
-            else
-                m_pRecord[m_FieldDefinitions[f].uFieldOffset] = 'F';
-        } else
+            page.nLow = nPageRecords;
+            page.nHigh = -1;
+        }
+    }
+    return &page.records[(size_t) (nRecord - nFirst)*nRecordLength];
+}
+
+int DBF::replaceRecord(int nRecord,char *pCached,const char *pRecord)
+{
+    // copy the new bytes over the cached record, the indexes only hear about it when a key changes
+    int nRecordLength = m_FileHeader.uRecordLength;
+    if( pCached[0] != DBF_DELETED_RECORD_FLAG && !m_Indexes.empty() )
+    {
+        vector<char> oldKey, newKey;
+        for( size_t i = 0 ; i < m_Indexes.size() ; i++ )
         {
-            // default for character type fields (and all unhandled field types)
-            for( unsigned int j=0;j<m_FieldDefinitions[f].uLength;j++)
+            oldKey.resize(m_Indexes[i]->getKeyLength());
+            newKey.resize(oldKey.size());
+            m_Indexes[i]->encodeKey(pCached,&oldKey[0]);
+            m_Indexes[i]->encodeKey(pRecord,&newKey[0]);
+            if( oldKey != newKey )
             {
-                int n = m_FieldDefinitions[f].uFieldOffset + j;
-                if( j < sFieldValue.length() )
-                    m_pRecord[n] = sFieldValue[j];
-                else
-                    m_pRecord[n] = 0; // zero fill remainder of field
+                m_Indexes[i]->remove(pCached,nRecord);
+                m_Indexes[i]->insert(pRecord,nRecord);
             }
         }
     }
-    // write the record at the end of the file
-    int nBytesWritten = fwrite(&m_pRecord[0],1,m_FileHeader.uRecordLength,m_pFileHandle);
-    if( nBytesWritten != m_FileHeader.uRecordLength )
+    memcpy(pCached,pRecord,nRecordLength);
+
+    int nPageRecords = max(1,DBF_UPDATE_PAGE_SIZE/nRecordLength);
+    DirtyPage &page = m_DirtyPages[nRecord/nPageRecords];
+    page.nLow = min(page.nLow,nRecord % nPageRecords);
+    page.nHigh = max(page.nHigh,nRecord % nPageRecords);
+    if( (int) m_DirtyPages.size() > m_nMaxDirtyPages )
     {
-        std::cerr << __FUNCTION__ << " Failed to write new record ! wrote " << nBytesWritten
-                  << " bytes but wanted to write " <<  m_FileHeader.uRecordLength << "bytes" << std::endl;
-        return 1;
+        if( flushUpdates() != 0 )
+            return 1;
+        return writeDone();
     }
-
-    // update the header to reflect the New record count
-    m_FileHeader.uRecordsInFile++;
-    updateFileHeader();
-
-    // make sure change is made permanent, we are not looking for speed, just reliability and compatibility
-    fflush(m_pFileHandle);
     return 0;
 }
 
+int DBF::flushUpdates()
+{
+    // write the dirty spans in file order, spans that meet across pages go out as one write, then one flush
+    if( m_DirtyPages.empty() )
+        return 0;
+    int nRecordLength = m_FileHeader.uRecordLength;
+    int nPageRecords = max(1,DBF_UPDATE_PAGE_SIZE/nRecordLength);
+    int nRet = 0;
+    vector<char> run;
+    int nRunFirst = 0;
+    for( std::map<int,DirtyPage>::const_iterator it = m_DirtyPages.begin() ; it != m_DirtyPages.end() ; ++it )
+    {
+        const DirtyPage &page = it->second;
+        if( page.nHigh < page.nLow )
+            continue; // read but never changed
+        int nFirst = it->first*nPageRecords + page.nLow;
+        int nRunRecords = (int) (run.size()/nRecordLength);
+        if( !run.empty() && (nRunFirst + nRunRecords != nFirst || run.size() >= (4 << 20)) )
+        {
+            if( writeRecordsAt(nRunFirst,nRunRecords,&run[0]) != 0 )
+                nRet = 1;
+            run.clear();
+        }
+        if( run.empty() )
+            nRunFirst = nFirst;
+        run.insert(run.end(),page.records.begin() + (size_t) page.nLow*nRecordLength,
+                   page.records.begin() + (size_t) (page.nHigh + 1)*nRecordLength);
+    }
+    if( !run.empty() && writeRecordsAt(nRunFirst,(int) (run.size()/nRecordLength),&run[0]) != 0 )
+        nRet = 1;
+    m_DirtyPages.clear();
+    return nRet;
+}
+
 int DBF::markAsDeleted(int nRecord)
 {
     // mark this record as deleted
@@ -632,8 +2995,10 @@ int DBF::markAsDeleted(int nRecord)
         std::cerr << "Can not delete records from a read only DBF!" << std::endl;
         return 1;
     }
-    int nPos = m_FileHeader.uPositionOfFirstRecord + m_FileHeader.uRecordLength*nRecord;
-    int nRes = fseek(m_pFileHandle,nPos,SEEK_SET);
+    if( flushUpdates() != 0 ) // the flag is written straight to the file
+        return 1;
+    int64 nPos = recordPosition(nRecord);
+    int nRes = seekFile(nPos);
     if (nRes !=0 )
     {
         std::cerr << __FUNCTION__ << " Error loading record " << nRecord << std::endl;
@@ -642,18 +3007,30 @@ int DBF::markAsDeleted(int nRecord)
 
     char Rec[2];
 
-    int nBytesRead = fread(&Rec[0],1,1,m_pFileHandle);
+    int nBytesRead = (int) readFile(&Rec[0],1);
     if( nBytesRead != 1 )
     {
         std::cerr << __FUNCTION__ << "read(" << nRecord << ") failed, wanted 1, but got " << nBytesRead << " bytes";
         return 1; //fail
     }
 
-    if( Rec[0] == ' ' )
+    if( Rec[0] != DBF_DELETED_RECORD_FLAG )
     {
+        m_bUnsynced = true;
+        if( !m_Indexes.empty() )
+        {
+            // the indexes need the key of the record, read all of it
+            vector<char> record(m_FileHeader.uRecordLength);
+            if( readAt(&record[0],record.size(),nPos) == 0 )
+            {
+                for( size_t i = 0 ; i < m_Indexes.size() ; i++ )
+                    m_Indexes[i]->remove(&record[0],nRecord);
+            }
+        }
+
         // ok to delete, not marked as deleted yet
         // must re-seek to proper spot
-        int nRes = fseek(m_pFileHandle,nPos,SEEK_SET);
+        int nRes = seekFile(nPos);
         if (nRes !=0 )
         {
             std::cerr << __FUNCTION__ << " Error loading record " << nRecord << std::endl;
@@ -662,77 +3039,382 @@ int DBF::markAsDeleted(int nRecord)
 
         Rec[0] = DBF_DELETED_RECORD_FLAG;
         Rec[1] = 0;
-        int nBytesWritten = fwrite(&Rec[0],1,1,m_pFileHandle);
+        cacheWrite(nPos,&Rec[0],1);
+        int nBytesWritten = (int) writeFile(&Rec[0],1);
         if( nBytesWritten != 1 )
         {
             std::cerr << __FUNCTION__ << "delete(" << nRecord << ") failed, wanted to write 1 byte , but wrote " << nBytesWritten << " bytes, err=" << ferror(m_pFileHandle) << std::endl;
             return 1; //fail
         }
 
-        // make sure change is made permanent, we are not looking for speed, just reliability and compatibility
-        fflush(m_pFileHandle);
+        setDeletedBit(nRecord,true);
+        return writeDone();
     }
 
     // done
     return 0;
 }
 
-void DBF::dumpAsCSV()
+int DBF::markAsDeleted(const vector<int> &nRecords,int64 *pnChanged)
 {
-    // output the fields and records as a csv to the std output
-    // first column is deleted flag!
-    for( int f=0; f < m_nNumFields ; f++ )
+    return setDeleteFlags(nRecords,true,pnChanged);
+}
+
+int DBF::undelete(int nRecord)
+{
+    return setDeleteFlags(vector<int>(1,nRecord),false,NULL);
+}
+
+int DBF::undelete(const vector<int> &nRecords,int64 *pnChanged)
+{
+    return setDeleteFlags(nRecords,false,pnChanged);
+}
+
+bool DBF::changeDeleteFlag(char *pRecord,int nRecord,bool bDeleted)
+{
+    // flip the flag of a record held in a block buffer, the indexes and the bitmap follow
+    if( (pRecord[0] == DBF_DELETED_RECORD_FLAG) == bDeleted )
+        return false; // nothing to do
+    for( size_t i = 0 ; i < m_Indexes.size() ; i++ )
+    {
+        if( bDeleted )
+            m_Indexes[i]->remove(pRecord,nRecord);
+        else
+            m_Indexes[i]->insert(pRecord,nRecord);
+    }
+    pRecord[0] = bDeleted ? DBF_DELETED_RECORD_FLAG : ' ';
+    setDeletedBit(nRecord,bDeleted);
+    return true;
+}
+
+int DBF::writeRecordsAt(int nFirst,int nCount,const char *pRecords)
+{
+    size_t nBytes = (size_t) nCount*m_FileHeader.uRecordLength;
+    if( m_pMemo != NULL && m_pMemo->flush() != 0 )
+        return 1;
+    m_bUnsynced = true;
+    cacheWrite(recordPosition(nFirst),pRecords,nBytes);
+    if( seekFile(recordPosition(nFirst)) != 0 )
+    {
+        std::cerr << __FUNCTION__ << " Error seeking to record " << nFirst << std::endl;
+        return 1;
+    }
+    size_t nBytesWritten = writeFile(pRecords,nBytes);
+    if( nBytesWritten != nBytes )
+    {
+        std::cerr << __FUNCTION__ << " write at record " << nFirst << " failed, wanted " << nBytes << ", but wrote " << nBytesWritten << " bytes, err=" << ferror(m_pFileHandle) << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+int DBF::setDeleteFlags(vector<int> nRecords,bool bDeleted,int64 *pnChanged)
+{
+    // sorted records that lie close together share one read-modify-write block, the records in between are
+    // written back unchanged. One flush at the end instead of one per record
+    if( pnChanged != NULL )
+        *pnChanged = 0;
+    if( !m_bAllowWrite )
+    {
+        std::cerr << "Can not change the delete flag of records in a read only DBF!" << std::endl;
+        return 1;
+    }
+    std::sort(nRecords.begin(),nRecords.end());
+    nRecords.erase(std::unique(nRecords.begin(),nRecords.end()),nRecords.end());
+    if( nRecords.empty() )
+        return 0;
+    if( flushUpdates() != 0 )
+        return 1;
+    if( nRecords.front() < 0 || nRecords.back() >= (int) m_FileHeader.uRecordsInFile )
     {
-        string sFieldName = GetFieldName(f);
-        std::cout << "," << sFieldName ;
+        std::cerr << __FUNCTION__ << " record " << (nRecords.front() < 0 ? nRecords.front() : nRecords.back()) << " is out of range" << std::endl;
+        return 1;
     }
-    std::cout << std::endl;
 
-    for( int r = 0; r < m_FileHeader.uRecordsInFile ; r++ )
+    int nRecordLength = m_FileHeader.uRecordLength;
+    const int nGapRecords = max(1,(64 << 10)/nRecordLength); // coalesce records less than 64K apart
+    const int nMaxRecords = max(1,(4 << 20)/nRecordLength); // but keep a block below 4MB
+    vector<char> buffer;
+    vector<char> block;
+    int64 nChanged = 0;
+    int nRet = 0;
+    size_t i = 0;
+    while( i < nRecords.size() && nRet == 0 )
     {
-        loadRec(r);
-        if( isRecordDeleted() )
-            std::cout << DBF_DELETED_RECORD_FLAG; // show * for deleted records in first column
+        size_t j = i + 1;
+        while( j < nRecords.size() && nRecords[j] - nRecords[j-1] <= nGapRecords && nRecords[j] - nRecords[i] < nMaxRecords )
+            j++;
+        int nFirst = nRecords[i];
+        int nCount = nRecords[j-1] - nFirst + 1;
+        const char *pData = readBlock(nFirst,nCount,buffer);
+        if( pData == NULL )
+        {
+            nRet = 1;
+            break;
+        }
+        block.assign(pData,pData + (size_t) nCount*nRecordLength);
 
-        for( int f=0; f < m_nNumFields ; f++ )
+        // only the span between the first and the last changed record goes back to the file
+        int nLow = nCount, nHigh = -1;
+        for( size_t k = i ; k < j ; k++ )
         {
-            string s = readField(f);
-            // trim right spaces
-            for( int i = s.length()-1 ; i > 0 ; i-- )
+            int r = nRecords[k] - nFirst;
+            if( changeDeleteFlag(&block[(size_t) r*nRecordLength],nRecords[k],bDeleted) )
             {
-                if( s[i] == ' ' )
-                    s.erase(i,1);
-                else
-                    break; // done
+                nLow = min(nLow,r);
+                nHigh = max(nHigh,r);
+                nChanged++;
             }
-            // trim left spaces
-            for( int i = 0 ; i < s.length() ; i++ )
+        }
+        if( nHigh >= nLow && writeRecordsAt(nFirst + nLow,nHigh - nLow + 1,&block[(size_t) nLow*nRecordLength]) != 0 )
+            nRet = 1;
+        i = j;
+    }
+
+    if( nChanged > 0 && writeDone() != 0 )
+        nRet = 1;
+    if( pnChanged != NULL )
+        *pnChanged = nChanged;
+    return nRet;
+}
+
+int DBF::deleteWhere(const DBFFilter &filter,int64 *pnDeleted)
+{
+    // one pass over the table in blocks, a block is copied and written back only if something in it matches
+    if( pnDeleted != NULL )
+        *pnDeleted = 0;
+    if( !m_bAllowWrite )
+    {
+        std::cerr << "Can not delete records from a read only DBF!" << std::endl;
+        return 1;
+    }
+    if( !checkFilter(&filter) || flushUpdates() != 0 )
+        return 1;
+
+    int nRecords = m_FileHeader.uRecordsInFile;
+    int nRecordLength = m_FileHeader.uRecordLength;
+    const int nBlockRecords = max(1,(4 << 20)/nRecordLength);
+    vector<char> buffer;
+    vector<char> block;
+    int64 nDeleted = 0;
+    int nRet = 0;
+    for( int nFirst = 0 ; nFirst < nRecords && nRet == 0 ; nFirst += nBlockRecords )
+    {
+        int nCount = min(nBlockRecords,nRecords - nFirst);
+        const char *pData = readBlock(nFirst,nCount,buffer);
+        if( pData == NULL )
+        {
+            nRet = 1;
+            break;
+        }
+        int nLow = -1, nHigh = -1;
+        for( int r = 0 ; r < nCount ; r++ )
+        {
+            const char *pRecord = pData + (size_t) r*nRecordLength;
+            if( pRecord[0] != DBF_DELETED_RECORD_FLAG && filter.matches(pRecord) )
             {
-                if( s[i] == ' ' )
-                {
-                    s.erase(i,1);
-                    i--;
-                }
-                else
-                    break; // done
+                if( nLow < 0 )
+                    nLow = r;
+                nHigh = r;
             }
+        }
+        if( nLow < 0 )
+            continue;
+
+        block.assign(pData + (size_t) nLow*nRecordLength,pData + (size_t) (nHigh + 1)*nRecordLength);
+        for( int r = nLow ; r <= nHigh ; r++ )
+        {
+            char *pRecord = &block[(size_t) (r - nLow)*nRecordLength];
+            if( pRecord[0] != DBF_DELETED_RECORD_FLAG && filter.matches(pRecord) && changeDeleteFlag(pRecord,nFirst + r,true) )
+                nDeleted++;
+        }
+        if( writeRecordsAt(nFirst + nLow,nHigh - nLow + 1,&block[0]) != 0 )
+            nRet = 1;
+    }
+
+    if( nDeleted > 0 && writeDone() != 0 )
+        nRet = 1;
+    if( pnDeleted != NULL )
+        *pnDeleted = nDeleted;
+    return nRet;
+}
+
+// move sFrom over sTo, atomic on POSIX so a crash leaves either the old or the new file
+static int replaceFile(const string &sFrom,const string &sTo)
+{
+#ifndef _WIN32
+    if( rename(sFrom.c_str(),sTo.c_str()) != 0 )
+        return 1;
+    // the rename itself must reach the disk too
+    size_t nSlash = sTo.find_last_of('/');
+    string sDir = nSlash == string::npos ? "." : (nSlash == 0 ? "/" : sTo.substr(0,nSlash));
+    int fd = ::open(sDir.c_str(),O_RDONLY);
+    if( fd >= 0 )
+    {
+        fsync(fd);
+        ::close(fd);
+    }
+    return 0;
+#else
+    remove(sTo.c_str()); // rename does not replace on windows
+    return rename(sFrom.c_str(),sTo.c_str()) == 0 ? 0 : 1;
+#endif
+}
+
+int DBF::pack(vector<int> *pRecordMap,string sNewFile)
+{
+    // copy the live records into a temp file in big blocks, then rename it over the table (or to sNewFile).
+    // pRecordMap gets the new number of every old record, -1 for the deleted ones
+    if( m_pFileHandle == NULL )
+        return 1;
+    bool bInPlace = sNewFile.empty();
+    if( bInPlace && !m_bAllowWrite )
+    {
+        std::cerr << __FUNCTION__ << " Can not pack a read only DBF in place!" << std::endl;
+        return 1;
+    }
+    if( commit() != 0 )
+        return 1;
 
-            int nFind = s.find(",");
-            if( nFind > -1 )
+    string sTarget = bInPlace ? m_sFileName : sNewFile;
+    string sTemp = sTarget + ".pack";
+    FILE *pOut = fopen(sTemp.c_str(),"wb");
+    if( pOut == NULL )
+    {
+        std::cerr << __FUNCTION__ << " Unable to create " << sTemp << std::endl;
+        return errno;
+    }
+#ifndef _WIN32
+    if( bInPlace )
+    {
+        // the packed file takes the place of the table, it keeps its mode and (where we may) its owner
+        struct stat st;
+        if( fstat(fileno(m_pFileHandle),&st) == 0 )
+        {
+            if( fchmod(fileno(pOut),st.st_mode & 07777) != 0 )
+                std::cerr << __FUNCTION__ << " Unable to copy the mode of " << m_sFileName << " to " << sTemp << std::endl;
+            if( fchown(fileno(pOut),st.st_uid,st.st_gid) != 0 && errno != EPERM )
+                std::cerr << __FUNCTION__ << " Unable to copy the owner of " << m_sFileName << " to " << sTemp << std::endl;
+        }
+    }
+#endif
+
+    // field definitions are copied as they are, the header is written once at the end with the new count
+    int nRecords = m_FileHeader.uRecordsInFile;
+    int nRecordLength = m_FileHeader.uRecordLength;
+    vector<char> head(m_FileHeader.uPositionOfFirstRecord);
+    int nRet = readAt(&head[0],head.size(),0);
+    if( nRet == 0 && (fseek(pOut,sizeof(fileHeader),SEEK_SET) != 0
+                      || fwrite(&head[sizeof(fileHeader)],1,head.size() - sizeof(fileHeader),pOut) != head.size() - sizeof(fileHeader)) )
+        nRet = 1;
+
+    if( pRecordMap != NULL )
+        pRecordMap->assign(nRecords,-1);
+    const int nBlockRecords = max(1,(4 << 20)/nRecordLength);
+    vector<char> buffer;
+    vector<char> live((size_t) nBlockRecords*nRecordLength);
+    int nLive = 0;
+    for( int nFirst = 0 ; nFirst < nRecords && nRet == 0 ; nFirst += nBlockRecords )
+    {
+        int nCount = min(nBlockRecords,nRecords - nFirst);
+        const char *pData = readBlock(nFirst,nCount,buffer);
+        if( pData == NULL )
+        {
+            nRet = 1;
+            break;
+        }
+        // runs of live records are moved with one memcpy
+        size_t nBytes = 0;
+        int r = 0;
+        while( r < nCount )
+        {
+            if( pData[(size_t) r*nRecordLength] == DBF_DELETED_RECORD_FLAG )
             {
-                // put string in double quotes!
-                // need quotes (make sure string also does not have double quotes, NOT DONE!)
-                nFind = s.find("\"");
-                while( nFind > -1 )
-                {
-                    s[nFind] = '\''; // convert double quote(34) to single quote to prevent errors reading this csv
-                    nFind = s.find("\"");
-                }
-                std::cout << ",\"" << s << "\"";
+                r++;
+                continue;
+            }
+            int nRun = r;
+            while( nRun < nCount && pData[(size_t) nRun*nRecordLength] != DBF_DELETED_RECORD_FLAG )
+            {
+                if( pRecordMap != NULL )
+                    (*pRecordMap)[nFirst + nRun] = nLive + (nRun - r);
+                nRun++;
             }
-            else
-                std::cout << "," << s;
+            size_t nRunBytes = (size_t) (nRun - r)*nRecordLength;
+            memcpy(&live[nBytes],pData + (size_t) r*nRecordLength,nRunBytes);
+            nBytes += nRunBytes;
+            nLive += nRun - r;
+            r = nRun;
         }
-        std::cout << std::endl;
+        if( nBytes > 0 && fwrite(&live[0],1,nBytes,pOut) != nBytes )
+            nRet = 1;
+    }
+
+    if( nRet == 0 )
+    {
+        fileHeader header = m_FileHeader;
+        header.uRecordsInFile = nLive;
+        time_t t = time(NULL);
+        tm* timePtr = localtime(&t);
+        header.u8LastUpdateDay = timePtr->tm_mday;
+        header.u8LastUpdateMonth = timePtr->tm_mon+1;
+        header.u8LastUpdateYear = timePtr->tm_year % 100;
+        if( fseek(pOut,0,SEEK_SET) != 0 || fwrite(&header,1,sizeof(header),pOut) != sizeof(header) || syncFile(pOut) != 0 )
+            nRet = 1;
+    }
+    if( fclose(pOut) != 0 )
+        nRet = 1;
+    if( nRet != 0 )
+    {
+        std::cerr << __FUNCTION__ << " Failed to write " << sTemp << ", table is unchanged" << std::endl;
+        remove(sTemp.c_str());
+        return 1;
+    }
+
+    if( !bInPlace )
+    {
+        // the copy keeps pointing at the same blobs, give it its own memo file
+        if( m_pMemo != NULL && m_pMemo->copyTo(memoFileName(sTarget,m_pMemo->getFormat() == DBF_MEMO_FPT ? ".fpt" : ".dbt")) != 0 )
+            nRet = 1;
+        if( nRet == 0 )
+            nRet = replaceFile(sTemp,sTarget);
+        return nRet;
+    }
+
+    // swap the packed file in and open it again the same way, attached indexes are rebuilt for the new numbers
+    bool bMapped = m_pMapping != NULL;
+    int nAccessHint = m_nAccessHint;
+    bool bDeletionBitmap = m_bDeletionBitmap;
+    vector<DBFIndex *> indexes = m_Indexes;
+    closeFile(); // not close(), the caller did not close the table and everything is committed
+    nRet = replaceFile(sTemp,sTarget);
+    if( nRet != 0 )
+    {
+        std::cerr << __FUNCTION__ << " Unable to replace " << sTarget << " with " << sTemp << std::endl;
+        remove(sTemp.c_str());
+    }
+    if( openFile(sTarget,true,bMapped,nAccessHint,false) != 0 )
+        return 1;
+    if( bDeletionBitmap && buildDeletionBitmap() != 0 ) // nothing is deleted now, but the bitmap must be sized again
+        nRet = 1;
+    for( size_t i = 0 ; i < indexes.size() ; i++ )
+    {
+        if( indexes[i]->rebuild(*this) != 0 || attachIndex(indexes[i]) != 0 )
+            nRet = 1;
     }
+    return nRet;
+}
+
+void DBF::dumpAsCSV()
+{
+    // output the fields and records as a csv to the std output
+    // first column is deleted flag!
+    DBFCSVOptions options;
+    options.bDeletedColumn = true;
+    exportCSV([](const char *pData,size_t nBytes)
+    {
+        // through stdio so the text stays in order with anything written to std::cout
+        return fwrite(pData,1,nBytes,stdout) == nBytes ? 0 : 1;
+    },options);
+    fflush(stdout);
 }
@@ -22,17 +22,42 @@
 #include <errno.h>
 #include <math.h>
 #include <ctime>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <string_view>
+#include <stdlib.h>
+#include <functional>
+#include <atomic>
+#include <mutex>
 
 using namespace std;
 
 typedef unsigned char uint8;
-typedef short int uint16;
-typedef int uint32;
+typedef unsigned short uint16;
+typedef unsigned int uint32;
+typedef long long int64;
+typedef unsigned long long uint64;
 
 #define MAX_FIELDS 255
 #define DBF_DELETED_RECORD_FLAG '*' // found by reading with hex editor
+#define DBF_CACHE_PAGE_SIZE 16384 // default page size of the loadRec read cache
+#define DBF_UPDATE_PAGE_SIZE 4096 // bytes of records per page in the update write-back cache
+#define DBF_COLUMN_EMPTY (-9223372036854775807LL - 1) // an empty date in DBFColumn::nValues
 #define MAX_RECORD_SIZE 0xffff*50    // not idea if this is correct, but good enough for my needs
 
+// access pattern hints for open(), passed on to madvise/posix_fadvise
+#define DBF_ACCESS_NORMAL 0
+#define DBF_ACCESS_SEQUENTIAL 1 // reading from start to end, kernel can read ahead aggressively
+#define DBF_ACCESS_RANDOM 2 // scattered loadRec calls, read ahead is wasted
+
+// sync policies (setSyncPolicy), when writes are pushed out of the stdio buffer or onto the disk
+#define DBF_SYNC_NONE 0 // never, the OS decides (fclose still flushes)
+#define DBF_SYNC_FLUSH 1 // fflush after every nValue write operations, the default is after each one
+#define DBF_SYNC_INTERVAL 2 // fflush at a write operation when nValue ms have passed since the last flush
+#define DBF_SYNC_COMMIT 3 // fflush at commit(), commitAppend() and close() only
+#define DBF_SYNC_FSYNC_COMMIT 4 // fflush and fdatasync at commit(), commitAppend() and close(), survives a power cut
+
 struct fileHeader
 {
     uint8 u8FileType;
@@ -66,36 +91,352 @@ struct fieldDefinition
 // then the records start
 
 
+class DBF;
+class DBFCursor;
+class DBFFilter;
+class DBFIndex;
+class DBFMemo;
+struct DBFCSVOptions;
+struct DBFAggregate;
+struct DBFGroup;
+
+// one projected column of a DBFColumnBlock, which array is filled depends on the field type
+struct DBFColumn
+{
+    int nField; // index of the field in the table
+    char cFieldType;
+    vector<int64> nValues; // 'I' values, 'L' as 1=true, 0=false, -1=null('?'), 'D' as days and 'T' as milliseconds since
+                           // 1970-01-01, 'Y' as value*10^4. Empty dates are DBF_COLUMN_EMPTY
+    vector<double> dValues; // 'B', 'N' and 'F' values, NAN when the field is empty or not a number
+    vector<unsigned int> uOffsets; // all other types and 'D': start of the trimmed text, from DBFColumnBlock::pData
+    vector<unsigned short> uLengths; // and its length
+};
+
+// a block of consecutive records transposed into per column arrays, row r is record nFirstRecord+r
+struct DBFColumnBlock
+{
+    int nFirstRecord;
+    int nRecords;
+    int nRecordLength;
+    const char *pData; // the raw records of the block, only valid inside the callback
+    vector<uint64> uDeleted; // bit r is set when row r is deleted
+    vector<uint64> uMatched; // bit r is set when row r passed the filter (all rows without one), other rows are not decoded
+    int nMatched;
+    vector<DBFColumn> columns; // same order as the fields given to scanColumns
+
+    bool isDeleted(int r) const
+    {
+        return (uDeleted[r >> 6] >> (r & 63)) & 1;
+    }
+    bool isMatched(int r) const
+    {
+        return (uMatched[r >> 6] >> (r & 63)) & 1;
+    }
+    string_view getText(int nColumn, int r) const
+    {
+        return string_view(pData + columns[nColumn].uOffsets[r],columns[nColumn].uLengths[r]);
+    }
+};
+
+// callback for scanColumns, return false to stop the scan
+typedef std::function<bool(const DBFColumnBlock &block)> DBFBlockCallback;
+
+// callback for scan, pRecord is the raw record (decode it with the readField overloads that take a record), return false to stop
+typedef std::function<bool(const char *pRecord, int nRecord)> DBFRecordCallback;
+
+// callback for parallelScan, nThread is 0..nThreads-1 so per thread results can be kept without locking
+typedef std::function<void(DBFCursor &cursor, int nRecord, int nThread)> DBFScanCallback;
+
+// destination of exported text, gets large pieces of output and returns 0 if they were written
+typedef std::function<int(const char *pData, size_t nBytes)> DBFOutputSink;
+
+// 64 bit file positions for tables and memo files beyond 2GB, fseek / ftell only take a long (32 bits on Windows)
+int dbfSeekFile(FILE *pFile, int64 nPos, int nOrigin=SEEK_SET);
+int64 dbfFileSize(FILE *pFile); // flushes pending writes first, -1 on failure
+
+// Shared source of record buffers for processes that keep thousands of tables open (DBF::setBufferPool).
+// Released buffers are kept on free lists by power of two size and handed to the next table, thread safe.
+// The pool must outlive every table using it
+class DBFBufferPool
+{
+public:
+    DBFBufferPool(size_t nMaxFreeBytes=64 << 20); // free buffers kept for reuse, more are given back to the heap
+    ~DBFBufferPool();
+
+    char *acquire(size_t nBytes, size_t *pnCapacity); // *pnCapacity gets the real size, pass it back to release()
+    void release(char *pBuffer, size_t nCapacity);
+    size_t getFreeBytes();
+
+private:
+    std::mutex m_Lock;
+    vector<vector<char *> > m_FreeLists; // by log2 of the capacity
+    size_t m_nFreeBytes;
+    size_t m_nMaxFreeBytes;
+};
+
+// Per table instrumentation (DBF::getStats), counted in the table from open() on. Building with DBF_NO_STATS
+// compiles the counters out of every hot path and getStats() then only has the read cache numbers.
+// The latency histograms are only filled after setLatencyTracking(true), reading the clock costs more than a mapped loadRec
+#define DBF_STATS_BUCKETS 32 // latency buckets, bucket b counts calls taking [2^b,2^(b+1)) ns, the last one everything slower
+#define DBF_STATS_TYPES 27 // field types 'A'..'Z', the last slot for any other type byte
+
+struct DBFStats
+{
+    DBFStats(); // all zero
+
+    int64 nRecordsLoaded; // successful loadRec calls
+    int64 nRecordsAppended; // appendRecord and appendRawRecords
+    int64 nBytesRead; // read from the table file with fread / pread, reads through the mapping are not counted
+    int64 nBytesWritten;
+    int64 nReadCalls; // fread and pread calls on the table file
+    int64 nWriteCalls; // fwrite calls
+    int64 nSeeks;
+    int64 nFlushes; // fflush calls
+    int64 nSyncs; // fdatasync / fsync calls
+    int64 nHeaderWrites; // rewrites of the file header
+    int64 nConversionFailures; // values that could not be encoded into their field (stored empty), see encodeFieldValue
+    int64 nCacheHits; // loadRec read cache, see setReadCache
+    int64 nCacheMisses;
+    int64 nFieldDecodes[DBF_STATS_TYPES]; // calls of the readField family and column decodes, by field type
+    int64 nLoadRecNs[DBF_STATS_BUCKETS]; // latency histograms, see DBF_STATS_BUCKETS
+    int64 nAppendRecordNs[DBF_STATS_BUCKETS];
+
+    int64 getSyscalls() const // every call above that may enter the kernel
+    {
+        return nReadCalls + nWriteCalls + nSeeks + nFlushes + nSyncs;
+    }
+    int64 getFieldDecodes(char cType) const;
+    // latency that dFraction (0..1) of the calls stayed under, as the upper bound of its bucket in microseconds. 0 without samples
+    static double percentileMicros(const int64 *pHistogram, double dFraction);
+};
+
+// periodic dump hook (DBF::setStatsHook), runs on the thread that is using the table
+typedef std::function<void(const DBF &dbf, const DBFStats &stats)> DBFStatsHook;
+
 class DBF
 {
 public:
     DBF();
     ~DBF();
 
-    int open(string sFileName,bool bAllowWrite=false); // open an existing dbf file
+    int open(string sFileName,bool bAllowWrite=false,bool bMemoryMap=false,int nAccessHint=DBF_ACCESS_NORMAL); // open an existing dbf file, past 2^31-1 records only the first 2^31-1 are read and writes are refused
     int close();
+    void setVerbose(bool bVerbose) // open() prints the header and fields to std::cout unless this is false
+    {
+        m_bVerbose = bVerbose;
+    }
+    // take the record buffer (uRecordLength bytes) from pPool instead of the heap, NULL goes back to the heap
+    void setBufferPool(DBFBufferPool *pPool);
 
     int markAsDeleted(int nRecord); // mark this record as deleted
+    // bulk versions, the records are sorted and flags close together are rewritten in one block with a single flush
+    // pnChanged gets the number of records whose flag actually changed
+    int markAsDeleted(const vector<int> &nRecords, int64 *pnChanged=NULL);
+    // in place updates, values are encoded like appendRecord and the record keeps its delete flag. Changed records are held
+    // in a write-back cache of pages and written in file order by commit() or close(), or when more than the cache size of
+    // pages are dirty. loadRec, the scans and the cursors see the updates at once
+    int updateRecord(int nRecord, string *sValues, int nNumValues);
+    int updateField(int nRecord, int nField, string sValue);
+    int setUpdateCacheSize(int nPages); // default 4096 pages of DBF_UPDATE_PAGE_SIZE bytes
+    int commit(); // commitAppend() and write the updated pages
+    // every policy flushes at commit() except DBF_SYNC_NONE, so the writes since the last commit share one flush or sync
+    // (group commit). A bulk call such as markAsDeleted(vector) or appendRecords counts as one write operation
+    int setSyncPolicy(int nPolicy, int nValue=1); // one of the DBF_SYNC_ values
+    int getSyncPolicy() const
+    {
+        return m_nSyncPolicy;
+    }
+    int undelete(int nRecord); // clear the delete flag, the record is put back into the attached indexes
+    int undelete(const vector<int> &nRecords, int64 *pnChanged=NULL);
+    int deleteWhere(const DBFFilter &filter, int64 *pnDeleted=NULL); // delete every live record matching a compiled filter in one pass
+    int pack(vector<int> *pRecordMap=NULL, string sNewFile=""); // remove the deleted records, in place or into sNewFile
     int create(string sFileName,int nNumFields); // create a new dbf file with space for nNumFields
     int assignField(fieldDefinition myFieldDef,int nField); // used to assign the field info ONLY if num records in file = 0 !!!
     int appendRecord(string *sValues, int nNumValues); // used to append records to the end of the dbf file
 
-    int getFieldIndex(string sFieldName);
+    // bulk loading, records are encoded into one buffer and written in large blocks, the header is written once at commit
+    // records appended in a session are not visible to loadRec until they have been flushed
+    int beginAppend(int nBufferRecords=4096); // start an append session, appendRecord() calls are buffered until commitAppend()
+    int appendRecords(string *sValues, int nNumValues, int nNumRecords); // append nNumRecords rows of nNumValues strings each
+    int commitAppend(); // write any buffered records and update the header, called by close() too
+
+    // for bulk loaders that build records themselves: encode one value into its field of a record buffer
+    // (getRecordLength() bytes, byte 0 is the delete flag) and write whole blocks of finished records
+    int encodeFieldValue(const char *pText, int nLen, int nField, char *pRecord) const; // same rules as appendRecord
+    int appendRawRecords(const char *pRecords, int nNumRecords);
+
+    // attached indexes are kept up to date by appendRecord and markAsDeleted, the DBF does not own them
+    int attachIndex(DBFIndex *pIndex);
+    int detachIndex(DBFIndex *pIndex);
+
+    int getFieldIndex(string sFieldName) const;
     int loadRec(int nRecord); // load the record into memory
+    const char *loadRecPointer(int nRecord); // load the record and return a pointer to its bytes (NULL on failure), valid until the next loadRec
+    int setAccessHint(int nAccessHint); // DBF_ACCESS_NORMAL, DBF_ACCESS_SEQUENTIAL or DBF_ACCESS_RANDOM
     bool isRecordDeleted(); // check if loaded record is deleted
-    string readField(int nField); // read the request field as a string always from the loaded record!
-    double readFieldAsDouble(int nField); // read the request field as a double to get higher performance for 'B' type fields only!
 
-    void dumpAsCSV(); // output fields and records as csv to std output
+    // read cache for loadRec on files that are not memory mapped: nBytes of file aligned pages of nPageSize bytes with
+    // CLOCK eviction. loadRec points into the cached page (or copies a record that straddles two). Every write through
+    // this DBF updates the cached pages. nBytes=0 turns the cache off (the default). Cursors and scans do not use it
+    int setReadCache(size_t nBytes, int nPageSize=DBF_CACHE_PAGE_SIZE);
+    int64 getCacheHits() const
+    {
+        return m_nCacheHits;
+    }
+    int64 getCacheMisses() const
+    {
+        return m_nCacheMisses;
+    }
+    void resetCacheCounters()
+    {
+        m_nCacheHits = 0;
+        m_nCacheMisses = 0;
+    }
+
+    // instrumentation, see DBFStats. Counters are kept with relaxed loads and stores, not locked adds, so cursors and
+    // scans reading on several threads may lose the odd count. All of these do nothing when built with DBF_NO_STATS
+    DBFStats getStats() const;
+    void resetStats(); // the read cache counters too
+    void setLatencyTracking(bool bTrack); // time loadRec and appendRecord into the histograms, off by default
+    // call hook at most every nIntervalMs, checked every 4096 loads or appends and at every write operation.
+    // close() calls it once more with the final numbers. An empty hook turns it off
+    void setStatsHook(const DBFStatsHook &hook, int nIntervalMs);
+    const string &getFileName() const
+    {
+        return m_sFileName;
+    }
+
+    // deletion bitmap, one bit per record built from byte 0 of every record and kept up to date by markAsDeleted
+    // and the appends. The calls below build it on first use, live records are the ones not flagged '*'
+    int buildDeletionBitmap();
+    void dropDeletionBitmap();
+    bool hasDeletionBitmap() const
+    {
+        return m_bDeletionBitmap;
+    }
+    int64 countLiveRecords(); // -1 on failure
+    bool isDeleted(int nRecord); // without loading the record
+    int nextLiveRecord(int nRecord); // first live record >= nRecord, -1 if none
+    int forEachLiveRecord(const std::function<bool(int nRecord)> &callback, int nFirst=0, int nCount=-1); // return false to stop
+    string readField(int nField) // read the request field as a string always from the loaded record!
+    {
+        return readField(m_pRecord,nField);
+    }
+    string readField(const char *pRecord, int nField) const;
+
+    // typed accessors, these never allocate. All work on the loaded record or on any record pointer from loadRecPointer()
+    double readFieldAsDouble(int nField) // read any field as a double without building a string, -9e99 if it is not a number
+    {
+        return readFieldAsDouble(m_pRecord,nField);
+    }
+    int64 readFieldAsInt64(int nField) // read any field as an integer, fractions are rounded, 0 if empty
+    {
+        return readFieldAsInt64(m_pRecord,nField);
+    }
+    bool readFieldAsBool(int nField) // 'L' fields are true for T or Y, numbers are true when non zero
+    {
+        return readFieldAsBool(m_pRecord,nField);
+    }
+    string_view readFieldView(int nField) // trimmed text pointing into the record, valid until the next loadRec. Empty for 'I', 'B', 'T' and 'Y'
+    {
+        return readFieldView(m_pRecord,nField);
+    }
+    int readFieldInto(int nField, char *pDest, size_t nDestSize) // same text as readField() into pDest, returns length or -1 if too small
+    {
+        return readFieldInto(m_pRecord,nField,pDest,nDestSize);
+    }
+    int readFieldAsScaled(int nField, int64 *pnValue) // exact value*10^uNumberOfDecimalPlaces, returns a DBF_NUM_ code (0=ok)
+    {
+        return readFieldAsScaled(m_pRecord,nField,pnValue);
+    }
+    // date, time and money as numbers (see dbfdate.h), these return a DBF_NUM_ code and never allocate
+    int readFieldAsDate(int nField, int64 *pnDays) // 'D' (and 'T' or date text) as days since 1970-01-01
+    {
+        return readFieldAsDate(m_pRecord,nField,pnDays);
+    }
+    int readFieldAsDateTime(int nField, int64 *pnEpochMs) // 'T' (and 'D' at midnight) as milliseconds since 1970-01-01
+    {
+        return readFieldAsDateTime(m_pRecord,nField,pnEpochMs);
+    }
+    int readFieldAsCurrency(int nField, int64 *pnScaled) // 'Y' (and any number) as value*10^4
+    {
+        return readFieldAsCurrency(m_pRecord,nField,pnScaled);
+    }
+    double readFieldAsDouble(const char *pRecord, int nField) const;
+    int64 readFieldAsInt64(const char *pRecord, int nField) const;
+    bool readFieldAsBool(const char *pRecord, int nField) const;
+    string_view readFieldView(const char *pRecord, int nField) const;
+    int readFieldInto(const char *pRecord, int nField, char *pDest, size_t nDestSize) const;
+    int readFieldAsScaled(const char *pRecord, int nField, int64 *pnValue) const;
+    int readFieldAsDate(const char *pRecord, int nField, int64 *pnDays) const;
+    int readFieldAsDateTime(const char *pRecord, int nField, int64 *pnEpochMs) const;
+    int readFieldAsCurrency(const char *pRecord, int nField, int64 *pnScaled) const;
+
+    // memo fields ('M', 'G', 'P') keep their blobs in the companion .fpt (or .dbt) file, see dbfmemo.h. It is opened with
+    // the table when uTableFlags has 0x02 and created by assignField for the first memo field. readField returns the
+    // blob, readMemo a view into the mapped memo file. Nothing is read from the memo file unless a memo field is asked for
+    bool isMemoField(int nField) const;
+    bool hasMemoFile() const
+    {
+        return m_pMemo != NULL;
+    }
+    int readMemo(int nField, string_view &blob) // blob of the loaded record, valid until the next readMemo
+    {
+        return readMemo(m_pRecord,nField,blob,m_MemoBuffer);
+    }
+    int readMemo(const char *pRecord, int nField, string_view &blob, vector<char> &buffer) const; // thread safe, buffer holds blobs that are not mapped
+
+    void dumpAsCSV(); // output fields and records as csv to std output, first column is * for deleted records
+
+    // CSV export through a large output buffer, see DBFCSVOptions in dbfcsv.h. Rows are written in table order
+    int exportCSV(const DBFOutputSink &sink, const DBFCSVOptions &options);
+    int exportCSV(int nFileDescriptor, const DBFCSVOptions &options);
+
+    // read every record on nThreads threads (0 = all cores), the callback may be called from any of them at the same time
+    // and must only use the cursor it is given. Records are handed out in chunks of nChunkRecords, read with one pread each
+    // With a compiled filter only the matching records are given to the callback
+    int parallelScan(int nThreads, const DBFScanCallback &callback, int nChunkRecords=4096, const DBFFilter *pFilter=NULL);
+    int readAt(void *pBuffer, size_t nBytes, int64 nPos) const; // thread safe positional read, does not move the file position, sees uncommitted updates
+
+    // columnar scan, nFields are field indexes (see getFieldIndex). Records [nFirst,nFirst+nCount) are read nBlockRecords
+    // at a time and only the listed fields are decoded, nCount=-1 means to the end of the table
+    // With a compiled filter only the matching rows are decoded, see DBFColumnBlock::uMatched
+    int scanColumns(const vector<int> &nFields, const DBFBlockCallback &callback, int nBlockRecords=4096, int nFirst=0, int nCount=-1,
+                    const DBFFilter *pFilter=NULL);
+    // sequential scan in blocks, the callback gets each record (only the ones matching pFilter if given) in order
+    int scan(const DBFRecordCallback &callback, const DBFFilter *pFilter=NULL, int nBlockRecords=4096, int nFirst=0, int nCount=-1);
+    // the same scan for cold tables larger than memory: a reader thread keeps nDepth blocks in flight with large preads
+    // (never through the mapping) while the callback runs on this thread. nBlockRecords=0 means about 4MB per block
+    int scanReadAhead(const DBFRecordCallback &callback, const DBFFilter *pFilter=NULL, int nBlockRecords=0, int nFirst=0, int nCount=-1,
+                      int nDepth=3);
+    // count, sum, min, max and average of one 'I', 'B', 'Y', 'N' or 'F' field over the live (and matching) records
+    // of [nFirst,nFirst+nCount), see dbfaggregate.h. nThreads=0 uses all cores
+    int aggregate(int nField, DBFAggregate &result, const DBFFilter *pFilter=NULL, int nFirst=0, int nCount=-1, int nThreads=1);
+    // GROUP BY the nGroupFields ('C', 'I', 'L', 'T', 'Y' and other text types, not 'B' or memo fields) with count, sum,
+    // min and max of the numeric nValueFields per group. Groups come back sorted by their keys
+    int groupBy(const vector<int> &nGroupFields, const vector<int> &nValueFields, vector<DBFGroup> &groups,
+                const DBFFilter *pFilter=NULL, int nThreads=1);
 
     int GetNumRecords()
     {
         return m_FileHeader.uRecordsInFile;
     }
+    bool isMemoryMapped()
+    {
+        return m_pMapping != NULL;
+    }
     int GetNumFields()
     {
         return m_nNumFields;
     }
+    int getRecordLength() const
+    {
+        return m_FileHeader.uRecordLength;
+    }
+    const fieldDefinition &getFieldDefinition(int nField) const
+    {
+        return m_FieldDefinitions[nField];
+    }
     string GetFieldName(int nField)
     {
         return string(m_FieldDefinitions[nField].cFieldName);
@@ -108,7 +449,7 @@ public:
        return ss.str();//return a string with the contents of the stream
     }
 
-    string convertNumber(uint8 *n, int nSize)
+    string convertNumber(uint8 *n, int nSize) const
     {
        // convert any size of number (represented by n[] ) into a string
        long long nResult = 0;
@@ -223,13 +564,244 @@ private:
     bool m_bStructSizesOK; // this must be true for engine to work!
     bool m_bAllowWrite;
     fileHeader m_FileHeader;
-    fieldDefinition m_FieldDefinitions[MAX_FIELDS]; // allow a max of 255 fields
+    vector<fieldDefinition> m_FieldDefinitions; // allow a max of 255 fields
     int m_nNumFields; // number of fields in use
+    bool m_bVerbose;
+
+    friend class DBFCursor;
 
     int updateFileHeader();
+    const char *readBlock(int nFirst, int nCount, vector<char> &buffer) const; // NULL on failure
+    void decodeBlock(DBFColumnBlock &block, const DBFFilter *pFilter) const;
+    bool checkFilter(const DBFFilter *pFilter) const;
+    int64 recordPosition(int nRecord) const
+    {
+        return (int64) m_FileHeader.uPositionOfFirstRecord + (int64) m_FileHeader.uRecordLength*nRecord;
+    }
+    int encodeRecord(string *sValues,char *pRecord,const char *pCurrent=NULL); // build the binary record for appendRecord and updateRecord
+    int flushAppendBuffer();
+    int writeRecordsAtEnd(const char *pRecords, int nNumRecords); // at uRecordsInFile, the header is not updated
+    int writeRecordsAt(int nFirst, int nCount, const char *pRecords); // overwrite existing records, no flush
+    char *dirtyRecord(int nRecord); // the record in the write-back cache, NULL on failure
+    int replaceRecord(int nRecord, char *pCached, const char *pRecord);
+    int flushUpdates();
+    int openMemo();
+    uint32 memoBlock(const char *pRecord, int nField) const;
+    // stages the blob in the memo file, unless pCurrent (the record being updated) already points at the same value
+    int encodeMemoValue(const char *pText, int nLen, int nField, char *pRecord, const char *pCurrent=NULL);
+    int endAppendSession(); // commitAppend() without the sync
+    int writeDone(); // a write operation finished, flush as the sync policy says
+    int syncCommit(); // flush (or fdatasync) everything written since the last sync
+    int setDeleteFlags(vector<int> nRecords, bool bDeleted, int64 *pnChanged);
+    bool changeDeleteFlag(char *pRecord, int nRecord, bool bDeleted); // in a block buffer, true if the flag changed
+    int openFile(string sFileName, bool bAllowWrite, bool bMemoryMap, int nAccessHint, bool bVerbose); // open() without resetting the counters
+    int closeFile(); // close() without the commit and the stats hook
+    int mapFile(); // try to map the whole file read only, returns 0 if the mapping is in use
+    void unmapFile();
+    int sizeRecordBuffer(size_t nBytes); // grow m_pRecordBuffer to at least nBytes, keeps its contents
+    void freeRecordBuffer();
+
+    const char *m_pRecord; // the loaded record, points into m_pRecordBuffer or into the mapping
+    char *m_pRecordBuffer; // used by the stdio read path and to build new records, sized to the record length
+    size_t m_nRecordBufferSize;
+    DBFBufferPool *m_pBufferPool; // where m_pRecordBuffer came from, NULL for the heap
+
+    char *m_pMapping; // whole file mapped read only, NULL when using stdio
+    size_t m_nMapSize;
+    int m_nAccessHint;
+
+    bool m_bAppendSession; // true between beginAppend and commitAppend
+    vector<char> m_AppendBuffer; // encoded records waiting to be written
+    int m_nAppendPending; // number of records in m_AppendBuffer
+    int m_nAppendBufferRecords; // capacity of m_AppendBuffer in records
+
+    vector<DBFIndex *> m_Indexes; // attached indexes
+
+    bool m_bDeletionBitmap; // m_DeletedBits is built and maintained
+    vector<uint64> m_DeletedBits; // bit set = record deleted
+    int64 m_nDeletedCount;
+
+    struct DirtyPage
+    {
+        vector<char> records; // the records of the page as read, with the updates applied
+        int nLow, nHigh; // changed records of the page, nothing when nHigh < nLow
+    };
+    std::map<int,DirtyPage> m_DirtyPages; // write-back cache of updated records, by page number
+    int m_nMaxDirtyPages;
+
+    int m_nSyncPolicy;
+    int m_nSyncValue; // operations or ms for DBF_SYNC_FLUSH / DBF_SYNC_INTERVAL
+    int m_nWritesSinceFlush;
+    int64 m_nLastFlushMs;
+    bool m_bUnsynced; // written since the last syncCommit
+
+    struct CachePage
+    {
+        CachePage() : nPage(-1), nValid(0), bReferenced(false), pData(NULL) {}
+        int64 nPage; // file offset / page size, -1 when the frame is free
+        size_t nValid; // bytes read, short for the last page of the file
+        bool bReferenced; // CLOCK bit
+        char *pData; // into m_CacheData
+    };
+    vector<CachePage> m_CachePages;
+    vector<char> m_CacheData;
+    std::unordered_map<int64,int> m_CacheMap; // page number to frame
+    int m_nCachePageSize;
+    size_t m_nCacheHand;
+    int64 m_nCacheHits;
+    int64 m_nCacheMisses;
+    const char *cachePage(int64 nPage, size_t *pnValid); // NULL on failure
+    const char *cachedRecord(int nRecord);
+    void cacheWrite(int64 nPos, const char *pData, size_t nBytes);
+    void clearReadCache();
+
+    DBFMemo *m_pMemo; // NULL when the table has no memo file
+    vector<char> m_MemoBuffer;
+    void growDeletionBitmap();
+    void setDeletedBit(int nRecord, bool bDeleted);
+
+    // every call on m_pFileHandle goes through these so it is counted
+    int seekFile(int64 nPos)
+    {
+        statAdd(STAT_SEEKS,1);
+        return dbfSeekFile(m_pFileHandle,nPos);
+    }
+    size_t readFile(void *pBuffer, size_t nBytes)
+    {
+        size_t nRead = fread(pBuffer,1,nBytes,m_pFileHandle);
+        statAdd(STAT_READ_CALLS,1);
+        statAdd(STAT_BYTES_READ,(int64) nRead);
+        return nRead;
+    }
+    size_t writeFile(const void *pData, size_t nBytes)
+    {
+        size_t nWritten = fwrite(pData,1,nBytes,m_pFileHandle);
+        m_bUnflushed = true;
+        statAdd(STAT_WRITE_CALLS,1);
+        statAdd(STAT_BYTES_WRITTEN,(int64) nWritten);
+        return nWritten;
+    }
+    int flushFile()
+    {
+        m_bUnflushed = false;
+        statAdd(STAT_FLUSHES,1);
+        return fflush(m_pFileHandle);
+    }
+    // the mapping and pread only see what left the stdio buffer, whatever the sync policy holds back goes out first
+    void flushPending() const
+    {
+        if( m_bUnflushed.load(std::memory_order_relaxed) )
+        {
+            m_bUnflushed = false;
+            statAdd(STAT_FLUSHES,1);
+            fflush(m_pFileHandle);
+        }
+    }
+    mutable std::atomic<bool> m_bUnflushed; // written with writeFile since the last fflush
+    int readFileAt(void *pBuffer, size_t nBytes, int64 nPos) const; // readAt that always reads the file, never the mapping
+    // copies the updated records still in m_DirtyPages over bytes read from [nPos,nPos+nBytes), with pBuffer NULL it
+    // only tells whether any of them fall in that range
+    bool applyPending(char *pBuffer, int64 nPos, size_t nBytes) const;
+    int encodeField(const char *pText, int nLen, int nField, char *pRecord) const; // encodeFieldValue without the count
+
+    enum
+    {
+        STAT_RECORDS_LOADED, STAT_RECORDS_APPENDED, STAT_BYTES_READ, STAT_BYTES_WRITTEN, STAT_READ_CALLS, STAT_WRITE_CALLS,
+        STAT_SEEKS, STAT_FLUSHES, STAT_SYNCS, STAT_HEADER_WRITES, STAT_CONVERSION_FAILURES,
+        STAT_DECODES, // DBF_STATS_TYPES slots
+        STAT_SLOTS = STAT_DECODES + DBF_STATS_TYPES
+    };
+#ifndef DBF_NO_STATS
+    mutable std::atomic<int64> m_Stats[STAT_SLOTS];
+    void statAdd(int nSlot, int64 n) const
+    {
+        // a plain load and store instead of a locked add, the count is only approximate while several threads read
+        m_Stats[nSlot].store(m_Stats[nSlot].load(std::memory_order_relaxed) + n,std::memory_order_relaxed);
+    }
+    std::atomic<int64> *m_pLatency; // loadRec then appendRecord histograms, allocated by the first setLatencyTracking(true)
+    bool m_bTrackLatency;
+    DBFStatsHook m_StatsHook;
+    int m_nStatsIntervalMs;
+    int64 m_nNextStatsMs;
+    void countTick(int nSlot); // count a load or append, and look at the hook every 4096 of them
+    void checkStatsHook();
+#else
+    void statAdd(int, int64) const {} // compiled out
+    void countTick(int) {}
+#endif
+};
+
+// read only view of one record of a DBF that has its own record buffer and uses positional reads,
+// so any number of cursors can read the same open DBF from different threads.
+// The DBF must stay open and must not be written while cursors are in use.
+class DBFCursor
+{
+public:
+    DBFCursor(const DBF &dbf);
+    DBFCursor(const DBFCursor &other);
+
+    int loadRec(int nRecord); // load the record into this cursor
+    int getRecordNumber() const
+    {
+        return m_nRecord;
+    }
+    const char *getRecord() const
+    {
+        return m_pRecord;
+    }
+    bool isRecordDeleted() const
+    {
+        return m_pRecord[0] == DBF_DELETED_RECORD_FLAG;
+    }
+    string readField(int nField) const
+    {
+        return m_pDBF->readField(m_pRecord,nField);
+    }
+    double readFieldAsDouble(int nField) const
+    {
+        return m_pDBF->readFieldAsDouble(m_pRecord,nField);
+    }
+    int64 readFieldAsInt64(int nField) const
+    {
+        return m_pDBF->readFieldAsInt64(m_pRecord,nField);
+    }
+    bool readFieldAsBool(int nField) const
+    {
+        return m_pDBF->readFieldAsBool(m_pRecord,nField);
+    }
+    string_view readFieldView(int nField) const
+    {
+        return m_pDBF->readFieldView(m_pRecord,nField);
+    }
+    int readFieldInto(int nField, char *pDest, size_t nDestSize) const
+    {
+        return m_pDBF->readFieldInto(m_pRecord,nField,pDest,nDestSize);
+    }
+    int readFieldAsScaled(int nField, int64 *pnValue) const
+    {
+        return m_pDBF->readFieldAsScaled(m_pRecord,nField,pnValue);
+    }
+    int readFieldAsDate(int nField, int64 *pnDays) const
+    {
+        return m_pDBF->readFieldAsDate(m_pRecord,nField,pnDays);
+    }
+    int readFieldAsDateTime(int nField, int64 *pnEpochMs) const
+    {
+        return m_pDBF->readFieldAsDateTime(m_pRecord,nField,pnEpochMs);
+    }
+    int readFieldAsCurrency(int nField, int64 *pnScaled) const
+    {
+        return m_pDBF->readFieldAsCurrency(m_pRecord,nField,pnScaled);
+    }
 
-    char *m_pRecord;
+private:
+    friend class DBF;
+    DBFCursor &operator=(const DBFCursor &); // not assignable
 
+    const DBF *m_pDBF;
+    vector<char> m_Buffer; // own record buffer, used when the record is not in a mapping
+    const char *m_pRecord;
+    int m_nRecord;
 };
 
 #endif // DBF_H
@@ -0,0 +1,730 @@
+#include "dbfaggregate.h"
+#include "dbfnumeric.h"
+#include "dbffilter.h"
+#include "dbfparallel.h"
+#include "dbfdate.h"
+
+#include <algorithm>
+
+// Copyright (C) 2012 Ron Ostafichuk
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files
+// (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify,
+// merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR
+// IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define DBF_AGGREGATE_SSE2
+#endif
+
+#define AGG_INTEGER 0 // binary little endian integer
+#define AGG_CURRENCY 1 // binary 8 byte integer, 4 implied decimals
+#define AGG_TEXT 2 // 'N' / 'F' text
+#define AGG_DOUBLE 3 // 'B'
+
+static inline bool addOverflows(int64 a, int64 b, int64 *pnResult)
+{
+    int64 r = (int64) ((uint64) a + (uint64) b);
+    *pnResult = r;
+    return ((a ^ r) & (b ^ r)) < 0; // both operands have the other sign than the result
+}
+
+// running totals of one thread (or of one group), the scaled integer total is always nSum + dOverflowSum
+struct AggregatePartial
+{
+    int64 nCount;
+    int64 nSum; // exact scaled sum of the integer values while it fits
+    double dOverflowSum; // the rest once nSum would have overflowed
+    bool bOverflow;
+    int64 nMin;
+    int64 nMax;
+    int64 nIntegerCount;
+
+    double dSum; // values that are only known as doubles
+    double dMin;
+    double dMax;
+    int64 nDoubleCount;
+
+    AggregatePartial()
+    {
+        nCount = nSum = nIntegerCount = nDoubleCount = 0;
+        dOverflowSum = 0;
+        bOverflow = false;
+        nMin = 9223372036854775807LL;
+        nMax = -9223372036854775807LL - 1;
+        dSum = 0;
+        dMin = INFINITY;
+        dMax = -INFINITY;
+    }
+
+    void addToSum(int64 n)
+    {
+        int64 r;
+        if( bOverflow || addOverflows(nSum,n,&r) )
+        {
+            bOverflow = true;
+            dOverflowSum += (double) n;
+        }
+        else
+            nSum = r;
+    }
+    void addInteger(int64 n)
+    {
+        addToSum(n);
+        nMin = n < nMin ? n : nMin;
+        nMax = n > nMax ? n : nMax;
+        nIntegerCount++;
+        nCount++;
+    }
+    void addDouble(double d)
+    {
+        dSum += d;
+        dMin = d < dMin ? d : dMin;
+        dMax = d > dMax ? d : dMax;
+        nDoubleCount++;
+        nCount++;
+    }
+    void merge(const AggregatePartial &p)
+    {
+        nCount += p.nCount;
+        nIntegerCount += p.nIntegerCount;
+        nDoubleCount += p.nDoubleCount;
+        addToSum(p.nSum);
+        dOverflowSum += p.dOverflowSum;
+        bOverflow = bOverflow || p.bOverflow;
+        nMin = min(nMin,p.nMin);
+        nMax = max(nMax,p.nMax);
+        dSum += p.dSum;
+        dMin = min(dMin,p.dMin);
+        dMax = max(dMax,p.dMax);
+    }
+    void finish(int nScale, DBFAggregate &result) const;
+};
+
+void AggregatePartial::finish(int nScale, DBFAggregate &result) const
+{
+    result.nCount = nCount;
+    result.nScale = nScale;
+    result.bExact = false;
+    result.nScaledSum = result.nScaledMin = result.nScaledMax = 0;
+    result.dSum = 0;
+    result.dMin = result.dMax = NAN;
+    if( nCount == 0 )
+        return;
+
+    result.bExact = nDoubleCount == 0 && !bOverflow;
+    if( bOverflow )
+        result.dSum = ((double) nSum + dOverflowSum)/pow(10.0,nScale);
+    else
+        result.dSum = dbfScaledToDouble(nSum,nScale);
+    result.dSum += dSum;
+
+    double dLow = dMin;
+    double dHigh = dMax;
+    if( nIntegerCount > 0 )
+    {
+        result.nScaledSum = bOverflow ? 0 : nSum;
+        result.nScaledMin = nMin;
+        result.nScaledMax = nMax;
+        dLow = min(dLow,dbfScaledToDouble(nMin,nScale));
+        dHigh = max(dHigh,dbfScaledToDouble(nMax,nScale));
+    }
+    result.dMin = dLow;
+    result.dMax = dHigh;
+}
+
+// sum of n integers, false if it does not fit in 64 bits
+static bool sumInt64(const int64 *p, int n, int64 *pnSum)
+{
+    int i = 0;
+    int64 nSum = 0;
+#ifdef DBF_AGGREGATE_SSE2
+    __m128i acc = _mm_setzero_si128();
+    __m128i overflow = _mm_setzero_si128();
+    for( ; i + 2 <= n ; i += 2 )
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *) (p + i));
+        __m128i r = _mm_add_epi64(acc,v);
+        overflow = _mm_or_si128(overflow,_mm_and_si128(_mm_xor_si128(acc,r),_mm_xor_si128(v,r)));
+        acc = r;
+    }
+    if( _mm_movemask_pd(_mm_castsi128_pd(overflow)) != 0 )
+        return false;
+    int64 lanes[2];
+    _mm_storeu_si128((__m128i *) lanes,acc);
+    if( addOverflows(lanes[0],lanes[1],&nSum) )
+        return false;
+#endif
+    for( ; i < n ; i++ )
+    {
+        if( addOverflows(nSum,p[i],&nSum) )
+            return false;
+    }
+    *pnSum = nSum;
+    return true;
+}
+
+static void minMaxInt64(const int64 *p, int n, int64 *pnMin, int64 *pnMax)
+{
+    // no 64 bit compare before SSE4.2, kept branch free so the compiler can vectorise it where it can
+    int64 nMin = *pnMin;
+    int64 nMax = *pnMax;
+    for( int i = 0 ; i < n ; i++ )
+    {
+        nMin = p[i] < nMin ? p[i] : nMin;
+        nMax = p[i] > nMax ? p[i] : nMax;
+    }
+    *pnMin = nMin;
+    *pnMax = nMax;
+}
+
+static void sumMinMaxDouble(const double *p, int n, double *pdSum, double *pdMin, double *pdMax)
+{
+    int i = 0;
+    double dSum = 0;
+    double dMin = *pdMin;
+    double dMax = *pdMax;
+#ifdef DBF_AGGREGATE_SSE2
+    __m128d sum0 = _mm_setzero_pd();
+    __m128d sum1 = _mm_setzero_pd();
+    __m128d vMin = _mm_set1_pd(dMin);
+    __m128d vMax = _mm_set1_pd(dMax);
+    for( ; i + 4 <= n ; i += 4 )
+    {
+        __m128d a = _mm_loadu_pd(p + i);
+        __m128d b = _mm_loadu_pd(p + i + 2);
+        sum0 = _mm_add_pd(sum0,a);
+        sum1 = _mm_add_pd(sum1,b);
+        vMin = _mm_min_pd(vMin,_mm_min_pd(a,b));
+        vMax = _mm_max_pd(vMax,_mm_max_pd(a,b));
+    }
+    double lanes[2];
+    _mm_storeu_pd(lanes,_mm_add_pd(sum0,sum1));
+    dSum = lanes[0] + lanes[1];
+    _mm_storeu_pd(lanes,vMin);
+    dMin = min(lanes[0],lanes[1]);
+    _mm_storeu_pd(lanes,vMax);
+    dMax = max(lanes[0],lanes[1]);
+#endif
+    for( ; i < n ; i++ )
+    {
+        dSum += p[i];
+        dMin = p[i] < dMin ? p[i] : dMin;
+        dMax = p[i] > dMax ? p[i] : dMax;
+    }
+    *pdSum += dSum;
+    *pdMin = dMin;
+    *pdMax = dMax;
+}
+
+// how the values of a field are stored, see fieldKind()
+struct ValueField
+{
+    int nOffset;
+    int nLength;
+    int nKind;
+    int nScale; // decimals of the scaled integer values
+};
+
+// decode one value, returns 1 for a scaled integer in *pn, 2 for a double in *pd, 0 for no value (blank / NAN)
+static inline int decodeValue(const char *pField, const ValueField &vf, int64 *pn, double *pd)
+{
+    if( vf.nKind == AGG_INTEGER || vf.nKind == AGG_CURRENCY )
+    {
+        if( vf.nLength == 4 )
+        {
+            int32_t n;
+            memcpy(&n,pField,4);
+            *pn = n;
+            return 1;
+        }
+        uint64 u = 0;
+        int nBytes = min(vf.nLength,8);
+        for( int b = 0 ; b < nBytes ; b++ )
+            u |= ((uint64) (uint8) pField[b]) << (b*8);
+        if( nBytes > 0 && nBytes < 8 && (pField[nBytes-1] & 0x80) )
+            u |= ~(uint64) 0 << (nBytes*8);
+        *pn = (int64) u;
+        return 1;
+    }
+    if( vf.nKind == AGG_DOUBLE )
+    {
+        if( vf.nLength == 8 )
+            memcpy(pd,pField,8);
+        else
+        {
+            float f;
+            memcpy(&f,pField,4);
+            *pd = f;
+        }
+        return *pd == *pd ? 2 : 0; // NAN is not a value
+    }
+    int nRes = dbfNumericToScaled(pField,vf.nLength,vf.nScale,pn);
+    if( nRes == DBF_NUM_OK )
+        return 1;
+    if( nRes == DBF_NUM_OVERFLOW && dbfNumericToDouble(pField,vf.nLength,pd) == DBF_NUM_OK )
+        return 2;
+    return 0;
+}
+
+// fill in vf for a numeric field, returns false if the field can not be aggregated
+static bool fieldKind(const fieldDefinition &fd, ValueField &vf)
+{
+    vf.nOffset = fd.uFieldOffset;
+    vf.nLength = fd.uLength;
+    vf.nScale = 0;
+    if( fd.cFieldType == 'I' )
+        vf.nKind = AGG_INTEGER;
+    else if( fd.cFieldType == 'Y' && fd.uLength == 8 )
+    {
+        vf.nKind = AGG_CURRENCY;
+        vf.nScale = 4;
+    }
+    else if( fd.cFieldType == 'B' && (fd.uLength == 8 || fd.uLength == 4) )
+        vf.nKind = AGG_DOUBLE;
+    else if( fd.cFieldType == 'N' || fd.cFieldType == 'F' || fd.cFieldType == 'Y' )
+    {
+        vf.nKind = AGG_TEXT;
+        vf.nScale = fd.cFieldType == 'Y' ? 4 : fd.uNumberOfDecimalPlaces;
+    }
+    else
+        return false;
+    return true;
+}
+
+// aggregate one block of raw records into the partial totals
+static void aggregateBlock(const char *pBlock, int nRecords, int nRecordLength, const ValueField &vf, const DBFFilter *pFilter,
+                           vector<int64> &integers, vector<double> &doubles, AggregatePartial &partial)
+{
+    // gather the values of the live rows into dense arrays, the kernels then run without any branches per row
+    integers.resize(nRecords);
+    doubles.resize(nRecords);
+    int nIntegers = 0;
+    int nDoubles = 0;
+    const char *pRecord = pBlock;
+    for( int r = 0 ; r < nRecords ; r++, pRecord += nRecordLength )
+    {
+        if( pRecord[0] == DBF_DELETED_RECORD_FLAG )
+            continue; // deleted
+        if( pFilter != NULL && !pFilter->matches(pRecord) )
+            continue;
+        int nType = decodeValue(pRecord + vf.nOffset,vf,&integers[nIntegers],&doubles[nDoubles]);
+        if( nType == 1 )
+            nIntegers++;
+        else if( nType == 2 )
+            nDoubles++;
+    }
+
+    if( nIntegers > 0 )
+    {
+        int64 nBlockSum;
+        if( sumInt64(&integers[0],nIntegers,&nBlockSum) )
+            partial.addToSum(nBlockSum);
+        else
+        {
+            // too big for 64 bits, this block goes to the floating point part
+            partial.bOverflow = true;
+            for( int i = 0 ; i < nIntegers ; i++ )
+                partial.dOverflowSum += (double) integers[i];
+        }
+        minMaxInt64(&integers[0],nIntegers,&partial.nMin,&partial.nMax);
+        partial.nIntegerCount += nIntegers;
+    }
+    if( nDoubles > 0 )
+    {
+        sumMinMaxDouble(&doubles[0],nDoubles,&partial.dSum,&partial.dMin,&partial.dMax);
+        partial.nDoubleCount += nDoubles;
+    }
+    partial.nCount += nIntegers + nDoubles;
+}
+
+int DBF::aggregate(int nField,DBFAggregate &result,const DBFFilter *pFilter,int nFirst,int nCount,int nThreads)
+{
+    // count, sum, min and max of one numeric field over [nFirst,nFirst+nCount), deleted rows are skipped
+    AggregatePartial().finish(0,result);
+    if( m_pFileHandle == NULL || !checkFilter(pFilter) )
+        return 1;
+    if( nField < 0 || nField >= m_nNumFields )
+    {
+        std::cerr << __FUNCTION__ << " Bad field index " << nField << std::endl;
+        return 1;
+    }
+    ValueField vf;
+    if( !fieldKind(m_FieldDefinitions[nField],vf) )
+    {
+        std::cerr << __FUNCTION__ << " Field " << GetFieldName(nField) << " of type " << m_FieldDefinitions[nField].cFieldType
+                  << " is not numeric" << std::endl;
+        return 1;
+    }
+
+    int nEnd = m_FileHeader.uRecordsInFile;
+    if( nFirst < 0 )
+        nFirst = 0;
+    if( nCount >= 0 && nFirst + nCount < nEnd )
+        nEnd = nFirst + nCount;
+    int nRecordLength = m_FileHeader.uRecordLength;
+    const int nBlockRecords = 4096;
+    int nBlocks = nEnd > nFirst ? (nEnd - nFirst + nBlockRecords - 1)/nBlockRecords : 0;
+    nThreads = dbfDefaultThreadCount(nThreads);
+
+    vector<AggregatePartial> partials(nThreads);
+    vector< vector<char> > buffers(nThreads);
+    vector< vector<int64> > integers(nThreads);
+    vector< vector<double> > doubles(nThreads);
+    std::atomic<int> nErrors(0);
+    dbfParallelFor(nBlocks,nThreads,[&](int nBlock,int nThread)
+    {
+        int nBlockFirst = nFirst + nBlock*nBlockRecords;
+        int nRecords = min(nBlockRecords,nEnd - nBlockFirst);
+        const char *pData = readBlock(nBlockFirst,nRecords,buffers[nThread]);
+        if( pData == NULL )
+        {
+            nErrors++;
+            return;
+        }
+        aggregateBlock(pData,nRecords,nRecordLength,vf,pFilter,integers[nThread],doubles[nThread],partials[nThread]);
+    });
+    if( nErrors != 0 )
+        return 1;
+
+    // merge the threads
+    for( int t = 1 ; t < nThreads ; t++ )
+        partials[0].merge(partials[t]);
+    partials[0].finish(vf.nScale,result);
+    return 0;
+}
+
+// one group field, where it is in the record and in the group key
+struct KeyField
+{
+    int nOffset;
+    int nLength;
+    int nKeyOffset;
+    char cType; // 'I', 'L', 'T' and 'Y' (the 8 byte binary ones) or 'C' for all text types
+};
+
+// binary 'T' and 'Y' keys as ordered numbers, an empty date time sorts first
+static inline int64 binaryKeyValue(const char *pField, const KeyField &kf)
+{
+    int64 n = 0;
+    if( kf.cType == 'T' )
+        return dbfDecodeDateTime(pField,kf.nLength,&n) == DBF_NUM_OK ? n : (-9223372036854775807LL - 1);
+    dbfDecodeCurrency(pField,kf.nLength,&n);
+    return n;
+}
+
+static inline uint64 hashKey(const char *pKey, int nLength)
+{
+    // 8 bytes at a time multiply / xor-shift, good enough spread for power of two tables
+    uint64 h = 0x9E3779B97F4A7C15ULL ^ (uint64) nLength;
+    int i = 0;
+    for( ; i + 8 <= nLength ; i += 8 )
+    {
+        uint64 w;
+        memcpy(&w,pKey + i,8);
+        h = (h ^ w)*0xBF58476D1CE4E5B9ULL;
+        h ^= h >> 31;
+    }
+    if( i < nLength )
+    {
+        uint64 w = 0;
+        memcpy(&w,pKey + i,nLength - i);
+        h = (h ^ w)*0x94D049BB133111EBULL;
+        h ^= h >> 29;
+    }
+    h *= 0xBF58476D1CE4E5B9ULL;
+    return h ^ (h >> 32);
+}
+
+// open addressing (linear probing) table of groups owned by one thread
+class GroupTable
+{
+public:
+    GroupTable(int nKeyLength, int nValues)
+    {
+        m_nKeyLength = nKeyLength;
+        m_nValues = nValues;
+        m_nGroups = 0;
+        m_Slots.assign(1024,0);
+        m_Hashes.assign(1024,0);
+    }
+
+    // index of the group with this key, created when it is new
+    int findOrAdd(const char *pKey, uint64 uHash)
+    {
+        size_t nMask = m_Slots.size() - 1;
+        size_t i = (size_t) uHash & nMask;
+        for( ;; )
+        {
+            uint32 nSlot = m_Slots[i];
+            if( nSlot == 0 )
+                break;
+            if( m_Hashes[i] == uHash && memcmp(&m_Keys[(size_t) (nSlot-1)*m_nKeyLength],pKey,m_nKeyLength) == 0 )
+                return nSlot - 1;
+            i = (i + 1) & nMask;
+        }
+
+        int nGroup = m_nGroups++;
+        m_Keys.insert(m_Keys.end(),pKey,pKey + m_nKeyLength);
+        m_Counts.push_back(0);
+        m_Partials.resize((size_t) m_nGroups*m_nValues);
+        m_Slots[i] = nGroup + 1;
+        m_Hashes[i] = uHash;
+        if( (size_t) m_nGroups*2 > m_Slots.size() )
+            grow(); // keep the load under one half
+        return nGroup;
+    }
+
+    void grow()
+    {
+        vector<uint32> slots(m_Slots.size()*2,0);
+        vector<uint64> hashes(slots.size(),0);
+        size_t nMask = slots.size() - 1;
+        for( size_t j = 0 ; j < m_Slots.size() ; j++ )
+        {
+            if( m_Slots[j] == 0 )
+                continue;
+            size_t i = (size_t) m_Hashes[j] & nMask;
+            while( slots[i] != 0 )
+                i = (i + 1) & nMask;
+            slots[i] = m_Slots[j];
+            hashes[i] = m_Hashes[j];
+        }
+        m_Slots.swap(slots);
+        m_Hashes.swap(hashes);
+    }
+
+    // add all the groups of another table into this one
+    void merge(const GroupTable &other)
+    {
+        for( int g = 0 ; g < other.m_nGroups ; g++ )
+        {
+            const char *pKey = &other.m_Keys[(size_t) g*m_nKeyLength];
+            int nGroup = findOrAdd(pKey,hashKey(pKey,m_nKeyLength));
+            m_Counts[nGroup] += other.m_Counts[g];
+            for( int v = 0 ; v < m_nValues ; v++ )
+                m_Partials[(size_t) nGroup*m_nValues + v].merge(other.m_Partials[(size_t) g*m_nValues + v]);
+        }
+    }
+
+    int m_nKeyLength;
+    int m_nValues;
+    int m_nGroups;
+    vector<uint32> m_Slots; // group index + 1, 0 = empty
+    vector<uint64> m_Hashes;
+    vector<char> m_Keys; // m_nKeyLength bytes per group
+    vector<int64> m_Counts;
+    vector<AggregatePartial> m_Partials; // m_nValues per group
+};
+
+// build the normalised group key of a record: NUL padding becomes spaces, 'L' becomes T, F or ?, binary fields are copied
+static inline void buildGroupKey(const char *pRecord, const vector<KeyField> &keyFields, char *pKey)
+{
+    for( size_t k = 0 ; k < keyFields.size() ; k++ )
+    {
+        const KeyField &kf = keyFields[k];
+        const char *pField = pRecord + kf.nOffset;
+        char *pOut = pKey + kf.nKeyOffset;
+        if( kf.cType == 'L' )
+            *pOut = (pField[0] == 'T' || pField[0] == 't' || pField[0] == 'Y' || pField[0] == 'y') ? 'T' : (pField[0] == '?' ? '?' : 'F');
+        else if( kf.cType == 'I' || kf.cType == 'T' || kf.cType == 'Y' )
+            memcpy(pOut,pField,kf.nLength);
+        else
+        {
+            const char *pNul = (const char *) memchr(pField,0,kf.nLength);
+            int nText = pNul != NULL ? (int) (pNul - pField) : kf.nLength;
+            memcpy(pOut,pField,nText);
+            memset(pOut + nText,' ',kf.nLength - nText);
+        }
+    }
+}
+
+int DBF::groupBy(const vector<int> &nGroupFields,const vector<int> &nValueFields,vector<DBFGroup> &groups,const DBFFilter *pFilter,int nThreads)
+{
+    groups.clear();
+    if( m_pFileHandle == NULL || !checkFilter(pFilter) )
+        return 1;
+    if( nGroupFields.empty() )
+    {
+        std::cerr << __FUNCTION__ << " No group fields given" << std::endl;
+        return 1;
+    }
+
+    vector<KeyField> keyFields;
+    int nKeyLength = 0;
+    for( size_t k = 0 ; k < nGroupFields.size() ; k++ )
+    {
+        int nField = nGroupFields[k];
+        if( nField < 0 || nField >= m_nNumFields || m_FieldDefinitions[nField].cFieldType == 'B' || isMemoField(nField) )
+        {
+            std::cerr << __FUNCTION__ << " Can not group by field " << nField << std::endl;
+            return 1;
+        }
+        const fieldDefinition &fd = m_FieldDefinitions[nField];
+        KeyField kf;
+        kf.nOffset = fd.uFieldOffset;
+        if( fd.cFieldType == 'I' || fd.cFieldType == 'L' )
+            kf.cType = fd.cFieldType;
+        else if( (fd.cFieldType == 'T' || fd.cFieldType == 'Y') && fd.uLength == 8 )
+            kf.cType = fd.cFieldType; // julian day + ms / value*10^4, not text
+        else
+            kf.cType = 'C';
+        kf.nLength = kf.cType == 'L' ? 1 : fd.uLength;
+        kf.nKeyOffset = nKeyLength;
+        nKeyLength += kf.nLength;
+        keyFields.push_back(kf);
+    }
+    vector<ValueField> valueFields(nValueFields.size());
+    for( size_t v = 0 ; v < nValueFields.size() ; v++ )
+    {
+        if( nValueFields[v] < 0 || nValueFields[v] >= m_nNumFields || !fieldKind(m_FieldDefinitions[nValueFields[v]],valueFields[v]) )
+        {
+            std::cerr << __FUNCTION__ << " Field " << nValueFields[v] << " is not numeric" << std::endl;
+            return 1;
+        }
+    }
+
+    int nRecords = m_FileHeader.uRecordsInFile;
+    int nRecordLength = m_FileHeader.uRecordLength;
+    const int nBlockRecords = 4096;
+    int nBlocks = (nRecords + nBlockRecords - 1)/nBlockRecords;
+    nThreads = dbfDefaultThreadCount(nThreads);
+    int nValues = (int) valueFields.size();
+
+    vector<GroupTable> tables(nThreads,GroupTable(nKeyLength,nValues));
+    vector< vector<char> > buffers(nThreads);
+    std::atomic<int> nErrors(0);
+    dbfParallelFor(nBlocks,nThreads,[&](int nBlock,int nThread)
+    {
+        int nFirst = nBlock*nBlockRecords;
+        int nCount = min(nBlockRecords,nRecords - nFirst);
+        const char *pData = readBlock(nFirst,nCount,buffers[nThread]);
+        if( pData == NULL )
+        {
+            nErrors++;
+            return;
+        }
+        GroupTable &table = tables[nThread];
+        vector<char> key(nKeyLength);
+        const char *pRecord = pData;
+        for( int r = 0 ; r < nCount ; r++, pRecord += nRecordLength )
+        {
+            if( pRecord[0] == DBF_DELETED_RECORD_FLAG )
+                continue; // deleted
+            if( pFilter != NULL && !pFilter->matches(pRecord) )
+                continue;
+            buildGroupKey(pRecord,keyFields,&key[0]);
+            int nGroup = table.findOrAdd(&key[0],hashKey(&key[0],nKeyLength));
+            table.m_Counts[nGroup]++;
+            AggregatePartial *pPartials = &table.m_Partials[(size_t) nGroup*nValues];
+            for( int v = 0 ; v < nValues ; v++ )
+            {
+                int64 n;
+                double d;
+                int nType = decodeValue(pRecord + valueFields[v].nOffset,valueFields[v],&n,&d);
+                if( nType == 1 )
+                    pPartials[v].addInteger(n);
+                else if( nType == 2 )
+                    pPartials[v].addDouble(d);
+            }
+        }
+    });
+    if( nErrors != 0 )
+        return 1;
+
+    // merge the per thread tables into the first one
+    GroupTable &total = tables[0];
+    for( int t = 1 ; t < nThreads ; t++ )
+        total.merge(tables[t]);
+
+    // order the groups by key, field by field ('I', 'T' and 'Y' as signed numbers, text and 'L' by their bytes)
+    vector<int> order(total.m_nGroups);
+    for( int g = 0 ; g < total.m_nGroups ; g++ )
+        order[g] = g;
+    const char *pKeys = total.m_Keys.empty() ? NULL : &total.m_Keys[0];
+    std::sort(order.begin(),order.end(),[&](int a,int b)
+    {
+        const char *pA = pKeys + (size_t) a*nKeyLength;
+        const char *pB = pKeys + (size_t) b*nKeyLength;
+        for( size_t k = 0 ; k < keyFields.size() ; k++ )
+        {
+            const KeyField &kf = keyFields[k];
+            if( kf.cType == 'I' )
+            {
+                int64 nA = 0, nB = 0;
+                ValueField vf = { kf.nKeyOffset, kf.nLength, AGG_INTEGER, 0 };
+                decodeValue(pA + kf.nKeyOffset,vf,&nA,NULL);
+                decodeValue(pB + kf.nKeyOffset,vf,&nB,NULL);
+                if( nA != nB )
+                    return nA < nB;
+            }
+            else if( kf.cType == 'T' || kf.cType == 'Y' )
+            {
+                int64 nA = binaryKeyValue(pA + kf.nKeyOffset,kf);
+                int64 nB = binaryKeyValue(pB + kf.nKeyOffset,kf);
+                if( nA != nB )
+                    return nA < nB;
+            } else
+            {
+                int nCmp = memcmp(pA + kf.nKeyOffset,pB + kf.nKeyOffset,kf.nLength);
+                if( nCmp != 0 )
+                    return nCmp < 0;
+            }
+        }
+        return false;
+    });
+
+    groups.resize(total.m_nGroups);
+    for( int i = 0 ; i < total.m_nGroups ; i++ )
+    {
+        int g = order[i];
+        const char *pKey = pKeys + (size_t) g*nKeyLength;
+        DBFGroup &group = groups[i];
+        group.nCount = total.m_Counts[g];
+        for( size_t k = 0 ; k < keyFields.size() ; k++ )
+        {
+            const KeyField &kf = keyFields[k];
+            if( kf.cType == 'I' )
+            {
+                int64 n = 0;
+                ValueField vf = { kf.nKeyOffset, kf.nLength, AGG_INTEGER, 0 };
+                decodeValue(pKey + kf.nKeyOffset,vf,&n,NULL);
+                group.keys.push_back(std::to_string(n));
+            }
+            else if( kf.cType == 'T' || kf.cType == 'Y' )
+            {
+                // formatted like readField, an empty date time is ""
+                char buffer[32];
+                int64 n;
+                int nLen = 0;
+                if( kf.cType == 'Y' )
+                    nLen = dbfDecodeCurrency(pKey + kf.nKeyOffset,kf.nLength,&n) == DBF_NUM_OK ? dbfFormatCurrency(n,buffer) : 0;
+                else
+                    nLen = dbfDecodeDateTime(pKey + kf.nKeyOffset,kf.nLength,&n) == DBF_NUM_OK ? dbfFormatDateTime(n,buffer) : 0;
+                group.keys.push_back(string(buffer,nLen));
+            } else
+            {
+                const char *pStart = pKey + kf.nKeyOffset;
+                const char *pEnd = pStart + kf.nLength;
+                while( pStart < pEnd && *pStart == ' ' )
+                    pStart++;
+                while( pEnd > pStart && pEnd[-1] == ' ' )
+                    pEnd--;
+                group.keys.push_back(string(pStart,pEnd - pStart));
+            }
+        }
+        group.values.resize(nValues);
+        for( int v = 0 ; v < nValues ; v++ )
+            total.m_Partials[(size_t) g*nValues + v].finish(valueFields[v].nScale,group.values[v]);
+    }
+    return 0;
+}
@@ -0,0 +1,57 @@
+#ifndef DBFAGGREGATE_H
+#define DBFAGGREGATE_H
+
+// Copyright (C) 2012 Ron Ostafichuk
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files
+// (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify,
+// merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR
+// IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+// Aggregates over one numeric column (DBF::aggregate).  Blocks of raw records are read like scan() does, the
+// values of the live (and matching) rows are gathered into a dense array and summed / compared with SSE2 kernels.
+//
+// 'I' and 'Y' (8 byte currency, 4 implied decimals) and the text numbers 'N' and 'F' are summed as exact scaled
+// integers, 'B' as doubles.  Blank or invalid 'N'/'F' values are not counted, like NULLs in SQL.
+//
+// DBF::groupBy hashes the raw bytes of the group fields of each record (text padding and 'L' values normalised)
+// into an open addressing table per thread, the tables are merged at the end.
+
+#include "dbf.h"
+
+struct DBFAggregate
+{
+    int64 nCount; // values aggregated
+    double dSum;
+    double dMin; // NAN when nCount is 0
+    double dMax;
+
+    // exact results for the integer, currency and fixed point types, value = n/10^nScale
+    bool bExact; // false for 'B' fields and when the scaled sum overflowed 64 bits
+    int nScale;
+    int64 nScaledSum;
+    int64 nScaledMin;
+    int64 nScaledMax;
+
+    double getAverage() const
+    {
+        return nCount > 0 ? dSum/nCount : NAN;
+    }
+};
+
+// one group of DBF::groupBy
+struct DBFGroup
+{
+    vector<string> keys; // value of each group field: text trimmed, 'I' as a number, 'L' as T, F or ?, 'T' and 'Y' like readField
+    int64 nCount; // live (and matching) records in the group
+    vector<DBFAggregate> values; // one per value field, nCount of each only counts the records that had a value
+};
+
+#endif // DBFAGGREGATE_H
@@ -0,0 +1,589 @@
+#include "dbf.h"
+#include "dbfcsv.h"
+#include "dbfdate.h"
+#include "dbfstats.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fcntl.h>
+#ifndef _WIN32
+#include <unistd.h>
+#else
+#include <io.h>
+#endif
+
+// Copyright (C) 2012 Ron Ostafichuk
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files
+// (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify,
+// merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR
+// IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+// Benchmark suite.  Generates a synthetic table (same seed, same file) and times the engine on it, every result is
+// written to stdout as one JSON object per line so runs can be stored and compared:
+//   {"bench":"scan","rows":1000000,"seconds":0.41,"rows_per_s":2439024,"mb_per_s":312.5,...}
+// Benchmarks that time single operations (open, lookup, delete) add p50/p90/p99/p999/max latencies in microseconds.
+// With -stats the scan, lookup and append benchmarks add a "<name>_stats" line with the table's DBF::getStats() counters.
+// Progress and errors go to stderr.
+
+using namespace std;
+
+#define BENCH_POOL_RECORDS 4096 // distinct pre encoded records the generator copies from
+
+struct BenchOptions
+{
+    int64 nRows;
+    string sFields;
+    double dDeletedRatio; // of the generated rows
+    int nLookups;
+    int nOpens;
+    int nAppendRows; // rows loaded through appendRecord
+    int nDeletes; // rows deleted by the markAsDeleted benchmarks
+    uint64 uSeed;
+    bool bMemoryMap;
+    size_t nCacheBytes; // loadRec read cache, 0 = none
+    int nSyncPolicy;
+    string sOnly; // comma separated benchmark names, empty = all
+    string sDirectory;
+    bool bKeep;
+    bool bStats; // print the engine counters after scan, lookup and append
+};
+
+static void usage()
+{
+    std::cerr << "usage: dbfbench [options] [work directory]" << std::endl
+              << "  -rows <n>       rows in the generated table (default 1000000, up to 100M)" << std::endl
+              << "  -f <fields>     field mix as NAME:TYPE[:LENGTH[:DECIMALS]],... (see dbfimport)" << std::endl
+              << "  -deleted <r>    ratio of generated rows marked deleted, 0 to 1 (default 0.05)" << std::endl
+              << "  -lookups <n>    random loadRec calls (default 100000)" << std::endl
+              << "  -opens <n>      open / close cycles (default 200)" << std::endl
+              << "  -append <n>     rows bulk loaded with appendRecord (default min(rows,1000000))" << std::endl
+              << "  -deletes <n>    rows deleted with markAsDeleted (default 10000)" << std::endl
+              << "  -seed <n>       generator seed (default 1)" << std::endl
+              << "  -mmap           open the table memory mapped" << std::endl
+              << "  -cache <MB>     loadRec read cache size" << std::endl
+              << "  -sync <n>       sync policy for the write benchmarks (DBF_SYNC_ value, default 1)" << std::endl
+              << "  -only <names>   run only these, of generate,open,scan,lookup,append,csv,dump,delete,delete_bulk" << std::endl
+              << "  -keep           leave the generated files in the work directory" << std::endl
+              << "  -stats          add the engine counters (DBF::getStats) of the scan, lookup and append runs" << std::endl;
+}
+
+// xorshift64*, fast and the same on every platform
+static inline uint64 nextRandom(uint64 &uState)
+{
+    uState ^= uState >> 12;
+    uState ^= uState << 25;
+    uState ^= uState >> 27;
+    return uState*2685821657736338717ULL;
+}
+
+static double secondsSince(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+static bool wanted(const BenchOptions &options, const char *pName)
+{
+    if( options.sOnly.empty() )
+        return true;
+    string sList = "," + options.sOnly + ",";
+    return sList.find(string(",") + pName + ",") != string::npos;
+}
+
+static string modeName(const BenchOptions &options)
+{
+    string sMode = options.bMemoryMap ? "mmap" : "stdio";
+    if( options.nCacheBytes > 0 )
+        sMode += "+cache";
+    return sMode;
+}
+
+// one result line, dBytes is what was read or written (0 leaves mb_per_s out), latencies in seconds may be empty
+static void report(const BenchOptions &options, const char *pName, int64 nRows, double dSeconds, double dBytes,
+                   vector<double> &latencies)
+{
+    char line[1024];
+    int nLen = snprintf(line,sizeof(line),"{\"bench\":\"%s\",\"mode\":\"%s\",\"rows\":%lld,\"seconds\":%.6f,\"rows_per_s\":%.1f",
+                        pName,modeName(options).c_str(),(long long) nRows,dSeconds,dSeconds > 0 ? nRows/dSeconds : 0.0);
+    if( dBytes > 0 )
+        nLen += snprintf(line + nLen,sizeof(line) - nLen,",\"mb_per_s\":%.2f",dSeconds > 0 ? dBytes/dSeconds/1048576.0 : 0.0);
+    if( !latencies.empty() )
+    {
+        std::sort(latencies.begin(),latencies.end());
+        size_t n = latencies.size();
+        const double dPercent[4] = {0.50,0.90,0.99,0.999};
+        const char *pLabel[4] = {"p50_us","p90_us","p99_us","p999_us"};
+        for( int i = 0 ; i < 4 ; i++ )
+            nLen += snprintf(line + nLen,sizeof(line) - nLen,",\"%s\":%.3f",pLabel[i],latencies[min(n - 1,(size_t) (dPercent[i]*n))]*1e6);
+        nLen += snprintf(line + nLen,sizeof(line) - nLen,",\"max_us\":%.3f",latencies[n - 1]*1e6);
+    }
+    snprintf(line + nLen,sizeof(line) - nLen,"}");
+    std::cout << line << std::endl;
+}
+
+// the table's counters as a "<name>_stats" line, after the result of that benchmark
+static void reportStats(const BenchOptions &options, const char *pName, const DBF &dbf)
+{
+    if( !options.bStats )
+        return;
+    string sStats = dbfFormatStats(dbf.getStats(),dbf.getFileName());
+    std::cout << "{\"bench\":\"" << pName << "_stats\"," << sStats.substr(1) << std::endl;
+}
+
+// text of a random value for the field, the generator encodes it with the engine's own rules
+static string randomValue(const fieldDefinition &fd, uint64 &uState)
+{
+    uint64 u = nextRandom(uState);
+    char buffer[64];
+    switch( fd.cFieldType )
+    {
+    case 'I':
+        return to_string((int) (u % 2000000) - 1000000);
+    case 'B':
+        snprintf(buffer,sizeof(buffer),"%.6f",(double) (u % 100000000)/1000.0 - 50000.0);
+        return buffer;
+    case 'N':
+    case 'F':
+    case 'Y':
+    {
+        // fits the field: digits before the point = length - decimals - 2 (sign and point)
+        int nDecimals = fd.cFieldType == 'Y' ? 4 : fd.uNumberOfDecimalPlaces;
+        int nIntDigits = max(1,min(12,fd.cFieldType == 'Y' ? 12 : fd.uLength - nDecimals - (nDecimals > 0 ? 2 : 1)));
+        int64 nLimit = 1;
+        for( int i = 0 ; i < nIntDigits ; i++ )
+            nLimit *= 10;
+        int64 nWhole = (int64) (u % (uint64) nLimit);
+        if( (u >> 60) & 1 )
+            nWhole = -nWhole/10;
+        int nLen = snprintf(buffer,sizeof(buffer),"%lld",(long long) nWhole);
+        if( nDecimals > 0 )
+        {
+            buffer[nLen++] = '.';
+            for( int i = 0 ; i < nDecimals ; i++ , u /= 10 )
+                buffer[nLen++] = (char) ('0' + (u >> 20) % 10);
+            buffer[nLen] = 0;
+        }
+        return buffer;
+    }
+    case 'L':
+        return u % 3 == 0 ? "F" : (u % 3 == 1 ? "T" : "?");
+    case 'D':
+        dbfFormatDate(dbfDaysFromCivil(2000,1,1) + (int64) (u % 11000),buffer);
+        return buffer;
+    case 'T':
+        dbfFormatDateTime(dbfDaysFromCivil(2000,1,1)*DBF_MS_PER_DAY + (int64) (u % (11000ULL*DBF_MS_PER_DAY)),buffer);
+        return buffer;
+    default:
+    {
+        // text of random length, at least a third of the field
+        int nLength = fd.uLength/3 + (int) (u % (fd.uLength - fd.uLength/3 + 1));
+        string s(nLength,' ');
+        for( int i = 0 ; i < nLength ; i++ )
+            s[i] = (char) ('a' + nextRandom(uState) % 26);
+        return s;
+    }
+    }
+}
+
+static int createTable(const string &sFile, const vector<fieldDefinition> &schema, DBF &dbf)
+{
+    dbf.setVerbose(false);
+    if( dbf.create(sFile,(int) schema.size()) != 0 )
+        return 1;
+    for( size_t f = 0 ; f < schema.size() ; f++ )
+    {
+        if( dbf.assignField(schema[f],(int) f) != 0 )
+            return 1;
+    }
+    return 0;
+}
+
+// the synthetic table: records are copied from a pool of pre encoded ones and written straight after the header in
+// large blocks, an 'I' first field gets the record number so rows stay distinct. Deleted rows are spread at random
+static int generateTable(const BenchOptions &options, const string &sFile, const vector<fieldDefinition> &schema)
+{
+    DBF dbf;
+    if( createTable(sFile,schema,dbf) != 0 )
+        return 1;
+    int nRecordLength = dbf.getRecordLength();
+    uint64 uState = options.uSeed*0x9E3779B97F4A7C15ULL + 1;
+    vector<char> pool((size_t) BENCH_POOL_RECORDS*nRecordLength);
+    for( int r = 0 ; r < BENCH_POOL_RECORDS ; r++ )
+    {
+        char *pRecord = &pool[(size_t) r*nRecordLength];
+        pRecord[0] = ' ';
+        for( size_t f = 0 ; f < schema.size() ; f++ )
+        {
+            string sValue = randomValue(dbf.getFieldDefinition((int) f),uState);
+            dbf.encodeFieldValue(sValue.data(),(int) sValue.size(),(int) f,pRecord);
+        }
+    }
+    dbf.close();
+
+    FILE *pFile = fopen(sFile.c_str(),"rb+");
+    if( pFile == NULL )
+    {
+        std::cerr << "Unable to reopen " << sFile << std::endl;
+        return 1;
+    }
+    fileHeader header;
+    if( fread(&header,1,sizeof(header),pFile) != sizeof(header) || dbfSeekFile(pFile,header.uPositionOfFirstRecord) != 0 )
+    {
+        fclose(pFile);
+        return 1;
+    }
+
+    const fieldDefinition &first = schema[0];
+    bool bNumberRows = first.cFieldType == 'I';
+    int nBlockRecords = max(1,(4 << 20)/nRecordLength);
+    vector<char> block((size_t) nBlockRecords*nRecordLength);
+    int nRet = 0;
+    for( int64 nDone = 0 ; nDone < options.nRows && nRet == 0 ; )
+    {
+        int nCount = (int) min((int64) nBlockRecords,options.nRows - nDone);
+        for( int r = 0 ; r < nCount ; r++ )
+        {
+            char *pRecord = &block[(size_t) r*nRecordLength];
+            memcpy(pRecord,&pool[(size_t) (nextRandom(uState) % BENCH_POOL_RECORDS)*nRecordLength],nRecordLength);
+            if( bNumberRows )
+            {
+                uint32 uId = (uint32) (nDone + r);
+                for( int b = 0 ; b < 4 ; b++ )
+                    pRecord[1 + b] = (char) (uId >> (b*8));
+            }
+            if( options.dDeletedRatio > 0 && (nextRandom(uState) >> 11)*(1.0/9007199254740992.0) < options.dDeletedRatio )
+                pRecord[0] = DBF_DELETED_RECORD_FLAG;
+        }
+        if( fwrite(&block[0],1,(size_t) nCount*nRecordLength,pFile) != (size_t) nCount*nRecordLength )
+            nRet = 1;
+        nDone += nCount;
+    }
+    header.uRecordsInFile = (uint32) options.nRows;
+    if( nRet == 0 && (dbfSeekFile(pFile,0) != 0 || fwrite(&header,1,sizeof(header),pFile) != sizeof(header)) )
+        nRet = 1;
+    if( fclose(pFile) != 0 )
+        nRet = 1;
+    if( nRet != 0 )
+        std::cerr << "Failed to write " << sFile << std::endl;
+    return nRet;
+}
+
+static int openTable(const BenchOptions &options, const string &sFile, DBF &dbf, bool bAllowWrite, int nAccessHint)
+{
+    dbf.setVerbose(false);
+    if( dbf.open(sFile,bAllowWrite,options.bMemoryMap,nAccessHint) != 0 )
+    {
+        std::cerr << "Unable to open " << sFile << std::endl;
+        return 1;
+    }
+    if( options.nCacheBytes > 0 )
+        dbf.setReadCache(options.nCacheBytes);
+    dbf.setSyncPolicy(options.nSyncPolicy);
+    return 0;
+}
+
+// readField of every field, the way most callers use the engine. The checksum keeps the work from being optimised away
+static size_t readAllFields(DBF &dbf)
+{
+    size_t nSum = 0;
+    for( int f = 0 ; f < dbf.GetNumFields() ; f++ )
+        nSum += dbf.readField(f).size();
+    return nSum;
+}
+
+// std output to the null device while dumpAsCSV runs, returns the saved descriptor
+static int silenceStdout()
+{
+    fflush(stdout);
+#ifndef _WIN32
+    int nSaved = dup(1);
+    int nNull = open("/dev/null",O_WRONLY);
+    dup2(nNull,1);
+    ::close(nNull);
+#else
+    int nSaved = _dup(1);
+    int nNull = _open("NUL",_O_WRONLY);
+    _dup2(nNull,1);
+    _close(nNull);
+#endif
+    return nSaved;
+}
+
+static void restoreStdout(int nSaved)
+{
+    fflush(stdout);
+#ifndef _WIN32
+    dup2(nSaved,1);
+    ::close(nSaved);
+#else
+    _dup2(nSaved,1);
+    _close(nSaved);
+#endif
+}
+
+int main(int argc, char *argv[])
+{
+    BenchOptions options;
+    options.nRows = 1000000;
+    options.sFields = "ID:I,NAME:C:30,PRICE:N:12:2,QTY:I,RATE:B,ACTIVE:L,DAY:D,NOTE:C:60";
+    options.dDeletedRatio = 0.05;
+    options.nLookups = 100000;
+    options.nOpens = 200;
+    options.nAppendRows = -1;
+    options.nDeletes = 10000;
+    options.uSeed = 1;
+    options.bMemoryMap = false;
+    options.nCacheBytes = 0;
+    options.nSyncPolicy = DBF_SYNC_FLUSH;
+    options.sDirectory = ".";
+    options.bKeep = false;
+    options.bStats = false;
+
+    for( int i = 1 ; i < argc ; i++ )
+    {
+        string sArg = argv[i];
+        bool bValue = i + 1 < argc;
+        if( sArg == "-rows" && bValue )
+            options.nRows = atoll(argv[++i]);
+        else if( sArg == "-f" && bValue )
+            options.sFields = argv[++i];
+        else if( sArg == "-deleted" && bValue )
+            options.dDeletedRatio = atof(argv[++i]);
+        else if( sArg == "-lookups" && bValue )
+            options.nLookups = atoi(argv[++i]);
+        else if( sArg == "-opens" && bValue )
+            options.nOpens = atoi(argv[++i]);
+        else if( sArg == "-append" && bValue )
+            options.nAppendRows = atoi(argv[++i]);
+        else if( sArg == "-deletes" && bValue )
+            options.nDeletes = atoi(argv[++i]);
+        else if( sArg == "-seed" && bValue )
+            options.uSeed = strtoull(argv[++i],NULL,10);
+        else if( sArg == "-mmap" )
+            options.bMemoryMap = true;
+        else if( sArg == "-cache" && bValue )
+            options.nCacheBytes = (size_t) atoll(argv[++i]) << 20;
+        else if( sArg == "-sync" && bValue )
+            options.nSyncPolicy = atoi(argv[++i]);
+        else if( sArg == "-only" && bValue )
+            options.sOnly = argv[++i];
+        else if( sArg == "-keep" )
+            options.bKeep = true;
+        else if( sArg == "-stats" )
+            options.bStats = true;
+        else if( !sArg.empty() && sArg[0] == '-' )
+        {
+            usage();
+            return 1;
+        }
+        else
+            options.sDirectory = sArg;
+    }
+    if( options.nRows < 1 || options.nRows > 2147483647 || options.dDeletedRatio < 0 || options.dDeletedRatio > 1 )
+    {
+        usage();
+        return 1;
+    }
+    if( options.nAppendRows < 0 )
+        options.nAppendRows = (int) min(options.nRows,(int64) 1000000);
+
+    vector<fieldDefinition> schema;
+    if( dbfParseSchema(options.sFields,schema) != 0 )
+        return 1;
+    string sTable = options.sDirectory + "/dbfbench.dbf";
+    string sAppendTable = options.sDirectory + "/dbfbench_append.dbf";
+
+    std::cout << "{\"bench\":\"config\",\"rows\":" << options.nRows << ",\"fields\":\"" << options.sFields
+              << "\",\"deleted_ratio\":" << options.dDeletedRatio << ",\"seed\":" << options.uSeed
+              << ",\"mode\":\"" << modeName(options) << "\",\"sync\":" << options.nSyncPolicy << "}" << std::endl;
+
+    vector<double> latencies;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    std::cerr << "generating " << options.nRows << " rows" << std::endl;
+    if( generateTable(options,sTable,schema) != 0 )
+        return 1;
+    double dSeconds = secondsSince(start);
+    int nRecordLength = 0;
+    {
+        DBF dbf;
+        if( openTable(options,sTable,dbf,false,DBF_ACCESS_NORMAL) != 0 )
+            return 1;
+        nRecordLength = dbf.getRecordLength();
+    }
+    double dTableBytes = (double) options.nRows*nRecordLength;
+    if( wanted(options,"generate") )
+        report(options,"generate",options.nRows,dSeconds,dTableBytes,latencies);
+
+    if( wanted(options,"open") )
+    {
+        latencies.clear();
+        start = chrono::steady_clock::now();
+        for( int i = 0 ; i < options.nOpens ; i++ )
+        {
+            chrono::steady_clock::time_point opStart = chrono::steady_clock::now();
+            DBF dbf;
+            if( openTable(options,sTable,dbf,false,DBF_ACCESS_NORMAL) != 0 )
+                return 1;
+            dbf.close();
+            latencies.push_back(secondsSince(opStart));
+        }
+        report(options,"open",options.nOpens,secondsSince(start),0,latencies);
+    }
+
+    size_t nChecksum = 0;
+    if( wanted(options,"scan") )
+    {
+        // sequential loadRec + readField of every field
+        DBF dbf;
+        if( openTable(options,sTable,dbf,false,DBF_ACCESS_SEQUENTIAL) != 0 )
+            return 1;
+        latencies.clear();
+        start = chrono::steady_clock::now();
+        int nRecords = dbf.GetNumRecords();
+        for( int r = 0 ; r < nRecords ; r++ )
+        {
+            if( dbf.loadRec(r) != 0 )
+                return 1;
+            nChecksum += readAllFields(dbf);
+        }
+        report(options,"scan",nRecords,secondsSince(start),dTableBytes,latencies);
+        reportStats(options,"scan",dbf);
+    }
+
+    if( wanted(options,"lookup") )
+    {
+        DBF dbf;
+        if( openTable(options,sTable,dbf,false,DBF_ACCESS_RANDOM) != 0 )
+            return 1;
+        uint64 uState = options.uSeed + 7;
+        int nRecords = dbf.GetNumRecords();
+        latencies.clear();
+        latencies.reserve(options.nLookups);
+        start = chrono::steady_clock::now();
+        for( int i = 0 ; i < options.nLookups ; i++ )
+        {
+            int nRecord = (int) (nextRandom(uState) % (uint64) nRecords);
+            chrono::steady_clock::time_point opStart = chrono::steady_clock::now();
+            if( dbf.loadRec(nRecord) != 0 )
+                return 1;
+            nChecksum += readAllFields(dbf);
+            latencies.push_back(secondsSince(opStart));
+        }
+        report(options,"lookup",options.nLookups,secondsSince(start),(double) options.nLookups*nRecordLength,latencies);
+        reportStats(options,"lookup",dbf);
+    }
+
+    if( wanted(options,"append") )
+    {
+        // appendRecord bulk load in an append session, values prepared up front so only the engine is timed
+        DBF dbf;
+        if( createTable(sAppendTable,schema,dbf) != 0 )
+            return 1;
+        dbf.setSyncPolicy(options.nSyncPolicy);
+        int nFields = (int) schema.size();
+        uint64 uState = options.uSeed + 11;
+        vector<string> values((size_t) BENCH_POOL_RECORDS*nFields);
+        for( size_t v = 0 ; v < values.size() ; v++ )
+            values[v] = randomValue(dbf.getFieldDefinition((int) (v % nFields)),uState);
+        latencies.clear();
+        start = chrono::steady_clock::now();
+        dbf.beginAppend();
+        for( int r = 0 ; r < options.nAppendRows ; r++ )
+        {
+            if( dbf.appendRecord(&values[(size_t) (r % BENCH_POOL_RECORDS)*nFields],nFields) != 0 )
+                return 1;
+        }
+        if( dbf.commitAppend() != 0 )
+            return 1;
+        report(options,"append",options.nAppendRows,secondsSince(start),(double) options.nAppendRows*dbf.getRecordLength(),latencies);
+        reportStats(options,"append",dbf);
+        dbf.close();
+        if( !options.bKeep )
+            remove(sAppendTable.c_str());
+    }
+
+    if( wanted(options,"csv") )
+    {
+        // exportCSV into a sink that only counts, the formatting cost without the disk
+        DBF dbf;
+        if( openTable(options,sTable,dbf,false,DBF_ACCESS_SEQUENTIAL) != 0 )
+            return 1;
+        DBFCSVOptions csvOptions;
+        csvOptions.nThreads = 1;
+        double dOutBytes = 0;
+        latencies.clear();
+        start = chrono::steady_clock::now();
+        dbf.exportCSV([&](const char *,size_t nBytes)
+        {
+            dOutBytes += nBytes;
+            return 0;
+        },csvOptions);
+        report(options,"csv",options.nRows,secondsSince(start),dOutBytes,latencies);
+    }
+
+    if( wanted(options,"dump") )
+    {
+        // dumpAsCSV as the tools call it, std output goes to the null device
+        DBF dbf;
+        if( openTable(options,sTable,dbf,false,DBF_ACCESS_SEQUENTIAL) != 0 )
+            return 1;
+        latencies.clear();
+        int nSaved = silenceStdout();
+        start = chrono::steady_clock::now();
+        dbf.dumpAsCSV();
+        dSeconds = secondsSince(start);
+        restoreStdout(nSaved);
+        report(options,"dump",options.nRows,dSeconds,dTableBytes,latencies);
+    }
+
+    // the delete benchmarks change the table, so they run last
+    int nDeletes = (int) min((int64) options.nDeletes,options.nRows);
+    if( wanted(options,"delete") )
+    {
+        DBF dbf;
+        if( openTable(options,sTable,dbf,true,DBF_ACCESS_RANDOM) != 0 )
+            return 1;
+        uint64 uState = options.uSeed + 13;
+        latencies.clear();
+        latencies.reserve(nDeletes);
+        start = chrono::steady_clock::now();
+        for( int i = 0 ; i < nDeletes ; i++ )
+        {
+            int nRecord = (int) (nextRandom(uState) % (uint64) options.nRows);
+            chrono::steady_clock::time_point opStart = chrono::steady_clock::now();
+            if( dbf.markAsDeleted(nRecord) != 0 )
+                return 1;
+            latencies.push_back(secondsSince(opStart));
+        }
+        dbf.commit();
+        report(options,"delete",nDeletes,secondsSince(start),0,latencies);
+    }
+
+    if( wanted(options,"delete_bulk") )
+    {
+        DBF dbf;
+        if( openTable(options,sTable,dbf,true,DBF_ACCESS_RANDOM) != 0 )
+            return 1;
+        uint64 uState = options.uSeed + 17;
+        vector<int> nRecords(nDeletes);
+        for( int i = 0 ; i < nDeletes ; i++ )
+            nRecords[i] = (int) (nextRandom(uState) % (uint64) options.nRows);
+        latencies.clear();
+        start = chrono::steady_clock::now();
+        if( dbf.markAsDeleted(nRecords) != 0 || dbf.commit() != 0 )
+            return 1;
+        report(options,"delete_bulk",nDeletes,secondsSince(start),0,latencies);
+    }
+
+    if( !options.bKeep )
+        remove(sTable.c_str());
+    std::cerr << "checksum " << nChecksum << std::endl;
+    return 0;
+}
@@ -0,0 +1,154 @@
+#include "dbfcatalog.h"
+#include "dbfparallel.h"
+
+#include <algorithm>
+#ifndef _WIN32
+#include <dirent.h>
+#else
+#include <io.h>
+#endif
+
+// Copyright (C) 2012 Ron Ostafichuk
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files
+// (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify,
+// merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR
+// IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+int dbfReadSchema(string sFileName,DBFSchema &schema)
+{
+    schema.sFileName = sFileName;
+    schema.nError = 1;
+    schema.fields.clear();
+    schema.nFileSize = -1;
+    memset(&schema.header,0,sizeof(schema.header));
+
+    FILE *pFile = fopen(sFileName.c_str(),"rb");
+    if( pFile == NULL )
+    {
+        std::cerr << __FUNCTION__ << " Unable to open file " << sFileName << std::endl;
+        return 1;
+    }
+    // header, every field definition and the terminator in one read
+    char buffer[32 + 32*MAX_FIELDS + 1];
+    size_t nBytes = fread(buffer,1,sizeof(buffer),pFile);
+    schema.nFileSize = dbfFileSize(pFile);
+    fclose(pFile);
+    if( nBytes < 32 )
+    {
+        std::cerr << __FUNCTION__ << " Bad read for Header of " << sFileName << std::endl;
+        return 1;
+    }
+    memcpy(&schema.header,buffer,32);
+
+    uint32 uFieldOffset = 1;
+    bool bTerminated = false;
+    for( size_t nPos = 32 ; nPos < nBytes ; nPos += 32 )
+    {
+        if( buffer[nPos] == 0x0D )
+        {
+            bTerminated = true;
+            break;
+        }
+        if( nPos + 32 > nBytes || schema.fields.size() >= MAX_FIELDS )
+            break;
+        fieldDefinition fd;
+        memcpy(&fd,buffer + nPos,32);
+        if( strnlen(fd.cFieldName,sizeof(fd.cFieldName)) <= 1 )
+        {
+            bTerminated = true; // same end test as DBF::open
+            break;
+        }
+        fd.uFieldOffset = uFieldOffset;
+        uFieldOffset += fd.uLength;
+        schema.fields.push_back(fd);
+    }
+
+    if( !bTerminated || schema.fields.empty() )
+    {
+        std::cerr << __FUNCTION__ << " " << sFileName << " has no field definitions" << std::endl;
+        return 1;
+    }
+    if( uFieldOffset != schema.header.uRecordLength
+            || schema.header.uPositionOfFirstRecord != 32 + 32*schema.fields.size() + 264 )
+    {
+        std::cerr << __FUNCTION__ << " " << sFileName << " has a bad record length or first record position" << std::endl;
+        return 1;
+    }
+    schema.nError = 0;
+    return 0;
+}
+
+int dbfReadSchemas(const vector<string> &files,vector<DBFSchema> &schemas,int nThreads)
+{
+    schemas.clear();
+    schemas.resize(files.size());
+    // small files, the time goes into open and the first read so keep many in flight
+    dbfParallelFor((int) files.size(),dbfDefaultThreadCount(nThreads),[&](int nItem,int)
+    {
+        dbfReadSchema(files[nItem],schemas[nItem]);
+    });
+    int nFailed = 0;
+    for( size_t i = 0 ; i < schemas.size() ; i++ )
+    {
+        if( schemas[i].nError != 0 )
+            nFailed++;
+    }
+    return nFailed;
+}
+
+static bool hasDBFExtension(const string &sName)
+{
+    if( sName.size() < 5 )
+        return false;
+    const char *p = sName.c_str() + sName.size() - 4;
+    return p[0] == '.' && (p[1] == 'd' || p[1] == 'D') && (p[2] == 'b' || p[2] == 'B') && (p[3] == 'f' || p[3] == 'F');
+}
+
+int dbfScanDirectory(string sDirectory,vector<DBFSchema> &schemas,int nThreads)
+{
+    schemas.clear();
+    if( sDirectory.empty() )
+        sDirectory = ".";
+    char cLast = sDirectory[sDirectory.size() - 1];
+    string sPrefix = (cLast == '/' || cLast == '\\') ? sDirectory : sDirectory + "/";
+
+    vector<string> files;
+#ifndef _WIN32
+    DIR *pDir = opendir(sDirectory.c_str());
+    if( pDir == NULL )
+    {
+        std::cerr << __FUNCTION__ << " Unable to list " << sDirectory << std::endl;
+        return 1;
+    }
+    struct dirent *pEntry;
+    while( (pEntry = readdir(pDir)) != NULL )
+    {
+        string sName = pEntry->d_name;
+        if( hasDBFExtension(sName) && pEntry->d_type != DT_DIR )
+            files.push_back(sPrefix + sName);
+    }
+    closedir(pDir);
+#else
+    struct _finddata_t info;
+    intptr_t hFind = _findfirst((sPrefix + "*.dbf").c_str(),&info);
+    if( hFind == -1 )
+        return errno == ENOENT ? 0 : 1; // ENOENT is an empty directory
+    do
+    {
+        if( !(info.attrib & _A_SUBDIR) && hasDBFExtension(info.name) )
+            files.push_back(sPrefix + info.name);
+    } while( _findnext(hFind,&info) == 0 );
+    _findclose(hFind);
+#endif
+    std::sort(files.begin(),files.end());
+    dbfReadSchemas(files,schemas,nThreads);
+    return 0;
+}
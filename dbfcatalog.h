@@ -0,0 +1,42 @@
+#ifndef DBFCATALOG_H
+#define DBFCATALOG_H
+
+// Copyright (C) 2012 Ron Ostafichuk
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files
+// (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify,
+// merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR
+// IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+// Schema only access for catalogs of many tables.  dbfReadSchema reads the header and the field definitions of
+// one file with a single read and no DBF object (no record buffer, no mapping, no memo file, nothing printed),
+// dbfScanDirectory does the same for every .dbf in a directory on a pool of threads.
+// A schema is valid (nError 0) exactly when DBF::open would accept the header.
+
+#include "dbf.h"
+
+struct DBFSchema
+{
+    string sFileName;
+    int nError; // 0 when the header and fields were read, otherwise the file is not a table this engine opens
+    fileHeader header;
+    vector<fieldDefinition> fields; // with the offsets recalculated like DBF::open does
+    int64 nFileSize;
+};
+
+int dbfReadSchema(string sFileName, DBFSchema &schema);
+
+// one schema per file in the same order, returns the number of files that could not be read
+int dbfReadSchemas(const vector<string> &files, vector<DBFSchema> &schemas, int nThreads=0);
+
+// every *.dbf (any case) directly in sDirectory, sorted by file name. Returns 1 if the directory can not be listed
+int dbfScanDirectory(string sDirectory, vector<DBFSchema> &schemas, int nThreads=0);
+
+#endif // DBFCATALOG_H
@@ -0,0 +1,795 @@
+#include "dbfcsv.h"
+#include "dbffilter.h"
+#include "dbfparallel.h"
+
+#include <algorithm>
+#include <charconv>
+#include <future>
+
+#ifndef _WIN32
+#include <unistd.h>
+#else
+#include <io.h>
+#endif
+
+// Copyright (C) 2012 Ron Ostafichuk
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files
+// (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify,
+// merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR
+// IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define DBF_CSV_SSE2
+#endif
+
+DBFCSVOptions::DBFCSVOptions()
+{
+    bHeader = true;
+    bSkipDeleted = false;
+    bDeletedColumn = false;
+    bCRLF = false;
+    cDelimiter = ',';
+    nThreads = 1;
+    nChunkRecords = 4096;
+    nBufferBytes = 1 << 20;
+    pFilter = NULL;
+}
+
+// text of a field without the NUL fill (appendRecord) and the space padding on both sides
+static void trimPadding(const char *pField, int nLen, const char **ppStart, int *pnLen)
+{
+    const char *pEnd = (const char *) memchr(pField,0,nLen);
+    if( pEnd == NULL )
+        pEnd = pField + nLen;
+#ifdef DBF_CSV_SSE2
+    // wide 'C' fields are mostly padding, skip it 16 bytes at a time and finish byte by byte
+    const __m128i spaces = _mm_set1_epi8(' ');
+    while( pEnd - pField >= 16 && _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (pEnd - 16)),spaces)) == 0xFFFF )
+        pEnd -= 16;
+    while( pEnd - pField >= 16 && _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) pField),spaces)) == 0xFFFF )
+        pField += 16;
+#endif
+    while( pEnd > pField && pEnd[-1] == ' ' )
+        pEnd--;
+    while( pField < pEnd && *pField == ' ' )
+        pField++;
+    *ppStart = pField;
+    *pnLen = (int) (pEnd - pField);
+}
+
+static inline bool isSpecial(char c, char cDelimiter)
+{
+    return c == cDelimiter || c == '"' || c == '\n' || c == '\r';
+}
+
+static bool needsQuotes(const char *pText, int nLen, char cDelimiter)
+{
+    int i = 0;
+#ifdef DBF_CSV_SSE2
+    const __m128i delimiter = _mm_set1_epi8(cDelimiter);
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i lf = _mm_set1_epi8('\n');
+    const __m128i cr = _mm_set1_epi8('\r');
+    for( ; i + 16 <= nLen ; i += 16 )
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *) (pText + i));
+        __m128i hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v,delimiter),_mm_cmpeq_epi8(v,quote)),
+                                   _mm_or_si128(_mm_cmpeq_epi8(v,lf),_mm_cmpeq_epi8(v,cr)));
+        if( _mm_movemask_epi8(hit) != 0 )
+            return true;
+    }
+#endif
+    for( ; i < nLen ; i++ )
+    {
+        if( isSpecial(pText[i],cDelimiter) )
+            return true;
+    }
+    return false;
+}
+
+void dbfAppendCSVField(string &sOut, const char *pText, int nLen, char cDelimiter)
+{
+    if( !needsQuotes(pText,nLen,cDelimiter) )
+    {
+        sOut.append(pText,nLen);
+        return;
+    }
+    // RFC 4180, the whole field in double quotes and every double quote inside doubled
+    sOut += '"';
+    const char *pEnd = pText + nLen;
+    for( ;; )
+    {
+        const char *pQuote = (const char *) memchr(pText,'"',pEnd - pText);
+        if( pQuote == NULL )
+            break;
+        sOut.append(pText,pQuote - pText + 1);
+        sOut += '"';
+        pText = pQuote + 1;
+    }
+    sOut.append(pText,pEnd - pText);
+    sOut += '"';
+}
+
+static void appendInt64(string &sOut, int64 n)
+{
+    char buffer[24];
+    char *p = buffer + sizeof(buffer);
+    uint64 u = n < 0 ? 0 - (uint64) n : (uint64) n;
+    do
+    {
+        *--p = (char) ('0' + u % 10);
+        u /= 10;
+    } while( u != 0 );
+    if( n < 0 )
+        *--p = '-';
+    sOut.append(p,buffer + sizeof(buffer) - p);
+}
+
+static void appendLineEnd(string &sOut, const DBFCSVOptions &options)
+{
+    if( options.bCRLF )
+        sOut += '\r';
+    sOut += '\n';
+}
+
+// format nCount consecutive raw records, one line each
+static void formatRecords(const DBF &dbf, const char *pBlock, int nCount, int nRecordLength, const DBFCSVOptions &options,
+                          const vector<int> &fields, string &sOut)
+{
+    char cDelimiter = options.cDelimiter;
+    char number[32];
+    vector<char> memoBuffer; // memo blobs that are not in the mapping
+    for( int r = 0 ; r < nCount ; r++ )
+    {
+        const char *pRecord = pBlock + (size_t) r*nRecordLength;
+        bool bDeleted = pRecord[0] == DBF_DELETED_RECORD_FLAG;
+        if( bDeleted && options.bSkipDeleted )
+            continue;
+        if( options.pFilter != NULL && !options.pFilter->matches(pRecord) )
+            continue;
+
+        if( options.bDeletedColumn )
+        {
+            if( bDeleted )
+                sOut += DBF_DELETED_RECORD_FLAG;
+            sOut += cDelimiter;
+        }
+        for( size_t f = 0 ; f < fields.size() ; f++ )
+        {
+            if( f > 0 )
+                sOut += cDelimiter;
+            const fieldDefinition &fd = dbf.getFieldDefinition(fields[f]);
+            const char *pField = pRecord + fd.uFieldOffset;
+            char cType = fd.cFieldType;
+            if( cType == 'I' )
+                appendInt64(sOut,dbf.readFieldAsInt64(pRecord,fields[f]));
+            else if( cType == 'B' || ((cType == 'T' || cType == 'Y') && fd.uLength == 8) )
+            {
+                // binary numbers, date times and currency as readField shows them
+                int nLen = dbf.readFieldInto(pRecord,fields[f],number,sizeof(number));
+                if( nLen > 0 )
+                    sOut.append(number,nLen);
+            }
+            else if( cType == 'L' )
+                sOut += (pField[0] == 'T' || pField[0] == '?') ? pField[0] : 'F';
+            else if( dbf.isMemoField(fields[f]) && dbf.hasMemoFile() )
+            {
+                string_view blob;
+                if( dbf.readMemo(pRecord,fields[f],blob,memoBuffer) == 0 )
+                    dbfAppendCSVField(sOut,blob.data(),(int) blob.size(),cDelimiter);
+            }
+            else
+            {
+                const char *pStart;
+                int nLen;
+                trimPadding(pField,fd.uLength,&pStart,&nLen);
+                dbfAppendCSVField(sOut,pStart,nLen,cDelimiter);
+            }
+        }
+        appendLineEnd(sOut,options);
+    }
+}
+
+int DBF::exportCSV(const DBFOutputSink &sink,const DBFCSVOptions &options)
+{
+    if( m_pFileHandle == NULL || !checkFilter(options.pFilter) )
+        return 1;
+
+    vector<int> fields = options.nFields;
+    if( fields.empty() )
+    {
+        for( int f = 0 ; f < m_nNumFields ; f++ )
+            fields.push_back(f);
+    }
+    for( size_t f = 0 ; f < fields.size() ; f++ )
+    {
+        if( fields[f] < 0 || fields[f] >= m_nNumFields )
+        {
+            std::cerr << __FUNCTION__ << " Invalid field index " << fields[f] << std::endl;
+            return 1;
+        }
+    }
+
+    size_t nBufferBytes = max(options.nBufferBytes,(size_t) 4096);
+    string sOut;
+    sOut.reserve(nBufferBytes + 65536);
+
+    if( options.bHeader )
+    {
+        if( options.bDeletedColumn )
+            sOut += options.cDelimiter;
+        for( size_t f = 0 ; f < fields.size() ; f++ )
+        {
+            if( f > 0 )
+                sOut += options.cDelimiter;
+            string sName = GetFieldName(fields[f]);
+            dbfAppendCSVField(sOut,sName.data(),(int) sName.size(),options.cDelimiter);
+        }
+        appendLineEnd(sOut,options);
+    }
+
+    int nRecords = m_FileHeader.uRecordsInFile;
+    int nRecordLength = m_FileHeader.uRecordLength;
+    int nChunkRecords = max(options.nChunkRecords,1);
+    int nChunks = (int) (((int64) nRecords + nChunkRecords - 1) / nChunkRecords);
+    int nThreads = dbfDefaultThreadCount(options.nThreads);
+
+    if( nThreads == 1 )
+    {
+        // format straight into the output buffer
+        vector<char> buffer;
+        for( int nChunk = 0 ; nChunk < nChunks ; nChunk++ )
+        {
+            int nFirst = nChunk*nChunkRecords;
+            int nCount = min(nChunkRecords,nRecords - nFirst);
+            const char *pBlock = readBlock(nFirst,nCount,buffer);
+            if( pBlock == NULL )
+                return 1;
+            formatRecords(*this,pBlock,nCount,nRecordLength,options,fields,sOut);
+            if( sOut.size() >= nBufferBytes )
+            {
+                if( sink(sOut.data(),sOut.size()) != 0 )
+                    return 1;
+                sOut.clear();
+            }
+        }
+    } else
+    {
+        // a window of chunks is formatted in parallel into their own strings, then written in order
+        // so the memory used stays at a few chunks per thread however big the table is
+        int nWindow = nThreads*4;
+        vector<string> chunkText(nWindow);
+        vector< vector<char> > buffers(nThreads);
+        for( int nWindowFirst = 0 ; nWindowFirst < nChunks ; nWindowFirst += nWindow )
+        {
+            int nWindowChunks = min(nWindow,nChunks - nWindowFirst);
+            std::atomic<int> nErrors(0);
+            dbfParallelFor(nWindowChunks,nThreads,[&](int nItem,int nThread)
+            {
+                int nFirst = (nWindowFirst + nItem)*nChunkRecords;
+                int nCount = min(nChunkRecords,nRecords - nFirst);
+                string &sText = chunkText[nItem];
+                sText.clear();
+                const char *pBlock = readBlock(nFirst,nCount,buffers[nThread]);
+                if( pBlock == NULL )
+                {
+                    nErrors++;
+                    return;
+                }
+                formatRecords(*this,pBlock,nCount,nRecordLength,options,fields,sText);
+            });
+            if( nErrors != 0 )
+                return 1;
+
+            for( int i = 0 ; i < nWindowChunks ; i++ )
+            {
+                sOut += chunkText[i];
+                if( sOut.size() >= nBufferBytes )
+                {
+                    if( sink(sOut.data(),sOut.size()) != 0 )
+                        return 1;
+                    sOut.clear();
+                }
+            }
+        }
+    }
+
+    if( !sOut.empty() && sink(sOut.data(),sOut.size()) != 0 )
+        return 1;
+    return 0;
+}
+
+int DBF::exportCSV(int nFileDescriptor,const DBFCSVOptions &options)
+{
+    return exportCSV([nFileDescriptor](const char *pData,size_t nBytes)
+    {
+        while( nBytes > 0 )
+        {
+#ifndef _WIN32
+            ssize_t n = write(nFileDescriptor,pData,nBytes);
+            if( n < 0 && errno == EINTR )
+                continue;
+#else
+            int n = _write(nFileDescriptor,pData,(unsigned int) min(nBytes,(size_t) 1 << 30));
+#endif
+            if( n <= 0 )
+            {
+                std::cerr << "exportCSV write failed, errno=" << errno << std::endl;
+                return 1;
+            }
+            pData += n;
+            nBytes -= n;
+        }
+        return 0;
+    },options);
+}
+
+DBFImportOptions::DBFImportOptions()
+{
+    cDelimiter = ',';
+    bHeader = true;
+    nThreads = 0;
+    nChunkBytes = 4 << 20;
+    nInferRows = 1000;
+}
+
+// end of the unquoted field starting at p: the next delimiter, \r or \n (or pEnd)
+static const char *findFieldEnd(const char *p, const char *pEnd, char cDelimiter)
+{
+#ifdef DBF_CSV_SSE2
+    const __m128i delimiter = _mm_set1_epi8(cDelimiter);
+    const __m128i lf = _mm_set1_epi8('\n');
+    const __m128i cr = _mm_set1_epi8('\r');
+    for( ; pEnd - p >= 16 ; p += 16 )
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *) p);
+        __m128i hit = _mm_or_si128(_mm_cmpeq_epi8(v,delimiter),_mm_or_si128(_mm_cmpeq_epi8(v,lf),_mm_cmpeq_epi8(v,cr)));
+        if( _mm_movemask_epi8(hit) != 0 )
+            break; // it is in these 16 bytes
+    }
+#endif
+    while( p < pEnd && *p != cDelimiter && *p != '\n' && *p != '\r' )
+        p++;
+    return p;
+}
+
+// split one row into fields, onField(nColumn,pText,nLen) is called for each. Returns the start of the next row
+template <class FieldFn>
+static const char *parseRow(const char *p, const char *pEnd, char cDelimiter, string &sUnquoted, FieldFn onField)
+{
+    int nColumn = 0;
+    for( ;; )
+    {
+        if( p < pEnd && *p == '"' )
+        {
+            // quoted, "" is one quote and delimiters / line breaks are part of the text
+            sUnquoted.clear();
+            p++;
+            for( ;; )
+            {
+                const char *pQuote = (const char *) memchr(p,'"',pEnd - p);
+                if( pQuote == NULL )
+                {
+                    sUnquoted.append(p,pEnd - p); // not closed, take the rest
+                    p = pEnd;
+                    break;
+                }
+                sUnquoted.append(p,pQuote - p);
+                p = pQuote + 1;
+                if( p < pEnd && *p == '"' )
+                {
+                    sUnquoted += '"';
+                    p++;
+                }
+                else
+                    break;
+            }
+            // text between the closing quote and the delimiter is not RFC 4180, keep it rather than lose it
+            const char *pStop = findFieldEnd(p,pEnd,cDelimiter);
+            sUnquoted.append(p,pStop - p);
+            p = pStop;
+            onField(nColumn++,sUnquoted.data(),(int) sUnquoted.size());
+        } else
+        {
+            const char *pStop = findFieldEnd(p,pEnd,cDelimiter);
+            onField(nColumn++,p,(int) (pStop - p));
+            p = pStop;
+        }
+        if( p < pEnd && *p == cDelimiter )
+        {
+            p++;
+            continue;
+        }
+        break;
+    }
+    if( p < pEnd && *p == '\r' )
+        p++;
+    if( p < pEnd && *p == '\n' )
+        p++;
+    return p;
+}
+
+// length of the complete rows at the start of the text, 0 if there is not one complete row.
+// A \n ends a row when an even number of quotes came before it (escaped quotes come in pairs)
+static size_t completeRowsLength(const char *pText, size_t nLen)
+{
+    size_t nRowsEnd = 0;
+    bool bQuoted = false;
+    size_t i = 0;
+#ifdef DBF_CSV_SSE2
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i lf = _mm_set1_epi8('\n');
+    for( ; i + 16 <= nLen ; i += 16 )
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *) (pText + i));
+        int nQuotes = _mm_movemask_epi8(_mm_cmpeq_epi8(v,quote));
+        int nLines = _mm_movemask_epi8(_mm_cmpeq_epi8(v,lf));
+        if( nQuotes == 0 )
+        {
+            if( nLines != 0 && !bQuoted )
+            {
+                int b = 15;
+                while( !(nLines & (1 << b)) )
+                    b--;
+                nRowsEnd = i + b + 1;
+            }
+            continue;
+        }
+        // quotes in this block, follow them byte by byte
+        for( size_t j = i ; j < i + 16 ; j++ )
+        {
+            if( pText[j] == '"' )
+                bQuoted = !bQuoted;
+            else if( pText[j] == '\n' && !bQuoted )
+                nRowsEnd = j + 1;
+        }
+    }
+#endif
+    for( ; i < nLen ; i++ )
+    {
+        if( pText[i] == '"' )
+            bQuoted = !bQuoted;
+        else if( pText[i] == '\n' && !bQuoted )
+            nRowsEnd = i + 1;
+    }
+    return nRowsEnd;
+}
+
+// stage 2: parse the rows of one chunk and encode them into records, returns the number of records
+static int encodeChunk(const DBF &dbf, const vector<char> &text, vector<char> &records, int nFields, char cDelimiter,
+                       string &sUnquoted)
+{
+    size_t nRecordLength = dbf.getRecordLength();
+    const char *p = text.data();
+    const char *pEnd = p + text.size();
+    if( records.size() < nRecordLength*64 )
+        records.resize(nRecordLength*64);
+    int nCount = 0;
+    while( p < pEnd )
+    {
+        if( *p == '\n' || *p == '\r' )
+        {
+            p++; // blank line
+            continue;
+        }
+        if( (nCount + 1)*nRecordLength > records.size() )
+            records.resize(records.size()*2);
+        char *pRecord = &records[nCount*nRecordLength];
+        pRecord[0] = ' ';
+        int nValues = 0;
+        p = parseRow(p,pEnd,cDelimiter,sUnquoted,[&](int nColumn,const char *pText,int nLen)
+        {
+            if( nColumn < nFields )
+            {
+                dbf.encodeFieldValue(pText,nLen,nColumn,pRecord);
+                nValues = nColumn + 1;
+            }
+        });
+        for( int f = nValues ; f < nFields ; f++ )
+            dbf.encodeFieldValue("",0,f,pRecord);
+        nCount++;
+    }
+    return nCount;
+}
+
+int dbfParseSchema(string sSpec, vector<fieldDefinition> &schema)
+{
+    stringstream ssFields(sSpec);
+    string sField;
+    while( getline(ssFields,sField,',') )
+    {
+        vector<string> parts;
+        stringstream ssParts(sField);
+        string sPart;
+        while( getline(ssParts,sPart,':') )
+            parts.push_back(sPart);
+        if( parts.size() < 2 || parts[0].empty() || parts[1].size() != 1 )
+        {
+            std::cerr << "Bad field definition '" << sField << "'" << std::endl;
+            return 1;
+        }
+
+        fieldDefinition fd;
+        memset(&fd,0,sizeof(fd));
+        strncpy(fd.cFieldName,parts[0].c_str(),10);
+        fd.cFieldType = (char) toupper(parts[1][0]);
+        fd.uLength = parts.size() > 2 ? (uint8) atoi(parts[2].c_str()) : (fd.cFieldType == 'C' ? 20 : 10);
+        fd.uNumberOfDecimalPlaces = parts.size() > 3 ? (uint8) atoi(parts[3].c_str()) : 0;
+        if( (fd.cFieldType == 'B' || fd.cFieldType == 'D' || fd.cFieldType == 'T' || fd.cFieldType == 'Y') && parts.size() < 3 )
+            fd.uLength = 8;
+        schema.push_back(fd);
+    }
+    return schema.empty() ? 1 : 0;
+}
+
+int dbfInferCSVSchema(string sCSVFile, const DBFImportOptions &options, vector<fieldDefinition> &schema)
+{
+    schema.clear();
+    FILE *pFile = fopen(sCSVFile.c_str(),"rb");
+    if( pFile == NULL )
+    {
+        std::cerr << __FUNCTION__ << " Unable to open " << sCSVFile << std::endl;
+        return errno;
+    }
+    vector<char> text(max(options.nChunkBytes,(size_t) 65536));
+    size_t nRead = fread(&text[0],1,text.size(),pFile);
+    fclose(pFile);
+    if( nRead == text.size() )
+        nRead = completeRowsLength(&text[0],nRead); // the last row may be cut off
+    const char *p = text.data();
+    const char *pEnd = p + nRead;
+
+    struct ColumnStats
+    {
+        string sName;
+        int nMaxLength = 0;
+        int nValues = 0;
+        bool bInteger = true;
+        bool bNumber = true;
+        bool bLogical = true;
+    };
+    vector<ColumnStats> columns;
+    string sUnquoted;
+    int nRows = 0;
+    bool bHeaderRow = options.bHeader;
+    while( p < pEnd && nRows < options.nInferRows )
+    {
+        if( *p == '\n' || *p == '\r' )
+        {
+            p++;
+            continue;
+        }
+        p = parseRow(p,pEnd,options.cDelimiter,sUnquoted,[&](int nColumn,const char *pText,int nLen)
+        {
+            if( nColumn >= MAX_FIELDS )
+                return;
+            if( nColumn >= (int) columns.size() )
+                columns.resize(nColumn + 1);
+            ColumnStats &col = columns[nColumn];
+            if( bHeaderRow )
+            {
+                col.sName.assign(pText,nLen);
+                return;
+            }
+            if( nLen == 0 )
+                return;
+            col.nValues++;
+            col.nMaxLength = max(col.nMaxLength,nLen);
+            string_view sValue(pText,nLen);
+            if( col.bLogical )
+                col.bLogical = sValue == "T" || sValue == "F" || sValue == "?" || sValue == "TRUE" || sValue == "FALSE";
+            const char *pStart = pText + ((pText[0] == '-' || pText[0] == '+') ? 1 : 0);
+            const char *pEnd = pText + nLen;
+            // leading zeros are codes (zip, part numbers), keep them as text
+            bool bCode = pEnd - pStart > 1 && pStart[0] == '0' && pStart[1] >= '0' && pStart[1] <= '9';
+            if( col.bNumber )
+            {
+                double d;
+                std::from_chars_result res = std::from_chars(pStart,pEnd,d);
+                col.bNumber = res.ec == std::errc() && res.ptr == pEnd && pStart[0] != '-' && !bCode;
+            }
+            if( col.bInteger )
+            {
+                int64 n;
+                std::from_chars_result res = std::from_chars(pStart,pEnd,n);
+                col.bInteger = res.ec == std::errc() && res.ptr == pEnd && pStart[0] != '-' && !bCode && n <= 2147483647LL;
+            }
+        });
+        if( bHeaderRow )
+            bHeaderRow = false;
+        else
+            nRows++;
+    }
+    if( columns.empty() )
+    {
+        std::cerr << __FUNCTION__ << " No rows in " << sCSVFile << std::endl;
+        return 1;
+    }
+
+    for( size_t c = 0 ; c < columns.size() ; c++ )
+    {
+        ColumnStats &col = columns[c];
+        fieldDefinition fd;
+        memset(&fd,0,sizeof(fd));
+        string sName = col.sName;
+        if( sName.empty() )
+            sName = "FIELD" + std::to_string(c + 1);
+        strncpy(fd.cFieldName,sName.c_str(),10);
+        if( col.nValues > 0 && col.bLogical )
+        {
+            fd.cFieldType = 'L';
+            fd.uLength = 1;
+        }
+        else if( col.nValues > 0 && col.bInteger )
+        {
+            fd.cFieldType = 'I';
+            fd.uLength = 4;
+        }
+        else if( col.nValues > 0 && col.bNumber )
+        {
+            fd.cFieldType = 'B';
+            fd.uLength = 8;
+        } else
+        {
+            fd.cFieldType = 'C';
+            fd.uLength = (uint8) min(max(col.nMaxLength,1),254);
+        }
+        schema.push_back(fd);
+    }
+    return 0;
+}
+
+int dbfImportCSV(string sCSVFile, string sDBFFile, const vector<fieldDefinition> &schemaIn, const DBFImportOptions &options,
+                 int64 *pnRows)
+{
+    vector<fieldDefinition> schema = schemaIn;
+    if( schema.empty() && dbfInferCSVSchema(sCSVFile,options,schema) != 0 )
+        return 1;
+    if( schema.size() > MAX_FIELDS )
+    {
+        std::cerr << __FUNCTION__ << " Too many fields " << schema.size() << std::endl;
+        return 1;
+    }
+    for( size_t f = 0 ; f < schema.size() ; f++ )
+    {
+        // the records are encoded on many threads and appended raw, there is no way to stage memo blobs from there
+        char cType = schema[f].cFieldType;
+        if( cType == 'M' || cType == 'G' || cType == 'P' )
+        {
+            std::cerr << __FUNCTION__ << " Memo field " << string(schema[f].cFieldName,strnlen(schema[f].cFieldName,10))
+                      << " can not be imported, load it as 'C' or fill it with updateField after the import" << std::endl;
+            return 1;
+        }
+    }
+
+    FILE *pFile = fopen(sCSVFile.c_str(),"rb");
+    if( pFile == NULL )
+    {
+        std::cerr << __FUNCTION__ << " Unable to open " << sCSVFile << std::endl;
+        return errno;
+    }
+    int nFields = (int) schema.size();
+    DBF dbf;
+    int nRet = dbf.create(sDBFFile,nFields);
+    for( int f = 0 ; f < nFields && nRet == 0 ; f++ )
+        nRet = dbf.assignField(schema[f],f);
+    if( nRet == 0 )
+        nRet = dbf.beginAppend(1); // the header is written once at the end
+    if( nRet != 0 )
+    {
+        fclose(pFile);
+        return nRet;
+    }
+
+    int nThreads = dbfDefaultThreadCount(options.nThreads);
+    size_t nChunkBytes = max(options.nChunkBytes,(size_t) 65536);
+    int nWindow = nThreads*2;
+    char cDelimiter = options.cDelimiter;
+
+    vector< vector<char> > text(nWindow);
+    vector< vector<char> > records[2]; // the writer owns one set while the other is being encoded
+    vector<int> recordCounts[2];
+    for( int i = 0 ; i < 2 ; i++ )
+    {
+        records[i].resize(nWindow);
+        recordCounts[i].resize(nWindow);
+    }
+    vector<string> unquoted(nThreads);
+    vector<char> carry; // start of a row that did not fit in the last chunk
+    bool bEOF = false;
+    bool bSkipHeader = options.bHeader;
+    int nSet = 0;
+    int64 nRows = 0;
+    std::future<int> writing;
+
+    while( !bEOF && nRet == 0 )
+    {
+        // stage 1: read a window of chunks, each holding only complete rows
+        int nChunks = 0;
+        while( nChunks < nWindow && !bEOF )
+        {
+            vector<char> &chunk = text[nChunks];
+            chunk.assign(carry.begin(),carry.end());
+            size_t nRowsEnd;
+            for( ;; )
+            {
+                size_t nOld = chunk.size();
+                chunk.resize(nOld + nChunkBytes);
+                size_t nRead = fread(&chunk[nOld],1,nChunkBytes,pFile);
+                chunk.resize(nOld + nRead);
+                if( nRead < nChunkBytes )
+                {
+                    if( ferror(pFile) )
+                    {
+                        std::cerr << __FUNCTION__ << " Failed to read " << sCSVFile << std::endl;
+                        nRet = 1;
+                    }
+                    bEOF = true;
+                    nRowsEnd = chunk.size();
+                    break;
+                }
+                nRowsEnd = completeRowsLength(&chunk[0],chunk.size());
+                if( nRowsEnd > 0 )
+                    break;
+                // a row longer than a chunk, keep reading
+            }
+            carry.assign(chunk.begin() + nRowsEnd,chunk.end());
+            chunk.resize(nRowsEnd);
+
+            if( bSkipHeader && !chunk.empty() )
+            {
+                const char *pStart = chunk.data();
+                const char *pNext = parseRow(pStart,pStart + chunk.size(),cDelimiter,unquoted[0],[](int,const char *,int){});
+                chunk.erase(chunk.begin(),chunk.begin() + (pNext - pStart));
+                bSkipHeader = false;
+            }
+            if( !chunk.empty() )
+                nChunks++;
+        }
+
+        // stage 2: parse and encode the window in parallel
+        vector< vector<char> > &out = records[nSet];
+        vector<int> &counts = recordCounts[nSet];
+        dbfParallelFor(nChunks,nThreads,[&](int nChunk,int nThread)
+        {
+            counts[nChunk] = encodeChunk(dbf,text[nChunk],out[nChunk],nFields,cDelimiter,unquoted[nThread]);
+        });
+        for( int i = 0 ; i < nChunks ; i++ )
+            nRows += counts[i];
+
+        // stage 3: the previous window must be on disk before this one is queued behind it
+        if( writing.valid() && writing.get() != 0 )
+            nRet = 1;
+        if( nRet != 0 )
+            break;
+        writing = std::async(std::launch::async,[&dbf,&out,&counts,nChunks]()
+        {
+            for( int i = 0 ; i < nChunks ; i++ )
+            {
+                if( counts[i] > 0 && dbf.appendRawRecords(&out[i][0],counts[i]) != 0 )
+                    return 1;
+            }
+            return 0;
+        });
+        nSet ^= 1;
+    }
+    if( writing.valid() && writing.get() != 0 )
+        nRet = 1;
+    fclose(pFile);
+
+    if( dbf.commitAppend() != 0 )
+        nRet = 1;
+    dbf.close();
+    if( pnRows != NULL )
+        *pnRows = nRows;
+    return nRet;
+}
@@ -0,0 +1,77 @@
+#ifndef DBFCSV_H
+#define DBFCSV_H
+
+// Copyright (C) 2012 Ron Ostafichuk
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files
+// (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify,
+// merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR
+// IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+// CSV export (DBF::exportCSV).  Records are read in chunks straight from the mapping or with one pread, formatted
+// into a large buffer and handed to the sink in pieces of about nBufferBytes, never a row at a time.
+// With more than one thread the chunks are formatted in parallel and written in table order.
+//
+// Text is trimmed of its space / NUL padding and quoted per RFC 4180 when it holds the delimiter, a double quote
+// or a line break (quotes inside are doubled).  'I' fields are written as signed integers, 'B' with the same
+// precision as readField, 'L' as T, F or ?, binary 'T' as YYYY-MM-DD HH:MM:SS and 'Y' with 4 decimals.
+//
+// CSV import (dbfImportCSV) runs as a three stage pipeline: the calling thread reads the file in large chunks cut
+// at row boundaries, a pool of threads parses the chunks and encodes the values straight into the record layout
+// (DBF::encodeFieldValue, the appendRecord rules without any strings), and a writer thread appends each window
+// of finished records with one large write while the next window is being read and encoded.
+// Rows end with \n or \r\n, quoted fields may hold line breaks.  Missing trailing values are left empty.
+
+#include "dbf.h"
+
+struct DBFCSVOptions
+{
+    DBFCSVOptions();
+
+    vector<int> nFields; // field indexes to export in this order, empty means all fields
+    bool bHeader; // first line holds the field names
+    bool bSkipDeleted; // leave deleted records out
+    bool bDeletedColumn; // extra first column with * for deleted records (the dumpAsCSV layout)
+    bool bCRLF; // end lines with \r\n as RFC 4180 says, otherwise \n
+    char cDelimiter;
+    int nThreads; // threads formatting chunks, 0 = all cores
+    int nChunkRecords; // records per chunk
+    size_t nBufferBytes; // size of the pieces given to the sink
+    const DBFFilter *pFilter; // optional, only matching records are exported (must be compiled)
+};
+
+struct DBFImportOptions
+{
+    DBFImportOptions();
+
+    char cDelimiter;
+    bool bHeader; // first line holds the field names, it is skipped (and used to name inferred fields)
+    int nThreads; // threads parsing and encoding chunks, 0 = all cores
+    size_t nChunkBytes; // CSV text per chunk
+    int nInferRows; // rows looked at by dbfInferCSVSchema
+};
+
+// build a schema from the first rows: 'L' for T/F/?/TRUE/FALSE columns, 'I' for 32 bit integers (without leading zeros),
+// 'B' for other numbers and 'C' as wide as the longest value seen. Only a sample is read, give a schema for odd data
+int dbfInferCSVSchema(string sCSVFile, const DBFImportOptions &options, vector<fieldDefinition> &schema);
+
+// parse a schema written as NAME:TYPE[:LENGTH[:DECIMALS]],... e.g. ID:I,NAME:C:30,PRICE:N:10:2,ACTIVE:L
+// (the -f option of dbfimport and dbfbench). Without a length 'C' is 20 bytes, 'B', 'D', 'T' and 'Y' 8 and the rest 10
+int dbfParseSchema(string sSpec, vector<fieldDefinition> &schema);
+
+// create sDBFFile with the schema (inferred when empty) and load every row of the CSV file into it. Memo fields
+// ('M', 'G' and 'P') are not supported, a schema with one is refused
+int dbfImportCSV(string sCSVFile, string sDBFFile, const vector<fieldDefinition> &schema, const DBFImportOptions &options,
+                 int64 *pnRows=NULL);
+
+// append one field to sOut, quoted when it holds cDelimiter, a double quote, \r or \n
+void dbfAppendCSVField(string &sOut, const char *pText, int nLen, char cDelimiter);
+
+#endif // DBFCSV_H
@@ -0,0 +1,317 @@
+#include "dbfdate.h"
+
+// Copyright (C) 2012 Ron Ostafichuk
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files
+// (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify,
+// merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR
+// IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+static inline int64 floorDiv(int64 a, int64 b)
+{
+    return a/b - ((a % b != 0) && ((a < 0) != (b < 0)));
+}
+
+int64 dbfDaysFromCivil(int nYear, int nMonth, int nDay)
+{
+    // H. Hinnant's days_from_civil, exact for every year of the proleptic Gregorian calendar
+    int64 y = (int64) nYear - (nMonth <= 2);
+    int64 nEra = floorDiv(y,400);
+    int64 nYearOfEra = y - nEra*400;
+    int64 nDayOfYear = (153*(nMonth + (nMonth > 2 ? -3 : 9)) + 2)/5 + nDay - 1;
+    int64 nDayOfEra = nYearOfEra*365 + nYearOfEra/4 - nYearOfEra/100 + nDayOfYear;
+    return nEra*146097 + nDayOfEra - 719468;
+}
+
+void dbfCivilFromDays(int64 nDays, int *pnYear, int *pnMonth, int *pnDay)
+{
+    nDays += 719468;
+    int64 nEra = floorDiv(nDays,146097);
+    int64 nDayOfEra = nDays - nEra*146097;
+    int64 nYearOfEra = (nDayOfEra - nDayOfEra/1460 + nDayOfEra/36524 - nDayOfEra/146096)/365;
+    int64 nDayOfYear = nDayOfEra - (365*nYearOfEra + nYearOfEra/4 - nYearOfEra/100);
+    int64 nMonthIndex = (5*nDayOfYear + 2)/153;
+    *pnDay = (int) (nDayOfYear - (153*nMonthIndex + 2)/5 + 1);
+    *pnMonth = (int) (nMonthIndex < 10 ? nMonthIndex + 3 : nMonthIndex - 9);
+    *pnYear = (int) (nYearOfEra + nEra*400 + (*pnMonth <= 2));
+}
+
+static inline bool isDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+// nCount digits at p, -1 if any is not a digit
+static inline int readDigits(const char *p, int nCount)
+{
+    int n = 0;
+    for( int i = 0 ; i < nCount ; i++ )
+    {
+        if( !isDigit(p[i]) )
+            return -1;
+        n = n*10 + (p[i] - '0');
+    }
+    return n;
+}
+
+static inline bool validDate(int nYear, int nMonth, int nDay)
+{
+    static const int nDaysInMonth[12] = {31,29,31,30,31,30,31,31,30,31,30,31};
+    if( nYear < 0 || nMonth < 1 || nMonth > 12 || nDay < 1 || nDay > nDaysInMonth[nMonth-1] )
+        return false;
+    return nMonth != 2 || nDay < 29 || (nYear % 4 == 0 && (nYear % 100 != 0 || nYear % 400 == 0));
+}
+
+static inline void trimText(const char **ppText, int *pnLen)
+{
+    const char *p = *ppText;
+    const char *pEnd = p + *pnLen;
+    while( p < pEnd && (*p == ' ' || *p == 0) )
+        p++;
+    while( pEnd > p && (pEnd[-1] == ' ' || pEnd[-1] == 0) )
+        pEnd--;
+    *ppText = p;
+    *pnLen = (int) (pEnd - p);
+}
+
+// date at the start of pText, sets *pnUsed to the characters taken
+static int parseDatePart(const char *pText, int nLen, int64 *pnDays, int *pnUsed)
+{
+    int nYear, nMonth, nDay;
+    if( nLen >= 10 && !isDigit(pText[4]) && pText[7] == pText[4] )
+    {
+        nYear = readDigits(pText,4);
+        nMonth = readDigits(pText + 5,2);
+        nDay = readDigits(pText + 8,2);
+        *pnUsed = 10;
+    }
+    else if( nLen >= 8 )
+    {
+        nYear = readDigits(pText,4);
+        nMonth = readDigits(pText + 4,2);
+        nDay = readDigits(pText + 6,2);
+        *pnUsed = 8;
+    } else
+        return DBF_NUM_INVALID;
+    if( nYear < 0 || nMonth < 0 || nDay < 0 || !validDate(nYear,nMonth,nDay) )
+        return DBF_NUM_INVALID;
+    *pnDays = dbfDaysFromCivil(nYear,nMonth,nDay);
+    return DBF_NUM_OK;
+}
+
+int dbfDecodeDate(const char *pField, int nLength, int64 *pnDays)
+{
+    return dbfParseDate(pField,nLength,pnDays);
+}
+
+int dbfParseDate(const char *pText, int nLen, int64 *pnDays)
+{
+    trimText(&pText,&nLen);
+    if( nLen == 0 )
+        return DBF_NUM_EMPTY;
+    int nUsed;
+    int64 nDays;
+    int nRes = parseDatePart(pText,nLen,&nDays,&nUsed);
+    if( nRes != DBF_NUM_OK || nUsed != nLen )
+        return DBF_NUM_INVALID;
+    *pnDays = nDays;
+    return DBF_NUM_OK;
+}
+
+int dbfParseDateTime(const char *pText, int nLen, int64 *pnEpochMs)
+{
+    trimText(&pText,&nLen);
+    if( nLen == 0 )
+        return DBF_NUM_EMPTY;
+    int nUsed;
+    int64 nDays;
+    if( parseDatePart(pText,nLen,&nDays,&nUsed) != DBF_NUM_OK )
+        return DBF_NUM_INVALID;
+    const char *p = pText + nUsed;
+    const char *pEnd = pText + nLen;
+    int64 nMs = 0;
+    if( p < pEnd )
+    {
+        int nHour, nMinute, nSecond = 0, nMilli = 0;
+        if( nUsed == 8 && pEnd - p == 6 )
+        {
+            // YYYYMMDDHHMMSS
+            nHour = readDigits(p,2);
+            nMinute = readDigits(p + 2,2);
+            nSecond = readDigits(p + 4,2);
+            p += 6;
+        } else
+        {
+            if( (*p != ' ' && *p != 'T') || pEnd - p < 6 || p[3] != ':' )
+                return DBF_NUM_INVALID;
+            nHour = readDigits(p + 1,2);
+            nMinute = readDigits(p + 4,2);
+            p += 6;
+            if( p < pEnd && *p == ':' )
+            {
+                if( pEnd - p < 3 )
+                    return DBF_NUM_INVALID;
+                nSecond = readDigits(p + 1,2);
+                p += 3;
+                if( p < pEnd && *p == '.' )
+                {
+                    // fraction of a second, milliseconds are kept
+                    int nDigits = 0;
+                    for( p++ ; p < pEnd && isDigit(*p) ; p++, nDigits++ )
+                    {
+                        if( nDigits < 3 )
+                            nMilli = nMilli*10 + (*p - '0');
+                    }
+                    if( nDigits == 0 )
+                        return DBF_NUM_INVALID;
+                    for( ; nDigits < 3 ; nDigits++ )
+                        nMilli *= 10;
+                }
+            }
+        }
+        if( p != pEnd || nHour < 0 || nHour > 23 || nMinute < 0 || nMinute > 59 || nSecond < 0 || nSecond > 59 )
+            return DBF_NUM_INVALID;
+        nMs = ((nHour*60 + nMinute)*60 + nSecond)*1000LL + nMilli;
+    }
+    *pnEpochMs = nDays*DBF_MS_PER_DAY + nMs;
+    return DBF_NUM_OK;
+}
+
+static inline uint32 readLittleEndian32(const char *p)
+{
+    const uint8 *u = (const uint8 *) p;
+    return ((uint32) u[3] << 24) | ((uint32) u[2] << 16) | ((uint32) u[1] << 8) | u[0];
+}
+
+static inline void writeLittleEndian32(char *p, uint32 u)
+{
+    for( int i = 0 ; i < 4 ; i++ )
+        p[i] = (char) (u >> (i*8));
+}
+
+int dbfDecodeDateTime(const char *pField, int nLength, int64 *pnEpochMs)
+{
+    if( nLength != 8 )
+        return dbfParseDateTime(pField,nLength,pnEpochMs); // not the binary layout, try it as text
+    uint32 uJulianDay = readLittleEndian32(pField);
+    uint32 uMs = readLittleEndian32(pField + 4);
+    if( uJulianDay == 0 && uMs == 0 )
+        return DBF_NUM_EMPTY;
+    if( uMs >= DBF_MS_PER_DAY )
+        return DBF_NUM_INVALID;
+    *pnEpochMs = ((int64) uJulianDay - DBF_JULIAN_DAY_1970)*DBF_MS_PER_DAY + uMs;
+    return DBF_NUM_OK;
+}
+
+int dbfDecodeCurrency(const char *pField, int nLength, int64 *pnScaled)
+{
+    if( nLength != 8 )
+        return dbfNumericToScaled(pField,nLength,DBF_CURRENCY_SCALE,pnScaled); // text currency
+    uint64 u = (uint64) readLittleEndian32(pField) | ((uint64) readLittleEndian32(pField + 4) << 32);
+    *pnScaled = (int64) u;
+    return DBF_NUM_OK;
+}
+
+void dbfEncodeDate(int64 nDays, char *pField)
+{
+    char buffer[16];
+    if( dbfFormatDate(nDays,buffer) == 8 )
+        memcpy(pField,buffer,8);
+    else
+        memset(pField,' ',8); // year outside 0..9999
+}
+
+void dbfEncodeDateTime(int64 nEpochMs, char *pField)
+{
+    int64 nDays = floorDiv(nEpochMs,DBF_MS_PER_DAY);
+    writeLittleEndian32(pField,(uint32) (nDays + DBF_JULIAN_DAY_1970));
+    writeLittleEndian32(pField + 4,(uint32) (nEpochMs - nDays*DBF_MS_PER_DAY));
+}
+
+void dbfEncodeCurrency(int64 nScaled, char *pField)
+{
+    writeLittleEndian32(pField,(uint32) (uint64) nScaled);
+    writeLittleEndian32(pField + 4,(uint32) ((uint64) nScaled >> 32));
+}
+
+static inline char *putDigits(char *p, int n, int nCount)
+{
+    for( int i = nCount - 1 ; i >= 0 ; i-- , n /= 10 )
+        p[i] = (char) ('0' + n % 10);
+    return p + nCount;
+}
+
+int dbfFormatDate(int64 nDays, char *pDest)
+{
+    int nYear, nMonth, nDay;
+    dbfCivilFromDays(nDays,&nYear,&nMonth,&nDay);
+    if( nYear < 0 || nYear > 9999 )
+    {
+        pDest[0] = 0;
+        return 0;
+    }
+    char *p = putDigits(pDest,nYear,4);
+    p = putDigits(p,nMonth,2);
+    p = putDigits(p,nDay,2);
+    *p = 0;
+    return 8;
+}
+
+int dbfFormatDateTime(int64 nEpochMs, char *pDest)
+{
+    int64 nDays = floorDiv(nEpochMs,DBF_MS_PER_DAY);
+    int nMs = (int) (nEpochMs - nDays*DBF_MS_PER_DAY);
+    int nYear, nMonth, nDay;
+    dbfCivilFromDays(nDays,&nYear,&nMonth,&nDay);
+    if( nYear < 0 || nYear > 9999 )
+    {
+        pDest[0] = 0;
+        return 0;
+    }
+    char *p = putDigits(pDest,nYear,4);
+    *p++ = '-';
+    p = putDigits(p,nMonth,2);
+    *p++ = '-';
+    p = putDigits(p,nDay,2);
+    *p++ = ' ';
+    p = putDigits(p,nMs/3600000,2);
+    *p++ = ':';
+    p = putDigits(p,nMs/60000 % 60,2);
+    *p++ = ':';
+    p = putDigits(p,nMs/1000 % 60,2);
+    if( nMs % 1000 != 0 )
+    {
+        *p++ = '.';
+        p = putDigits(p,nMs % 1000,3);
+    }
+    *p = 0;
+    return (int) (p - pDest);
+}
+
+int dbfFormatCurrency(int64 nScaled, char *pDest)
+{
+    uint64 u = nScaled < 0 ? 0 - (uint64) nScaled : (uint64) nScaled;
+    char buffer[24];
+    char *p = buffer + sizeof(buffer);
+    for( int i = 0 ; i < DBF_CURRENCY_SCALE ; i++ , u /= 10 )
+        *--p = (char) ('0' + u % 10);
+    *--p = '.';
+    do
+    {
+        *--p = (char) ('0' + u % 10);
+        u /= 10;
+    } while( u != 0 );
+    if( nScaled < 0 )
+        *--p = '-';
+    int nLen = (int) (buffer + sizeof(buffer) - p);
+    memcpy(pDest,p,nLen);
+    pDest[nLen] = 0;
+    return nLen;
+}
@@ -0,0 +1,55 @@
+#ifndef DBFDATE_H
+#define DBFDATE_H
+
+// Copyright (C) 2012 Ron Ostafichuk
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files
+// (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify,
+// merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR
+// IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+// Native codecs for the date, time and money field types.  No heap, no locale, no strftime.
+//
+// 'D' is 8 ASCII digits YYYYMMDD (blank when empty), decoded to a day number counted from 1970-01-01.
+// 'T' (8 bytes, Visual FoxPro) is a little endian 32 bit julian day followed by the milliseconds since midnight,
+// decoded to milliseconds since 1970-01-01 00:00:00 (no time zone, the table does not store one).  Both zero is empty.
+// 'Y' (8 bytes, Visual FoxPro) is a little endian int64 holding the amount times 10^4.
+//
+// The decoders return the DBF_NUM_ codes of dbfnumeric.h and leave the output untouched unless it is DBF_NUM_OK.
+
+#include "dbfnumeric.h"
+
+#define DBF_JULIAN_DAY_1970 2440588 // julian day number of 1970-01-01
+#define DBF_MS_PER_DAY 86400000LL
+#define DBF_CURRENCY_SCALE 4
+
+// proleptic Gregorian calendar <-> days since 1970-01-01
+int64 dbfDaysFromCivil(int nYear, int nMonth, int nDay);
+void dbfCivilFromDays(int64 nDays, int *pnYear, int *pnMonth, int *pnDay);
+
+int dbfDecodeDate(const char *pField, int nLength, int64 *pnDays);
+int dbfDecodeDateTime(const char *pField, int nLength, int64 *pnEpochMs);
+int dbfDecodeCurrency(const char *pField, int nLength, int64 *pnScaled);
+
+void dbfEncodeDate(int64 nDays, char *pField); // 8 bytes
+void dbfEncodeDateTime(int64 nEpochMs, char *pField); // 8 bytes
+void dbfEncodeCurrency(int64 nScaled, char *pField); // 8 bytes
+
+// text input: dates as YYYYMMDD or YYYY-MM-DD (also with / or .), date times as a date optionally followed by
+// ' ' or 'T' and HH:MM[:SS[.fff]], or as YYYYMMDDHHMMSS. Blank text is DBF_NUM_EMPTY
+int dbfParseDate(const char *pText, int nLen, int64 *pnDays);
+int dbfParseDateTime(const char *pText, int nLen, int64 *pnEpochMs);
+
+// text output, returns the length written (pDest needs 9 bytes for a date, 24 for a date time, 24 for money)
+int dbfFormatDate(int64 nDays, char *pDest); // YYYYMMDD, how FoxPro stores it
+int dbfFormatDateTime(int64 nEpochMs, char *pDest); // YYYY-MM-DD HH:MM:SS, .fff added when there are milliseconds
+int dbfFormatCurrency(int64 nScaled, char *pDest); // 1234.5600
+
+#endif // DBFDATE_H
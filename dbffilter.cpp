@@ -0,0 +1,330 @@
+#include "dbffilter.h"
+#include "dbfnumeric.h"
+#include "dbfdate.h"
+
+// Copyright (C) 2012 Ron Ostafichuk
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files
+// (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify,
+// merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR
+// IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+// FoxPro style logical value, T/Y are true, F/N are false, anything else is null
+static char normaliseLogical(char c)
+{
+    if( c == 'T' || c == 't' || c == 'Y' || c == 'y' )
+        return 'T';
+    if( c == 'F' || c == 'f' || c == 'N' || c == 'n' )
+        return 'F';
+    return '?';
+}
+
+// true when the rest of a text field is only padding
+static inline bool isPadding(const char *p, int nLen)
+{
+    for( int i = 0 ; i < nLen ; i++ )
+    {
+        if( p[i] != ' ' && p[i] != 0 )
+            return false;
+    }
+    return true;
+}
+
+// compare a padded text field with a value that has no trailing padding, <0, 0 or >0 like memcmp
+static inline int compareText(const char *pField, int nLength, const string &sValue)
+{
+    int nValueLen = (int) sValue.size();
+    int nCommon = nValueLen < nLength ? nValueLen : nLength;
+    int nCmp = memcmp(pField,sValue.data(),nCommon);
+    if( nCmp != 0 )
+        return nCmp;
+    if( nValueLen > nLength )
+        return -1; // value is longer than the field can hold
+    // a NUL ends the text (appendRecord zero fills), treat it like the space padding FoxPro uses
+    return isPadding(pField + nCommon,nLength - nCommon) ? 0 : 1;
+}
+
+// line up the scale of one decimal with a bigger scale, false if it would overflow
+static inline bool raiseScale(int64 *pnMantissa, int *pnScale, int nScale)
+{
+    while( *pnScale < nScale )
+    {
+        if( *pnMantissa > 922337203685477580LL || *pnMantissa < -922337203685477580LL )
+            return false;
+        *pnMantissa *= 10;
+        (*pnScale)++;
+    }
+    return true;
+}
+
+// compare two exact decimals
+static int compareDecimal(int64 nM1, int nS1, int64 nM2, int nS2)
+{
+    int64 nA = nM1;
+    int nScaleA = nS1;
+    int64 nB = nM2;
+    int nScaleB = nS2;
+    if( raiseScale(&nA,&nScaleA,nScaleB) && raiseScale(&nB,&nScaleB,nScaleA) )
+        return nA < nB ? -1 : (nA > nB ? 1 : 0);
+
+    // too many digits to line up, doubles are good enough here
+    double d1 = dbfScaledToDouble(nM1,nS1);
+    double d2 = dbfScaledToDouble(nM2,nS2);
+    return d1 < d2 ? -1 : (d1 > d2 ? 1 : 0);
+}
+
+static inline bool compareResult(int nOperator, int nCmp)
+{
+    switch( nOperator )
+    {
+    case DBF_FILTER_EQ:
+    case DBF_FILTER_IN:
+        return nCmp == 0;
+    case DBF_FILTER_NE:
+        return nCmp != 0;
+    case DBF_FILTER_LT:
+        return nCmp < 0;
+    case DBF_FILTER_LE:
+        return nCmp <= 0;
+    case DBF_FILTER_GT:
+        return nCmp > 0;
+    case DBF_FILTER_GE:
+        return nCmp >= 0;
+    }
+    return false;
+}
+
+DBFFilter::DBFFilter()
+{
+    m_bCompiled = false;
+}
+
+void DBFFilter::addCondition(string sField, int nOperator, string sValue)
+{
+    Condition cond;
+    cond.sField = sField;
+    cond.nOperator = nOperator;
+    cond.values.push_back(sValue);
+    m_Conditions.push_back(cond);
+    m_bCompiled = false;
+}
+
+void DBFFilter::addIn(string sField, const vector<string> &values)
+{
+    Condition cond;
+    cond.sField = sField;
+    cond.nOperator = DBF_FILTER_IN;
+    cond.values = values;
+    m_Conditions.push_back(cond);
+    m_bCompiled = false;
+}
+
+void DBFFilter::clear()
+{
+    m_Conditions.clear();
+    m_bCompiled = false;
+}
+
+int DBFFilter::compile(const DBF &dbf)
+{
+    m_bCompiled = false;
+    for( size_t c = 0 ; c < m_Conditions.size() ; c++ )
+    {
+        Condition &cond = m_Conditions[c];
+        int nField = dbf.getFieldIndex(cond.sField);
+        if( nField < 0 )
+        {
+            std::cerr << __FUNCTION__ << " Unknown field " << cond.sField << std::endl;
+            return 1;
+        }
+        const fieldDefinition &fd = dbf.getFieldDefinition(nField);
+        cond.nOffset = fd.uFieldOffset;
+        cond.nLength = fd.uLength;
+        cond.cType = fd.cFieldType;
+        if( cond.cType == 'D' && cond.nOperator == DBF_FILTER_PREFIX )
+            cond.cType = 'C'; // prefix of the YYYYMMDD text, e.g. all of one year
+        else if( cond.cType == 'T' && cond.nLength != 8 )
+            cond.cType = 'C'; // not the binary layout
+        else if( cond.cType == 'Y' && cond.nLength != 8 )
+            cond.cType = 'N'; // currency written as text
+        if( cond.cType != 'N' && cond.cType != 'F' && cond.cType != 'I' && cond.cType != 'B' && cond.cType != 'L'
+                && cond.cType != 'D' && cond.cType != 'T' && cond.cType != 'Y' )
+            cond.cType = 'C'; // everything else is compared as text
+        cond.texts.clear();
+        cond.mantissas.clear();
+        cond.scales.clear();
+        cond.doubles.clear();
+        cond.logicals.clear();
+
+        if( cond.nOperator == DBF_FILTER_PREFIX && cond.cType != 'C' )
+        {
+            std::cerr << __FUNCTION__ << " Prefix is only supported on character fields, not " << cond.sField << std::endl;
+            return 1;
+        }
+        if( cond.cType == 'L' && cond.nOperator != DBF_FILTER_EQ && cond.nOperator != DBF_FILTER_NE && cond.nOperator != DBF_FILTER_IN )
+        {
+            std::cerr << __FUNCTION__ << " Logical field " << cond.sField << " only supports =, <> and IN" << std::endl;
+            return 1;
+        }
+
+        for( size_t v = 0 ; v < cond.values.size() ; v++ )
+        {
+            const string &sValue = cond.values[v];
+            if( cond.cType == 'C' )
+            {
+                string sText = sValue;
+                if( cond.nOperator != DBF_FILTER_PREFIX )
+                {
+                    size_t nEnd = sText.find_last_not_of(' ');
+                    sText.erase(nEnd == string::npos ? 0 : nEnd + 1);
+                }
+                cond.texts.push_back(sText);
+            }
+            else if( cond.cType == 'L' )
+            {
+                cond.logicals.push_back(sValue.empty() ? '?' : normaliseLogical(sValue[0]));
+            }
+            else if( cond.cType == 'D' || cond.cType == 'T' )
+            {
+                // days or milliseconds since 1970-01-01, a date alone is midnight for 'T'
+                int64 nValue;
+                int nRes = cond.cType == 'D' ? dbfParseDate(sValue.data(),(int) sValue.size(),&nValue)
+                                             : dbfParseDateTime(sValue.data(),(int) sValue.size(),&nValue);
+                if( nRes != DBF_NUM_OK )
+                {
+                    std::cerr << __FUNCTION__ << " '" << sValue << "' is not a date for field " << cond.sField << std::endl;
+                    return 1;
+                }
+                cond.mantissas.push_back(nValue);
+                cond.scales.push_back(0);
+            } else
+            {
+                int64 nMantissa;
+                int nScale;
+                if( dbfParseNumeric(sValue.data(),(int) sValue.size(),&nMantissa,&nScale) != DBF_NUM_OK )
+                {
+                    std::cerr << __FUNCTION__ << " '" << sValue << "' is not a number for field " << cond.sField << std::endl;
+                    return 1;
+                }
+                cond.mantissas.push_back(nMantissa);
+                cond.scales.push_back(nScale);
+                cond.doubles.push_back(dbfScaledToDouble(nMantissa,nScale));
+            }
+        }
+    }
+    m_bCompiled = true;
+    return 0;
+}
+
+bool DBFFilter::testCondition(const Condition &cond, const char *pRecord) const
+{
+    const char *pField = pRecord + cond.nOffset;
+    size_t nValues = cond.values.size();
+
+    if( cond.cType == 'C' )
+    {
+        if( cond.nOperator == DBF_FILTER_PREFIX )
+            return memcmp(pField,cond.texts[0].data(),min(cond.texts[0].size(),(size_t) cond.nLength)) == 0
+                    && cond.texts[0].size() <= (size_t) cond.nLength;
+        for( size_t v = 0 ; v < nValues ; v++ )
+        {
+            if( compareResult(cond.nOperator,compareText(pField,cond.nLength,cond.texts[v])) )
+                return true; // only IN has more than one value
+        }
+        return false;
+    }
+
+    if( cond.cType == 'L' )
+    {
+        char c = normaliseLogical(pField[0]);
+        for( size_t v = 0 ; v < nValues ; v++ )
+        {
+            if( compareResult(cond.nOperator,c == cond.logicals[v] ? 0 : 1) )
+                return true;
+        }
+        return false;
+    }
+
+    if( cond.cType == 'B' )
+    {
+        double d;
+        if( cond.nLength == 8 )
+            memcpy(&d,pField,8);
+        else if( cond.nLength == 4 )
+        {
+            float f;
+            memcpy(&f,pField,4);
+            d = f;
+        } else
+            return false;
+        for( size_t v = 0 ; v < nValues ; v++ )
+        {
+            int nCmp = d < cond.doubles[v] ? -1 : (d > cond.doubles[v] ? 1 : 0);
+            if( compareResult(cond.nOperator,nCmp) )
+                return true;
+        }
+        return false;
+    }
+
+    if( cond.cType == 'D' || cond.cType == 'T' )
+    {
+        int64 nValue;
+        int nRes = cond.cType == 'D' ? dbfDecodeDate(pField,cond.nLength,&nValue) : dbfDecodeDateTime(pField,cond.nLength,&nValue);
+        if( nRes != DBF_NUM_OK )
+            return false; // empty dates never match
+        for( size_t v = 0 ; v < nValues ; v++ )
+        {
+            int nCmp = nValue < cond.mantissas[v] ? -1 : (nValue > cond.mantissas[v] ? 1 : 0);
+            if( compareResult(cond.nOperator,nCmp) )
+                return true;
+        }
+        return false;
+    }
+
+    // 'I', 'Y', 'N' and 'F' are compared as exact decimals
+    int64 nMantissa;
+    int nScale;
+    if( cond.cType == 'Y' )
+    {
+        dbfDecodeCurrency(pField,cond.nLength,&nMantissa); // little endian int64, 4 implied decimals
+        nScale = DBF_CURRENCY_SCALE;
+    }
+    else if( cond.cType == 'I' )
+    {
+        // little endian signed integer, normally 4 bytes
+        uint64 u = 0;
+        int nLength = min(cond.nLength,8);
+        for( int i = 0 ; i < nLength ; i++ )
+            u |= ((uint64) (uint8) pField[i]) << (i*8);
+        if( nLength > 0 && nLength < 8 && (pField[nLength-1] & 0x80) )
+            u |= ~(uint64) 0 << (nLength*8);
+        nMantissa = (int64) u;
+        nScale = 0;
+    }
+    else if( dbfParseNumeric(pField,cond.nLength,&nMantissa,&nScale) != DBF_NUM_OK )
+        return false; // blank or bad numbers never match
+
+    for( size_t v = 0 ; v < nValues ; v++ )
+    {
+        if( compareResult(cond.nOperator,compareDecimal(nMantissa,nScale,cond.mantissas[v],cond.scales[v])) )
+            return true;
+    }
+    return false;
+}
+
+bool DBFFilter::matches(const char *pRecord) const
+{
+    for( size_t c = 0 ; c < m_Conditions.size() ; c++ )
+    {
+        if( !testCondition(m_Conditions[c],pRecord) )
+            return false;
+    }
+    return true;
+}
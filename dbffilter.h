@@ -0,0 +1,97 @@
+#ifndef DBFFILTER_H
+#define DBFFILTER_H
+
+// Copyright (C) 2012 Ron Ostafichuk
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files
+// (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify,
+// merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR
+// IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+// Predicate pushdown for the scans.  Conditions are given by field name and value as strings, compiled once
+// against the table's field definitions into raw byte / scaled integer form, and then tested directly on the
+// record bytes so rows that do not match are never turned into strings.
+//
+// All conditions must match (AND).  Supported: equality, <>, <, <=, >, >=, ranges, prefix and IN lists on
+// 'C' (and other text types), 'N', 'F', 'I', 'B' and 'L' fields ('L' supports equality, <> and IN only).
+// Text compares ignore trailing spaces / NUL padding like FoxPro does, blank numeric fields never match.
+// 'D' and 'T' fields are compared as day / millisecond numbers (values like 2024-03-01 or 2024-03-01 12:30:00,
+// see dbfdate.h) and 'Y' as exact decimals, all decoded straight from the record bytes.  Blank dates never match,
+// a prefix on a 'D' field compares the stored YYYYMMDD text.
+
+#include "dbf.h"
+
+#define DBF_FILTER_EQ 0
+#define DBF_FILTER_NE 1
+#define DBF_FILTER_LT 2
+#define DBF_FILTER_LE 3
+#define DBF_FILTER_GT 4
+#define DBF_FILTER_GE 5
+#define DBF_FILTER_PREFIX 6
+#define DBF_FILTER_IN 7
+
+class DBFFilter
+{
+public:
+    DBFFilter();
+
+    void addEqual(string sField, string sValue)
+    {
+        addCondition(sField,DBF_FILTER_EQ,sValue);
+    }
+    void addRange(string sField, string sLow, string sHigh) // sLow <= field <= sHigh
+    {
+        addCondition(sField,DBF_FILTER_GE,sLow);
+        addCondition(sField,DBF_FILTER_LE,sHigh);
+    }
+    void addPrefix(string sField, string sPrefix)
+    {
+        addCondition(sField,DBF_FILTER_PREFIX,sPrefix);
+    }
+    void addIn(string sField, const vector<string> &values);
+    void addCondition(string sField, int nOperator, string sValue); // nOperator is one of the DBF_FILTER_ values (not IN)
+    void clear();
+
+    int compile(const DBF &dbf); // resolve the fields and encode the values, must be called before matches(), returns 0 if ok
+    bool isCompiled() const
+    {
+        return m_bCompiled;
+    }
+    bool matches(const char *pRecord) const; // test a raw record (from loadRecPointer, a cursor or a block)
+    int getNumConditions() const
+    {
+        return (int) m_Conditions.size();
+    }
+
+private:
+    struct Condition
+    {
+        string sField;
+        int nOperator;
+        vector<string> values; // as given by the caller
+
+        // filled in by compile()
+        char cType; // 'C' for all text types, 'D', 'T' and 'Y' are decoded natively
+        int nOffset;
+        int nLength;
+        vector<string> texts; // text values with the trailing padding removed
+        vector<int64> mantissas; // numeric values as exact decimals, value = mantissa/10^scale, dates as day / ms numbers
+        vector<int> scales;
+        vector<double> doubles; // for 'B' fields
+        vector<char> logicals; // 'T', 'F' or '?'
+    };
+
+    bool testCondition(const Condition &cond, const char *pRecord) const;
+
+    vector<Condition> m_Conditions;
+    bool m_bCompiled;
+};
+
+#endif // DBFFILTER_H
@@ -0,0 +1,65 @@
+#include "dbf.h"
+#include "dbfcsv.h"
+
+#include <chrono>
+
+using namespace std;
+
+// command line CSV to DBF loader, see dbfImportCSV in dbfcsv.h
+
+static void usage()
+{
+    std::cerr << "usage: dbfimport [options] input.csv output.dbf" << std::endl
+              << "  -d <c>        field delimiter (default ,)" << std::endl
+              << "  -noheader     the first line is data, not field names" << std::endl
+              << "  -t <n>        parser threads (default all cores)" << std::endl
+              << "  -f <fields>   schema as NAME:TYPE[:LENGTH[:DECIMALS]],... in column order" << std::endl
+              << "                e.g. ID:I,NAME:C:30,PRICE:N:10:2,ACTIVE:L" << std::endl
+              << "                without it the schema is inferred from the first rows" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    DBFImportOptions options;
+    vector<fieldDefinition> schema;
+    vector<string> files;
+    for( int i = 1 ; i < argc ; i++ )
+    {
+        string sArg = argv[i];
+        if( sArg == "-d" && i + 1 < argc )
+            options.cDelimiter = argv[++i][0];
+        else if( sArg == "-noheader" )
+            options.bHeader = false;
+        else if( sArg == "-t" && i + 1 < argc )
+            options.nThreads = atoi(argv[++i]);
+        else if( sArg == "-f" && i + 1 < argc )
+        {
+            if( dbfParseSchema(argv[++i],schema) != 0 )
+                return 1;
+        }
+        else if( !sArg.empty() && sArg[0] == '-' )
+        {
+            usage();
+            return 1;
+        }
+        else
+            files.push_back(sArg);
+    }
+    if( files.size() != 2 )
+    {
+        usage();
+        return 1;
+    }
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    int64 nRows = 0;
+    int nRet = dbfImportCSV(files[0],files[1],schema,options,&nRows);
+    double dSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    if( nRet != 0 )
+    {
+        std::cerr << "Import of " << files[0] << " failed" << std::endl;
+        return 1;
+    }
+    std::cout << "Imported " << nRows << " rows into " << files[1] << " in " << dSeconds << " s" << std::endl;
+    return 0;
+}
@@ -0,0 +1,860 @@
+#include "dbfindex.h"
+#include "dbfnumeric.h"
+#include "dbfdate.h"
+
+#include <algorithm>
+
+// Copyright (C) 2012 Ron Ostafichuk
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files
+// (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify,
+// merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR
+// IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+// node page layout: byte 0 = type, bytes 2-3 = number of entries, bytes 4-7 = next leaf (leaf) or first child (internal)
+// leaf entries follow as key+recno, internal pages have (separator entry, child page) pairs.
+// The separator before a child is the smallest entry found in that child.
+#define PAGE_LEAF 1
+#define PAGE_INTERNAL 2
+#define PAGE_HEADER_SIZE 8
+
+static inline int getPageCount(const char *pPage)
+{
+    unsigned short n;
+    memcpy(&n,pPage + 2,2);
+    return n;
+}
+
+static inline void setPageCount(char *pPage, int nCount)
+{
+    unsigned short n = (unsigned short) nCount;
+    memcpy(pPage + 2,&n,2);
+}
+
+static inline uint32 getPageLink(const char *pPage)
+{
+    uint32 u;
+    memcpy(&u,pPage + 4,4);
+    return u;
+}
+
+static inline void setPageLink(char *pPage, uint32 u)
+{
+    memcpy(pPage + 4,&u,4);
+}
+
+static inline void initPage(char *pPage, int nType)
+{
+    memset(pPage,0,DBF_INDEX_PAGE_SIZE);
+    pPage[0] = (char) nType;
+}
+
+static inline uint32 getChild(const char *pPage, int nChild, int nEntryLength)
+{
+    if( nChild == 0 )
+        return getPageLink(pPage);
+    uint32 u;
+    memcpy(&u,pPage + PAGE_HEADER_SIZE + (nChild-1)*(nEntryLength+4) + nEntryLength,4);
+    return u;
+}
+
+// record numbers are stored big endian so they sort after the key with memcmp
+static inline void putRecordNumber(char *p, int nRecord)
+{
+    uint32 u = (uint32) nRecord;
+    p[0] = (char) (u >> 24);
+    p[1] = (char) (u >> 16);
+    p[2] = (char) (u >> 8);
+    p[3] = (char) u;
+}
+
+static inline int getRecordNumber(const char *p)
+{
+    return (int) (((uint32) (uint8) p[0] << 24) | ((uint32) (uint8) p[1] << 16) | ((uint32) (uint8) p[2] << 8) | (uint32) (uint8) p[3]);
+}
+
+static inline void putBigEndian64(char *p, uint64 u)
+{
+    for( int i = 7 ; i >= 0 ; i-- )
+    {
+        p[i] = (char) u;
+        u >>= 8;
+    }
+}
+
+// doubles with the sign bit flipped (positive) or all bits inverted (negative) sort correctly with memcmp
+static void encodeOrderedDouble(double d, char *pOut)
+{
+    uint64 u;
+    memcpy(&u,&d,8);
+    if( u >> 63 )
+        u = ~u;
+    else
+        u |= 1ULL << 63;
+    putBigEndian64(pOut,u);
+}
+
+// Visual FoxPro 'T' and 'Y' fields hold 8 binary bytes, keyed as ordered integers
+static inline bool isBinaryKey(char cType, int nLength)
+{
+    return (cType == 'T' || cType == 'Y') && nLength == 8;
+}
+
+static void encodeOrderedInt(int64 n, char *pOut)
+{
+    putBigEndian64(pOut,(uint64) n ^ (1ULL << 63));
+}
+
+static char normaliseLogical(char c)
+{
+    if( c == 'T' || c == 't' || c == 'Y' || c == 'y' )
+        return 'T';
+    if( c == 'F' || c == 'f' || c == 'N' || c == 'n' )
+        return 'F';
+    return '?';
+}
+
+// number of entries in the page that compare < pKey (or <= pKey with bOrEqual) over the first nLength bytes
+static int searchEntries(const char *pFirst, int nStride, int nCount, const char *pKey, int nLength, bool bOrEqual)
+{
+    int nLow = 0;
+    int nHigh = nCount;
+    while( nLow < nHigh )
+    {
+        int nMid = (nLow + nHigh)/2;
+        int nCmp = memcmp(pFirst + (size_t) nMid*nStride,pKey,nLength);
+        if( nCmp < 0 || (bOrEqual && nCmp == 0) )
+            nLow = nMid + 1;
+        else
+            nHigh = nMid;
+    }
+    return nLow;
+}
+
+DBFIndexIterator::DBFIndexIterator()
+{
+    m_pIndex = NULL;
+    m_uPage = 0;
+    m_nPos = -1;
+}
+
+int DBFIndexIterator::getRecord() const
+{
+    if( m_nPos < 0 )
+        return -1;
+    int nEntryLength = m_pIndex->entryLength();
+    return getRecordNumber(&m_Page[PAGE_HEADER_SIZE + m_nPos*nEntryLength + nEntryLength - 4]);
+}
+
+const char *DBFIndexIterator::getKey() const
+{
+    if( m_nPos < 0 )
+        return NULL;
+    return &m_Page[PAGE_HEADER_SIZE + m_nPos*m_pIndex->entryLength()];
+}
+
+int DBFIndexIterator::next()
+{
+    if( m_nPos < 0 )
+        return 1;
+    m_nPos++;
+    return skipEmpty();
+}
+
+int DBFIndexIterator::skipEmpty()
+{
+    // move on to the next leaf when past the end of this one, leaves can be empty after deletes
+    while( m_nPos >= getPageCount(&m_Page[0]) )
+    {
+        uint32 uNext = getPageLink(&m_Page[0]);
+        if( uNext == 0 || m_pIndex->readPage(uNext,&m_Page[0]) != 0 )
+        {
+            m_nPos = -1;
+            return 1;
+        }
+        m_uPage = uNext;
+        m_nPos = 0;
+    }
+    return 0;
+}
+
+DBFIndex::DBFIndex()
+{
+    m_pFileHandle = NULL;
+    memset(&m_Header,0,sizeof(m_Header));
+}
+
+DBFIndex::~DBFIndex()
+{
+    if( m_pFileHandle != NULL )
+        close();
+}
+
+int DBFIndex::leafCapacity() const
+{
+    return (DBF_INDEX_PAGE_SIZE - PAGE_HEADER_SIZE)/entryLength();
+}
+
+int DBFIndex::internalCapacity() const
+{
+    return (DBF_INDEX_PAGE_SIZE - PAGE_HEADER_SIZE)/(entryLength() + 4);
+}
+
+int DBFIndex::resolveFields(const DBF &dbf)
+{
+    // work out where each key field is in the record and in the key
+    m_Fields.clear();
+    int nKeyOffset = 0;
+    for( uint32 i = 0 ; i < m_Header.uNumFields ; i++ )
+    {
+        char cName[12];
+        memcpy(cName,m_Header.cFieldNames[i],11);
+        cName[11] = 0;
+        int nField = dbf.getFieldIndex(cName);
+        if( nField < 0 )
+        {
+            std::cerr << __FUNCTION__ << " Index field " << cName << " is not in the table" << std::endl;
+            return 1;
+        }
+        const fieldDefinition &fd = dbf.getFieldDefinition(nField);
+
+        KeyField kf;
+        kf.nOffset = fd.uFieldOffset;
+        kf.nLength = fd.uLength;
+        kf.cType = fd.cFieldType;
+        kf.nKeyOffset = nKeyOffset;
+        if( kf.cType == 'I' || kf.cType == 'B' || kf.cType == 'N' || kf.cType == 'F' || isBinaryKey(kf.cType,kf.nLength) )
+            kf.nKeyLength = 8;
+        else if( kf.cType == 'L' )
+            kf.nKeyLength = 1;
+        else
+            kf.nKeyLength = kf.nLength;
+        nKeyOffset += kf.nKeyLength;
+        m_Fields.push_back(kf);
+    }
+
+    if( m_Header.uKeyLength != 0 && (int) m_Header.uKeyLength != nKeyOffset )
+    {
+        std::cerr << __FUNCTION__ << " Index key length " << m_Header.uKeyLength << " does not match the table fields " << nKeyOffset << std::endl;
+        return 1;
+    }
+    m_Header.uKeyLength = nKeyOffset;
+    // a page must hold at least 4 entries for the splits to work
+    if( internalCapacity() < 4 )
+    {
+        std::cerr << __FUNCTION__ << " Index key is too long, " << nKeyOffset << " bytes" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+void DBFIndex::encodeKey(const char *pRecord, char *pKey) const
+{
+    for( size_t i = 0 ; i < m_Fields.size() ; i++ )
+    {
+        const KeyField &kf = m_Fields[i];
+        const char *pField = pRecord + kf.nOffset;
+        char *pOut = pKey + kf.nKeyOffset;
+        if( kf.cType == 'I' )
+        {
+            uint64 u = 0;
+            int nLength = min(kf.nLength,8);
+            for( int b = 0 ; b < nLength ; b++ )
+                u |= ((uint64) (uint8) pField[b]) << (b*8);
+            if( nLength > 0 && nLength < 8 && (pField[nLength-1] & 0x80) )
+                u |= ~(uint64) 0 << (nLength*8);
+            encodeOrderedInt((int64) u,pOut);
+        }
+        else if( isBinaryKey(kf.cType,kf.nLength) )
+        {
+            // 'T' as milliseconds since 1970, 'Y' as value*10^4, both little endian on disk
+            int64 n;
+            if( kf.cType == 'Y' )
+            {
+                dbfDecodeCurrency(pField,kf.nLength,&n);
+                encodeOrderedInt(n,pOut);
+            }
+            else if( dbfDecodeDateTime(pField,kf.nLength,&n) == DBF_NUM_OK )
+                encodeOrderedInt(n,pOut);
+            else
+                memset(pOut,0,8); // blank sorts before every date
+        }
+        else if( kf.cType == 'B' )
+        {
+            double d = 0;
+            if( kf.nLength == 8 )
+                memcpy(&d,pField,8);
+            else if( kf.nLength == 4 )
+            {
+                float f;
+                memcpy(&f,pField,4);
+                d = f;
+            }
+            encodeOrderedDouble(d,pOut);
+        }
+        else if( kf.cType == 'N' || kf.cType == 'F' )
+        {
+            double d;
+            if( dbfNumericToDouble(pField,kf.nLength,&d) == DBF_NUM_OK )
+                encodeOrderedDouble(d,pOut);
+            else
+                memset(pOut,0,8); // blank sorts before every number
+        }
+        else if( kf.cType == 'L' )
+            pOut[0] = normaliseLogical(pField[0]);
+        else
+        {
+            // text, NUL padding (appendRecord) and space padding (FoxPro) must give the same key
+            for( int b = 0 ; b < kf.nLength ; b++ )
+                pOut[b] = pField[b] == 0 ? ' ' : pField[b];
+        }
+    }
+}
+
+int DBFIndex::encodeValues(const vector<string> &keyValues, char *pKey) const
+{
+    int nLength = 0;
+    for( size_t i = 0 ; i < m_Fields.size() && i < keyValues.size() ; i++ )
+    {
+        const KeyField &kf = m_Fields[i];
+        const string &sValue = keyValues[i];
+        char *pOut = pKey + kf.nKeyOffset;
+        if( kf.cType == 'I' )
+        {
+            int64 n = 0;
+            dbfNumericToInt64(sValue.data(),(int) sValue.size(),&n);
+            encodeOrderedInt(n,pOut);
+        }
+        else if( isBinaryKey(kf.cType,kf.nLength) )
+        {
+            int64 n;
+            int nRes = kf.cType == 'Y' ? dbfNumericToScaled(sValue.data(),(int) sValue.size(),DBF_CURRENCY_SCALE,&n)
+                                       : dbfParseDateTime(sValue.data(),(int) sValue.size(),&n);
+            if( nRes == DBF_NUM_OK )
+                encodeOrderedInt(n,pOut);
+            else
+                memset(pOut,0,8);
+        }
+        else if( kf.cType == 'D' )
+        {
+            // stored as YYYYMMDD, also look up 2024-03-01
+            int64 nDays;
+            char buffer[16];
+            if( kf.nLength == 8 && dbfParseDate(sValue.data(),(int) sValue.size(),&nDays) == DBF_NUM_OK && dbfFormatDate(nDays,buffer) == 8 )
+                memcpy(pOut,buffer,8);
+            else
+            {
+                for( int b = 0 ; b < kf.nLength ; b++ )
+                    pOut[b] = (b < (int) sValue.size() && sValue[b] != 0) ? sValue[b] : ' ';
+            }
+        }
+        else if( kf.cType == 'B' || kf.cType == 'N' || kf.cType == 'F' )
+        {
+            double d;
+            if( dbfNumericToDouble(sValue.data(),(int) sValue.size(),&d) == DBF_NUM_OK )
+                encodeOrderedDouble(d,pOut);
+            else
+                memset(pOut,0,8);
+        }
+        else if( kf.cType == 'L' )
+            pOut[0] = sValue.empty() ? '?' : normaliseLogical(sValue[0]);
+        else
+        {
+            for( int b = 0 ; b < kf.nLength ; b++ )
+                pOut[b] = (b < (int) sValue.size() && sValue[b] != 0) ? sValue[b] : ' ';
+        }
+        nLength = kf.nKeyOffset + kf.nKeyLength;
+    }
+    return nLength;
+}
+
+int DBFIndex::readPage(uint32 uPage, char *pPage)
+{
+    if( dbfSeekFile(m_pFileHandle,(int64) uPage*DBF_INDEX_PAGE_SIZE) != 0 )
+        return 1;
+    if( fread(pPage,1,DBF_INDEX_PAGE_SIZE,m_pFileHandle) != DBF_INDEX_PAGE_SIZE )
+    {
+        std::cerr << __FUNCTION__ << " Failed to read index page " << uPage << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+int DBFIndex::writePage(uint32 uPage, const char *pPage)
+{
+    if( dbfSeekFile(m_pFileHandle,(int64) uPage*DBF_INDEX_PAGE_SIZE) != 0 )
+        return 1;
+    if( fwrite(pPage,1,DBF_INDEX_PAGE_SIZE,m_pFileHandle) != DBF_INDEX_PAGE_SIZE )
+    {
+        std::cerr << __FUNCTION__ << " Failed to write index page " << uPage << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+int DBFIndex::writeHeader()
+{
+    char page[DBF_INDEX_PAGE_SIZE];
+    memset(page,0,sizeof(page));
+    memcpy(page,&m_Header,sizeof(m_Header));
+    return writePage(0,page);
+}
+
+uint32 DBFIndex::allocatePage()
+{
+    return m_Header.uPageCount++;
+}
+
+int DBFIndex::create(string sIndexFile, DBF &dbf, const vector<string> &fieldNames)
+{
+    if( m_pFileHandle != NULL )
+        close();
+    if( fieldNames.empty() || fieldNames.size() > DBF_INDEX_MAX_FIELDS )
+    {
+        std::cerr << __FUNCTION__ << " An index needs 1 to " << DBF_INDEX_MAX_FIELDS << " key fields" << std::endl;
+        return 1;
+    }
+
+    memset(&m_Header,0,sizeof(m_Header));
+    memcpy(m_Header.cMagic,DBF_INDEX_MAGIC,8);
+    m_Header.uPageSize = DBF_INDEX_PAGE_SIZE;
+    m_Header.uNumFields = (uint32) fieldNames.size();
+    for( size_t i = 0 ; i < fieldNames.size() ; i++ )
+    {
+        int nField = dbf.getFieldIndex(fieldNames[i]);
+        if( nField < 0 )
+        {
+            std::cerr << __FUNCTION__ << " Unknown field " << fieldNames[i] << std::endl;
+            return 1;
+        }
+        const fieldDefinition &fd = dbf.getFieldDefinition(nField);
+        memcpy(m_Header.cFieldNames[i],fd.cFieldName,11);
+        m_Header.cFieldTypes[i] = fd.cFieldType;
+        m_Header.uFieldLengths[i] = fd.uLength;
+    }
+    if( resolveFields(dbf) != 0 )
+        return 1;
+
+    m_pFileHandle = fopen(sIndexFile.c_str(),"wb+");
+    if( m_pFileHandle == NULL )
+    {
+        std::cerr << __FUNCTION__ << " Unable to create index file " << sIndexFile << std::endl;
+        return errno;
+    }
+    m_sFileName = sIndexFile;
+    return buildFromTable(dbf);
+}
+
+int DBFIndex::open(string sIndexFile, const DBF &dbf)
+{
+    if( m_pFileHandle != NULL )
+        close();
+    m_pFileHandle = fopen(sIndexFile.c_str(),"rb+");
+    if( m_pFileHandle == NULL )
+    {
+        std::cerr << __FUNCTION__ << " Unable to open index file " << sIndexFile << std::endl;
+        return errno;
+    }
+    m_sFileName = sIndexFile;
+
+    char page[DBF_INDEX_PAGE_SIZE];
+    if( readPage(0,page) != 0 )
+    {
+        close();
+        return 1;
+    }
+    memcpy(&m_Header,page,sizeof(m_Header));
+    if( memcmp(m_Header.cMagic,"DBFBTRE1",8) == 0 )
+    {
+        // keys of 'T' and 'Y' fields were encoded as text, lookups in it would find the wrong records
+        std::cerr << __FUNCTION__ << " " << sIndexFile << " was written by an older version, create it again" << std::endl;
+        close();
+        return 1;
+    }
+    if( memcmp(m_Header.cMagic,DBF_INDEX_MAGIC,8) != 0 || m_Header.uPageSize != DBF_INDEX_PAGE_SIZE
+            || m_Header.uNumFields < 1 || m_Header.uNumFields > DBF_INDEX_MAX_FIELDS )
+    {
+        std::cerr << __FUNCTION__ << " " << sIndexFile << " is not an index file" << std::endl;
+        close();
+        return 1;
+    }
+    if( resolveFields(dbf) != 0 )
+    {
+        close();
+        return 1;
+    }
+    for( uint32 i = 0 ; i < m_Header.uNumFields ; i++ )
+    {
+        if( m_Fields[i].cType != m_Header.cFieldTypes[i] || m_Fields[i].nLength != m_Header.uFieldLengths[i] )
+        {
+            std::cerr << __FUNCTION__ << " Index field " << i << " no longer matches the table definition" << std::endl;
+            close();
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int DBFIndex::close()
+{
+    if( m_pFileHandle == NULL )
+        return 0;
+    int nRet = writeHeader(); // entry count is only kept in memory until now
+    if( fclose(m_pFileHandle) != 0 )
+        nRet = 1;
+    m_pFileHandle = NULL;
+    m_sFileName = "";
+    m_Fields.clear();
+    return nRet;
+}
+
+int DBFIndex::rebuild(DBF &dbf)
+{
+    if( m_pFileHandle == NULL )
+        return 1;
+    // start again with an empty file
+    FILE *pFile = freopen(m_sFileName.c_str(),"wb+",m_pFileHandle);
+    if( pFile == NULL )
+    {
+        m_pFileHandle = NULL;
+        std::cerr << __FUNCTION__ << " Unable to truncate index file " << m_sFileName << std::endl;
+        return 1;
+    }
+    m_pFileHandle = pFile;
+    if( resolveFields(dbf) != 0 )
+        return 1;
+    return buildFromTable(dbf);
+}
+
+int DBFIndex::buildFromTable(DBF &dbf)
+{
+    // bulk load: collect and sort every entry, then write full leaves and the internal levels bottom up
+    int nEntryLength = entryLength();
+    vector<char> entries;
+    int64 nCount = 0;
+    int nScan = dbf.scan([&](const char *pRecord,int nRecord)
+    {
+        if( pRecord[0] == DBF_DELETED_RECORD_FLAG )
+            return true; // deleted records are not indexed
+        entries.resize((size_t) (nCount+1)*nEntryLength);
+        char *pEntry = &entries[(size_t) nCount*nEntryLength];
+        encodeKey(pRecord,pEntry);
+        putRecordNumber(pEntry + nEntryLength - 4,nRecord);
+        nCount++;
+        return true;
+    });
+    if( nScan != 0 )
+        return 1;
+
+    vector<uint32> order(nCount);
+    for( int64 i = 0 ; i < nCount ; i++ )
+        order[i] = (uint32) i;
+    const char *pEntries = entries.empty() ? NULL : &entries[0];
+    std::sort(order.begin(),order.end(),[&](uint32 a,uint32 b)
+    {
+        return memcmp(pEntries + (size_t) a*nEntryLength,pEntries + (size_t) b*nEntryLength,nEntryLength) < 0;
+    });
+
+    m_Header.uPageCount = 1; // page 0 is the header
+    m_Header.nEntries = nCount;
+    m_Header.uHeight = 1;
+
+    char page[DBF_INDEX_PAGE_SIZE];
+    int nLeafCapacity = leafCapacity();
+    vector<uint32> levelPages; // pages of the level just written
+    vector<char> levelFirst; // smallest entry of each of those pages
+
+    int64 nDone = 0;
+    do
+    {
+        // the last leaf links to nothing, every other leaf to the page written next
+        initPage(page,PAGE_LEAF);
+        int n = (int) min((int64) nLeafCapacity,nCount - nDone);
+        for( int i = 0 ; i < n ; i++ )
+            memcpy(page + PAGE_HEADER_SIZE + i*nEntryLength,pEntries + (size_t) order[nDone+i]*nEntryLength,nEntryLength);
+        setPageCount(page,n);
+        uint32 uPage = allocatePage();
+        if( nDone + n < nCount )
+            setPageLink(page,uPage + 1);
+        if( writePage(uPage,page) != 0 )
+            return 1;
+        levelPages.push_back(uPage);
+        levelFirst.insert(levelFirst.end(),page + PAGE_HEADER_SIZE,page + PAGE_HEADER_SIZE + nEntryLength);
+        nDone += n;
+    } while( nDone < nCount );
+
+    int nInternalCapacity = internalCapacity();
+    while( levelPages.size() > 1 )
+    {
+        vector<uint32> upperPages;
+        vector<char> upperFirst;
+        size_t nChild = 0;
+        while( nChild < levelPages.size() )
+        {
+            initPage(page,PAGE_INTERNAL);
+            size_t nChildren = min((size_t) nInternalCapacity + 1,levelPages.size() - nChild);
+            if( levelPages.size() - nChild - nChildren == 1 )
+                nChildren--; // do not leave a single child for the last page
+            setPageLink(page,levelPages[nChild]);
+            for( size_t i = 1 ; i < nChildren ; i++ )
+            {
+                char *pSlot = page + PAGE_HEADER_SIZE + (i-1)*(nEntryLength+4);
+                memcpy(pSlot,&levelFirst[(nChild+i)*nEntryLength],nEntryLength);
+                memcpy(pSlot + nEntryLength,&levelPages[nChild+i],4);
+            }
+            setPageCount(page,(int) nChildren - 1);
+            uint32 uPage = allocatePage();
+            if( writePage(uPage,page) != 0 )
+                return 1;
+            upperPages.push_back(uPage);
+            upperFirst.insert(upperFirst.end(),&levelFirst[nChild*nEntryLength],&levelFirst[nChild*nEntryLength] + nEntryLength);
+            nChild += nChildren;
+        }
+        levelPages.swap(upperPages);
+        levelFirst.swap(upperFirst);
+        m_Header.uHeight++;
+    }
+    m_Header.uRootPage = levelPages[0];
+    if( writeHeader() != 0 )
+        return 1;
+    fflush(m_pFileHandle);
+    return 0;
+}
+
+uint32 DBFIndex::descend(const char *pEntry, int nCompareLength, bool bLowerBound, vector<uint32> *pPath, vector<int> *pChildIndex)
+{
+    // walk from the root to the leaf that holds pEntry. Full entries go right on an equal separator,
+    // a lower bound on a partial key goes left so the first match is not missed
+    int nEntryLength = entryLength();
+    char page[DBF_INDEX_PAGE_SIZE];
+    uint32 uPage = m_Header.uRootPage;
+    for( uint32 nLevel = 1 ; nLevel < m_Header.uHeight ; nLevel++ )
+    {
+        if( readPage(uPage,page) != 0 )
+            return 0;
+        int nChild = searchEntries(page + PAGE_HEADER_SIZE,nEntryLength + 4,getPageCount(page),pEntry,nCompareLength,!bLowerBound);
+        if( pPath != NULL )
+        {
+            pPath->push_back(uPage);
+            pChildIndex->push_back(nChild);
+        }
+        uPage = getChild(page,nChild,nEntryLength);
+    }
+    return uPage;
+}
+
+int DBFIndex::insertEntry(const char *pEntry)
+{
+    int nEntryLength = entryLength();
+    vector<uint32> path;
+    vector<int> childIndex;
+    uint32 uLeaf = descend(pEntry,nEntryLength,false,&path,&childIndex);
+    if( uLeaf == 0 )
+        return 1;
+
+    // room for one extra entry while splitting
+    vector<char> buffer(DBF_INDEX_PAGE_SIZE + nEntryLength + 4);
+    char *pPage = &buffer[0];
+    if( readPage(uLeaf,pPage) != 0 )
+        return 1;
+
+    int nCount = getPageCount(pPage);
+    char *pEntries = pPage + PAGE_HEADER_SIZE;
+    int nPos = searchEntries(pEntries,nEntryLength,nCount,pEntry,nEntryLength,false);
+    if( nPos < nCount && memcmp(pEntries + nPos*nEntryLength,pEntry,nEntryLength) == 0 )
+        return 0; // already indexed
+    memmove(pEntries + (nPos+1)*nEntryLength,pEntries + nPos*nEntryLength,(nCount - nPos)*nEntryLength);
+    memcpy(pEntries + nPos*nEntryLength,pEntry,nEntryLength);
+    nCount++;
+    m_Header.nEntries++;
+
+    if( nCount <= leafCapacity() )
+    {
+        setPageCount(pPage,nCount);
+        return writePage(uLeaf,pPage);
+    }
+
+    // split the leaf, upper half goes to a new page linked after it
+    char right[DBF_INDEX_PAGE_SIZE];
+    initPage(right,PAGE_LEAF);
+    int nLeft = nCount/2;
+    memcpy(right + PAGE_HEADER_SIZE,pEntries + nLeft*nEntryLength,(nCount - nLeft)*nEntryLength);
+    setPageCount(right,nCount - nLeft);
+    setPageLink(right,getPageLink(pPage));
+    uint32 uRight = allocatePage();
+    setPageCount(pPage,nLeft);
+    setPageLink(pPage,uRight);
+    if( writePage(uRight,right) != 0 || writePage(uLeaf,pPage) != 0 )
+        return 1;
+
+    vector<char> separator(right + PAGE_HEADER_SIZE,right + PAGE_HEADER_SIZE + nEntryLength);
+    uint32 uLeft = uLeaf;
+    int nSlot = nEntryLength + 4;
+    int nInternalCapacity = internalCapacity();
+
+    // push the separator up until a parent has room
+    while( true )
+    {
+        if( path.empty() )
+        {
+            // the root split, the tree grows one level
+            initPage(pPage,PAGE_INTERNAL);
+            setPageLink(pPage,uLeft);
+            memcpy(pPage + PAGE_HEADER_SIZE,&separator[0],nEntryLength);
+            memcpy(pPage + PAGE_HEADER_SIZE + nEntryLength,&uRight,4);
+            setPageCount(pPage,1);
+            uint32 uRoot = allocatePage();
+            if( writePage(uRoot,pPage) != 0 )
+                return 1;
+            m_Header.uRootPage = uRoot;
+            m_Header.uHeight++;
+            break;
+        }
+
+        uint32 uParent = path.back();
+        int nChild = childIndex.back();
+        path.pop_back();
+        childIndex.pop_back();
+        if( readPage(uParent,pPage) != 0 )
+            return 1;
+
+        // the new child goes right after the one that split, its separator is in slot nChild
+        nCount = getPageCount(pPage);
+        char *pSlots = pPage + PAGE_HEADER_SIZE;
+        memmove(pSlots + (nChild+1)*nSlot,pSlots + nChild*nSlot,(nCount - nChild)*nSlot);
+        memcpy(pSlots + nChild*nSlot,&separator[0],nEntryLength);
+        memcpy(pSlots + nChild*nSlot + nEntryLength,&uRight,4);
+        nCount++;
+
+        if( nCount <= nInternalCapacity )
+        {
+            setPageCount(pPage,nCount);
+            if( writePage(uParent,pPage) != 0 )
+                return 1;
+            break;
+        }
+
+        // split the internal page, the middle separator moves up
+        int nMid = nCount/2;
+        initPage(right,PAGE_INTERNAL);
+        uint32 uFirstRightChild;
+        memcpy(&uFirstRightChild,pSlots + nMid*nSlot + nEntryLength,4);
+        setPageLink(right,uFirstRightChild);
+        memcpy(right + PAGE_HEADER_SIZE,pSlots + (nMid+1)*nSlot,(nCount - nMid - 1)*nSlot);
+        setPageCount(right,nCount - nMid - 1);
+        separator.assign(pSlots + nMid*nSlot,pSlots + nMid*nSlot + nEntryLength);
+        setPageCount(pPage,nMid);
+
+        uRight = allocatePage();
+        if( writePage(uRight,right) != 0 || writePage(uParent,pPage) != 0 )
+            return 1;
+        uLeft = uParent;
+    }
+    return writeHeader();
+}
+
+int DBFIndex::insert(const char *pRecord, int nRecord)
+{
+    if( m_pFileHandle == NULL )
+        return 1;
+    vector<char> entry(entryLength());
+    encodeKey(pRecord,&entry[0]);
+    putRecordNumber(&entry[entry.size() - 4],nRecord);
+    return insertEntry(&entry[0]);
+}
+
+int DBFIndex::remove(const char *pRecord, int nRecord)
+{
+    // remove the entry from its leaf, pages are not merged
+    if( m_pFileHandle == NULL )
+        return 1;
+    int nEntryLength = entryLength();
+    vector<char> entry(nEntryLength);
+    encodeKey(pRecord,&entry[0]);
+    putRecordNumber(&entry[nEntryLength - 4],nRecord);
+
+    uint32 uLeaf = descend(&entry[0],nEntryLength,false,NULL,NULL);
+    char page[DBF_INDEX_PAGE_SIZE];
+    if( uLeaf == 0 || readPage(uLeaf,page) != 0 )
+        return 1;
+    int nCount = getPageCount(page);
+    char *pEntries = page + PAGE_HEADER_SIZE;
+    int nPos = searchEntries(pEntries,nEntryLength,nCount,&entry[0],nEntryLength,false);
+    if( nPos >= nCount || memcmp(pEntries + nPos*nEntryLength,&entry[0],nEntryLength) != 0 )
+        return 0; // was not indexed
+    memmove(pEntries + nPos*nEntryLength,pEntries + (nPos+1)*nEntryLength,(nCount - nPos - 1)*nEntryLength);
+    setPageCount(page,nCount - 1);
+    m_Header.nEntries--;
+    return writePage(uLeaf,page);
+}
+
+int DBFIndex::lowerBound(const char *pKey, int nKeyLength, DBFIndexIterator &it)
+{
+    it.m_pIndex = this;
+    it.m_nPos = -1;
+    if( m_pFileHandle == NULL )
+        return 1;
+    uint32 uLeaf = descend(pKey,nKeyLength,true,NULL,NULL);
+    it.m_Page.resize(DBF_INDEX_PAGE_SIZE);
+    if( uLeaf == 0 || readPage(uLeaf,&it.m_Page[0]) != 0 )
+        return 1;
+    it.m_uPage = uLeaf;
+    int nCount = getPageCount(&it.m_Page[0]);
+    it.m_nPos = searchEntries(&it.m_Page[PAGE_HEADER_SIZE],entryLength(),nCount,pKey,nKeyLength,false);
+    // the match can be at the start of a following leaf
+    return it.skipEmpty();
+}
+
+int DBFIndex::first(DBFIndexIterator &it)
+{
+    return lowerBound("",0,it);
+}
+
+int DBFIndex::seek(const vector<string> &keyValues, DBFIndexIterator &it)
+{
+    vector<char> key(m_Header.uKeyLength + 1);
+    int nLength = encodeValues(keyValues,&key[0]);
+    return lowerBound(&key[0],nLength,it);
+}
+
+int DBFIndex::find(const vector<string> &keyValues, vector<int> &records)
+{
+    records.clear();
+    vector<char> key(m_Header.uKeyLength + 1);
+    int nLength = encodeValues(keyValues,&key[0]);
+    DBFIndexIterator it;
+    lowerBound(&key[0],nLength,it);
+    while( it.isValid() && memcmp(it.getKey(),&key[0],nLength) == 0 )
+    {
+        records.push_back(it.getRecord());
+        it.next();
+    }
+    return 0;
+}
+
+int DBFIndex::scanRange(const vector<string> &lowValues, const vector<string> &highValues, const std::function<bool(int nRecord)> &callback)
+{
+    vector<char> low(m_Header.uKeyLength + 1);
+    vector<char> high(m_Header.uKeyLength + 1);
+    int nLowLength = encodeValues(lowValues,&low[0]);
+    int nHighLength = encodeValues(highValues,&high[0]);
+
+    DBFIndexIterator it;
+    lowerBound(&low[0],nLowLength,it);
+    while( it.isValid() )
+    {
+        if( nHighLength > 0 && memcmp(it.getKey(),&high[0],nHighLength) > 0 )
+            break;
+        if( !callback(it.getRecord()) )
+            break;
+        it.next();
+    }
+    return 0;
+}
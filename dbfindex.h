@@ -0,0 +1,151 @@
+#ifndef DBFINDEX_H
+#define DBFINDEX_H
+
+// Copyright (C) 2012 Ron Ostafichuk
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files
+// (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify,
+// merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR
+// IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+// Sidecar B+tree index file, maps the key of one field (or several fields concatenated) to record numbers.
+// This is NOT a FoxPro .cdx, it is this engine's own format so use a different extension (e.g. .bix).
+//
+// Keys are encoded so a plain memcmp sorts them in field order: text as is (padding normalised to spaces),
+// 'I' as big endian with the sign flipped, 'B','N','F' as order preserving doubles, 'L' as T/F/?.
+// Binary 'T' (milliseconds since 1970) and 'Y' (value*10^4) are keyed like 'I', 'D' by its YYYYMMDD text.
+// Every entry is key+record number, so duplicate keys are fine and each entry is unique.
+//
+// The file is made of fixed size pages, page 0 is the header.  Leaves are linked for ordered range scans.
+// Deletes do not merge pages, call rebuild() to get the space back (DBF::pack rebuilds the attached indexes).
+
+#include "dbf.h"
+
+#define DBF_INDEX_PAGE_SIZE 4096
+#define DBF_INDEX_MAX_FIELDS 16
+#define DBF_INDEX_MAGIC "DBFBTRE2" // 2: binary 'T' and 'Y' keyed as numbers, "DBFBTRE1" files must be rebuilt
+
+struct indexHeader
+{
+    char cMagic[8]; // DBF_INDEX_MAGIC
+    uint32 uPageSize;
+    uint32 uKeyLength; // bytes of encoded key, the record number adds 4 more
+    uint32 uRootPage;
+    uint32 uPageCount;
+    uint32 uHeight; // 1 when the root is a leaf
+    uint32 uNumFields;
+    int64 nEntries;
+    char cFieldNames[DBF_INDEX_MAX_FIELDS][11];
+    char cFieldTypes[DBF_INDEX_MAX_FIELDS];
+    uint8 uFieldLengths[DBF_INDEX_MAX_FIELDS];
+};
+
+class DBFIndex;
+
+// position in the leaf level of an index, walks the entries in key order
+class DBFIndexIterator
+{
+public:
+    DBFIndexIterator();
+
+    bool isValid() const
+    {
+        return m_nPos >= 0;
+    }
+    int getRecord() const; // record number of the current entry
+    const char *getKey() const; // encoded key of the current entry, getKeyLength() bytes
+    int next(); // move to the next entry, returns 0 if there is one
+
+private:
+    friend class DBFIndex;
+    int skipEmpty();
+
+    DBFIndex *m_pIndex;
+    vector<char> m_Page; // current leaf
+    uint32 m_uPage;
+    int m_nPos; // -1 when past the end
+};
+
+class DBFIndex
+{
+public:
+    DBFIndex();
+    ~DBFIndex();
+
+    int create(string sIndexFile, DBF &dbf, const vector<string> &fieldNames); // build a new index from the live records
+    int open(string sIndexFile, const DBF &dbf); // open an existing index, checks it still matches the table
+    int close();
+    int rebuild(DBF &dbf); // throw away all entries and build again from the table (used after pack)
+
+    // maintenance, DBF calls these for attached indexes (see DBF::attachIndex)
+    int insert(const char *pRecord, int nRecord);
+    int remove(const char *pRecord, int nRecord);
+
+    // lookups, values are given per key field as strings, fewer values than fields match on the leading fields
+    int find(const vector<string> &keyValues, vector<int> &records); // all records with this key
+    int seek(const vector<string> &keyValues, DBFIndexIterator &it); // first entry with key >= keyValues
+    int first(DBFIndexIterator &it); // first entry of the index
+    int scanRange(const vector<string> &lowValues, const vector<string> &highValues, const std::function<bool(int nRecord)> &callback); // low <= key <= high, empty means unbounded
+
+    int getKeyLength() const
+    {
+        return m_Header.uKeyLength;
+    }
+    int64 getNumEntries() const
+    {
+        return m_Header.nEntries;
+    }
+    bool isOpen() const
+    {
+        return m_pFileHandle != NULL;
+    }
+    string getFileName() const
+    {
+        return m_sFileName;
+    }
+
+    void encodeKey(const char *pRecord, char *pKey) const; // build the key of a raw record
+    int encodeValues(const vector<string> &keyValues, char *pKey) const; // build a (partial) key from strings, returns its length
+
+private:
+    friend class DBFIndexIterator;
+
+    struct KeyField
+    {
+        int nOffset; // in the record
+        int nLength; // in the record
+        int nKeyOffset;
+        int nKeyLength;
+        char cType;
+    };
+
+    int resolveFields(const DBF &dbf);
+    int buildFromTable(DBF &dbf);
+    int readPage(uint32 uPage, char *pPage);
+    int writePage(uint32 uPage, const char *pPage);
+    int writeHeader();
+    uint32 allocatePage();
+    int entryLength() const
+    {
+        return m_Header.uKeyLength + 4;
+    }
+    int leafCapacity() const;
+    int internalCapacity() const;
+    uint32 descend(const char *pEntry, int nCompareLength, bool bLowerBound, vector<uint32> *pPath, vector<int> *pChildIndex);
+    int insertEntry(const char *pEntry);
+    int lowerBound(const char *pKey, int nKeyLength, DBFIndexIterator &it);
+
+    FILE *m_pFileHandle;
+    string m_sFileName;
+    indexHeader m_Header;
+    vector<KeyField> m_Fields;
+};
+
+#endif // DBFINDEX_H
@@ -0,0 +1,379 @@
+#include "dbfmemo.h"
+
+#include <algorithm>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <io.h>
+#endif
+
+// Copyright (C) 2012 Ron Ostafichuk
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files
+// (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify,
+// merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR
+// IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#define FPT_HEADER_SIZE 512
+
+static inline uint32 readBigEndian32(const char *p)
+{
+    const uint8 *u = (const uint8 *) p;
+    return ((uint32) u[0] << 24) | ((uint32) u[1] << 16) | ((uint32) u[2] << 8) | u[3];
+}
+
+static inline void writeBigEndian32(char *p, uint32 u)
+{
+    p[0] = (char) (u >> 24);
+    p[1] = (char) (u >> 16);
+    p[2] = (char) (u >> 8);
+    p[3] = (char) u;
+}
+
+static inline uint32 readLittleEndian32(const char *p)
+{
+    const uint8 *u = (const uint8 *) p;
+    return ((uint32) u[3] << 24) | ((uint32) u[2] << 16) | ((uint32) u[1] << 8) | u[0];
+}
+
+DBFMemo::DBFMemo()
+{
+    m_pFileHandle = NULL;
+    m_nFormat = DBF_MEMO_FPT;
+    m_bAllowWrite = false;
+    m_uBlockSize = DBF_MEMO_BLOCK_SIZE;
+    m_uNextBlock = 0;
+    m_nFileSize = 0;
+    m_pMapping = NULL;
+    m_nMapSize = 0;
+}
+
+DBFMemo::~DBFMemo()
+{
+    close();
+}
+
+int DBFMemo::open(string sMemoFile, bool bAllowWrite, int nFormat)
+{
+    if( m_pFileHandle != NULL )
+        close();
+    if( nFormat != DBF_MEMO_FPT )
+        bAllowWrite = false; // only .fpt files can be written
+    m_pFileHandle = fopen(sMemoFile.c_str(),bAllowWrite ? "rb+" : "rb");
+    if( m_pFileHandle == NULL )
+    {
+        std::cerr << __FUNCTION__ << " Unable to open memo file " << sMemoFile << std::endl;
+        return errno;
+    }
+    m_sFileName = sMemoFile;
+    m_nFormat = nFormat;
+    m_bAllowWrite = bAllowWrite;
+
+    m_nFileSize = dbfFileSize(m_pFileHandle);
+    char header[32];
+    if( m_nFileSize < (int64) sizeof(header) || readAt(header,sizeof(header),0) != 0 )
+    {
+        std::cerr << __FUNCTION__ << " " << sMemoFile << " is too short for a memo file" << std::endl;
+        close();
+        return 1;
+    }
+    if( nFormat == DBF_MEMO_FPT )
+    {
+        m_uNextBlock = readBigEndian32(header);
+        m_uBlockSize = ((uint8) header[6] << 8) | (uint8) header[7];
+    } else
+    {
+        m_uNextBlock = readLittleEndian32(header);
+        m_uBlockSize = 512;
+        if( nFormat == DBF_MEMO_DBT4 )
+        {
+            uint32 uSize = (uint8) header[20] | ((uint8) header[21] << 8);
+            if( uSize != 0 )
+                m_uBlockSize = uSize;
+        }
+    }
+    if( m_uBlockSize == 0 )
+    {
+        std::cerr << __FUNCTION__ << " " << sMemoFile << " has no block size" << std::endl;
+        close();
+        return 1;
+    }
+    if( m_bAllowWrite )
+    {
+        // new blobs go after everything in the file, even if the header is behind
+        uint32 uEnd = (uint32) ((m_nFileSize + m_uBlockSize - 1)/m_uBlockSize);
+        uint32 uFirst = (FPT_HEADER_SIZE + m_uBlockSize - 1)/m_uBlockSize;
+        m_uNextBlock = max(m_uNextBlock,max(uEnd,uFirst));
+        m_nFileSize = (int64) m_uNextBlock*m_uBlockSize;
+    }
+    mapFile(); // optional, read() falls back to pread
+    return 0;
+}
+
+int DBFMemo::create(string sMemoFile, int nBlockSize)
+{
+    if( m_pFileHandle != NULL )
+        close();
+    if( nBlockSize < 1 || nBlockSize > 65535 )
+    {
+        std::cerr << __FUNCTION__ << " invalid memo block size " << nBlockSize << std::endl;
+        return 1;
+    }
+    m_pFileHandle = fopen(sMemoFile.c_str(),"wb+");
+    if( m_pFileHandle == NULL )
+    {
+        std::cerr << __FUNCTION__ << " Unable to create memo file " << sMemoFile << std::endl;
+        return errno;
+    }
+    m_sFileName = sMemoFile;
+    m_nFormat = DBF_MEMO_FPT;
+    m_bAllowWrite = true;
+    m_uBlockSize = nBlockSize;
+    m_uNextBlock = (FPT_HEADER_SIZE + m_uBlockSize - 1)/m_uBlockSize; // the header fills the first blocks
+    m_nFileSize = (int64) m_uNextBlock*m_uBlockSize;
+
+    vector<char> header(m_nFileSize,0);
+    writeBigEndian32(&header[0],m_uNextBlock);
+    header[6] = (char) (m_uBlockSize >> 8);
+    header[7] = (char) m_uBlockSize;
+    if( fwrite(&header[0],1,header.size(),m_pFileHandle) != header.size() || fflush(m_pFileHandle) != 0 )
+    {
+        std::cerr << __FUNCTION__ << " Failed to write memo header" << std::endl;
+        close();
+        return 1;
+    }
+    return 0;
+}
+
+int DBFMemo::close()
+{
+    if( m_pFileHandle == NULL )
+        return 0;
+    int nRet = flush();
+    unmapFile();
+    if( fclose(m_pFileHandle) != 0 )
+        nRet = 1;
+    m_pFileHandle = NULL;
+    m_sFileName = "";
+    vector<char>().swap(m_Staged);
+    return nRet;
+}
+
+int DBFMemo::readAt(void *pBuffer, size_t nBytes, int64 nPos) const
+{
+#ifndef _WIN32
+    int fd = fileno(m_pFileHandle);
+    size_t nDone = 0;
+    while( nDone < nBytes )
+    {
+        ssize_t n = pread(fd,(char *) pBuffer + nDone,nBytes - nDone,(off_t) (nPos + nDone));
+        if( n < 0 && errno == EINTR )
+            continue;
+        if( n <= 0 )
+            return 1;
+        nDone += n;
+    }
+    return 0;
+#else
+    if( _fseeki64(m_pFileHandle,nPos,SEEK_SET) != 0 )
+        return 1;
+    return fread(pBuffer,1,nBytes,m_pFileHandle) == nBytes ? 0 : 1;
+#endif
+}
+
+int DBFMemo::mapFile()
+{
+    unmapFile();
+#ifndef _WIN32
+    struct stat st;
+    if( fstat(fileno(m_pFileHandle),&st) != 0 || st.st_size <= 0 )
+        return 1;
+    void *p = mmap(NULL,(size_t) st.st_size,PROT_READ,MAP_SHARED,fileno(m_pFileHandle),0);
+    if( p == MAP_FAILED )
+        return 1;
+    m_pMapping = (char *) p;
+    m_nMapSize = (size_t) st.st_size;
+    return 0;
+#else
+    return 1;
+#endif
+}
+
+void DBFMemo::unmapFile()
+{
+#ifndef _WIN32
+    if( m_pMapping != NULL )
+        munmap(m_pMapping,m_nMapSize);
+#endif
+    m_pMapping = NULL;
+    m_nMapSize = 0;
+}
+
+int DBFMemo::read(uint32 uBlock, string_view &blob, vector<char> &buffer) const
+{
+    blob = string_view();
+    if( m_pFileHandle == NULL )
+        return 1;
+    if( uBlock == 0 )
+        return 0; // no blob
+    int64 nPos = (int64) uBlock*m_uBlockSize;
+
+    // get nBytes at nAt: mapped, staged or read into buffer
+    auto fetch = [&](int64 nAt, size_t nBytes, const char **ppData) -> int
+    {
+        if( nAt >= m_nFileSize - (int64) m_Staged.size() && nAt + (int64) nBytes <= m_nFileSize && !m_Staged.empty() )
+        {
+            *ppData = &m_Staged[nAt - (m_nFileSize - (int64) m_Staged.size())];
+            return 0;
+        }
+        if( m_pMapping != NULL && nAt + (int64) nBytes <= (int64) m_nMapSize )
+        {
+            *ppData = m_pMapping + nAt;
+            return 0;
+        }
+        buffer.resize(max(nBytes,(size_t) 1));
+        if( readAt(&buffer[0],nBytes,nAt) != 0 )
+            return 1;
+        *ppData = &buffer[0];
+        return 0;
+    };
+
+    const char *pData;
+    if( m_nFormat == DBF_MEMO_DBT3 )
+    {
+        // no length, the text runs up to the 0x1A terminator
+        if( m_pMapping != NULL && nPos < (int64) m_nMapSize )
+        {
+            const char *pEnd = (const char *) memchr(m_pMapping + nPos,0x1A,m_nMapSize - nPos);
+            size_t nLen = pEnd != NULL ? pEnd - (m_pMapping + nPos) : m_nMapSize - nPos;
+            blob = string_view(m_pMapping + nPos,nLen);
+            return 0;
+        }
+        buffer.clear();
+        vector<char> block(m_uBlockSize);
+        for( int64 nAt = nPos ; ; nAt += m_uBlockSize )
+        {
+            size_t nBytes = (size_t) min((int64) m_uBlockSize,m_nFileSize - nAt);
+            if( nAt >= m_nFileSize || readAt(&block[0],nBytes,nAt) != 0 )
+                break;
+            const char *pEnd = (const char *) memchr(&block[0],0x1A,nBytes);
+            buffer.insert(buffer.end(),block.begin(),block.begin() + (pEnd != NULL ? pEnd - &block[0] : nBytes));
+            if( pEnd != NULL )
+                break;
+        }
+        blob = string_view(buffer.empty() ? "" : &buffer[0],buffer.size());
+        return 0;
+    }
+
+    if( nPos + 8 > m_nFileSize || fetch(nPos,8,&pData) != 0 )
+    {
+        std::cerr << __FUNCTION__ << " memo block " << uBlock << " is outside of " << m_sFileName << std::endl;
+        return 1;
+    }
+    int64 nLength;
+    if( m_nFormat == DBF_MEMO_FPT )
+        nLength = readBigEndian32(pData + 4);
+    else
+    {
+        if( (uint8) pData[0] != 0xFF || (uint8) pData[1] != 0xFF )
+        {
+            std::cerr << __FUNCTION__ << " memo block " << uBlock << " does not start a blob" << std::endl;
+            return 1;
+        }
+        nLength = (int64) readLittleEndian32(pData + 4) - 8; // the length counts the 8 header bytes
+    }
+    if( nLength < 0 || nPos + 8 + nLength > m_nFileSize )
+    {
+        std::cerr << __FUNCTION__ << " memo block " << uBlock << " has a bad length " << nLength << std::endl;
+        return 1;
+    }
+    if( nLength == 0 )
+        return 0;
+    if( fetch(nPos + 8,(size_t) nLength,&pData) != 0 )
+        return 1;
+    blob = string_view(pData,(size_t) nLength);
+    return 0;
+}
+
+uint32 DBFMemo::stage(const char *pData, size_t nLength, uint32 uType)
+{
+    // bulk allocation, blocks are handed out from memory and written together by flush()
+    if( !m_bAllowWrite || m_pFileHandle == NULL || nLength > 0xFFFFFFFFu - 8 )
+        return 0;
+    if( nLength == 0 )
+        return 0; // empty memo, no blob
+    uint32 uBlock = m_uNextBlock;
+    size_t nBlocks = (nLength + 8 + m_uBlockSize - 1)/m_uBlockSize;
+    size_t nStart = m_Staged.size();
+    m_Staged.resize(nStart + nBlocks*m_uBlockSize,0);
+    writeBigEndian32(&m_Staged[nStart],uType);
+    writeBigEndian32(&m_Staged[nStart + 4],(uint32) nLength);
+    memcpy(&m_Staged[nStart + 8],pData,nLength);
+    m_uNextBlock += (uint32) nBlocks;
+    m_nFileSize += nBlocks*m_uBlockSize;
+    return uBlock;
+}
+
+int DBFMemo::flush()
+{
+    if( m_Staged.empty() || m_pFileHandle == NULL )
+        return 0;
+    int64 nPos = m_nFileSize - (int64) m_Staged.size();
+    char next[4];
+    writeBigEndian32(next,m_uNextBlock);
+    if( dbfSeekFile(m_pFileHandle,nPos) != 0 || fwrite(&m_Staged[0],1,m_Staged.size(),m_pFileHandle) != m_Staged.size()
+            || fseek(m_pFileHandle,0,SEEK_SET) != 0 || fwrite(next,1,4,m_pFileHandle) != 4 || fflush(m_pFileHandle) != 0 )
+    {
+        std::cerr << __FUNCTION__ << " Failed to write " << m_Staged.size() << " bytes of memo blobs to " << m_sFileName << std::endl;
+        return 1;
+    }
+    m_Staged.clear();
+    return 0;
+}
+
+int DBFMemo::sync()
+{
+    if( m_pFileHandle == NULL )
+        return 0;
+    if( flush() != 0 )
+        return 1;
+#if defined(_WIN32)
+    return _commit(_fileno(m_pFileHandle)) == 0 ? 0 : 1;
+#else
+    return fsync(fileno(m_pFileHandle)) == 0 ? 0 : 1;
+#endif
+}
+
+int DBFMemo::copyTo(string sFile)
+{
+    if( m_pFileHandle == NULL || flush() != 0 )
+        return 1;
+    FILE *pOut = fopen(sFile.c_str(),"wb");
+    if( pOut == NULL )
+    {
+        std::cerr << __FUNCTION__ << " Unable to create " << sFile << std::endl;
+        return 1;
+    }
+    int64 nSize = dbfFileSize(m_pFileHandle);
+    vector<char> buffer(1 << 20);
+    int nRet = 0;
+    for( int64 nPos = 0 ; nPos < nSize && nRet == 0 ; nPos += buffer.size() )
+    {
+        size_t nBytes = (size_t) min((int64) buffer.size(),nSize - nPos);
+        if( readAt(&buffer[0],nBytes,nPos) != 0 || fwrite(&buffer[0],1,nBytes,pOut) != nBytes )
+            nRet = 1;
+    }
+    if( fclose(pOut) != 0 )
+        nRet = 1;
+    return nRet;
+}
@@ -0,0 +1,95 @@
+#ifndef DBFMEMO_H
+#define DBFMEMO_H
+
+// Copyright (C) 2012 Ron Ostafichuk
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files
+// (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify,
+// merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR
+// IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+// Companion memo file of a table with 'M', 'G' or 'P' fields (uTableFlags 0x02).  The record holds the number of the
+// first block of the blob: 4 bytes little endian in Visual FoxPro tables, 10 ASCII digits in older ones, 0 / blank
+// for no blob.
+//
+// FoxPro .fpt: 512 byte header with the next free block and the block size (both big endian), every blob starts
+// with its type and length (big endian) and fills whole blocks.  dBase .dbt files are read only: dBase III blobs end
+// at 0x1A, dBase IV blobs start with FF FF 08 00 and their length.
+//
+// The file is mapped read only and blobs are returned as views into the mapping, nothing is read until a blob is
+// asked for.  New blobs are staged in memory and written with one write by flush(), which the DBF calls before
+// it writes any record that points at them.
+
+#include "dbf.h"
+
+#define DBF_MEMO_FPT 0
+#define DBF_MEMO_DBT3 1
+#define DBF_MEMO_DBT4 2
+
+#define DBF_MEMO_BLOCK_SIZE 64 // Visual FoxPro default
+#define DBF_MEMO_TYPE_PICTURE 0
+#define DBF_MEMO_TYPE_TEXT 1
+#define DBF_MEMO_TYPE_OBJECT 2
+
+class DBFMemo
+{
+public:
+    DBFMemo();
+    ~DBFMemo();
+
+    int open(string sMemoFile, bool bAllowWrite, int nFormat=DBF_MEMO_FPT);
+    int create(string sMemoFile, int nBlockSize=DBF_MEMO_BLOCK_SIZE); // new empty .fpt
+    int close();
+
+    // the blob that starts at uBlock, a view into the mapping or into buffer when the blob is not mapped (appended
+    // since the file was opened). Thread safe as long as nothing is staged or flushed at the same time
+    int read(uint32 uBlock, string_view &blob, vector<char> &buffer) const;
+
+    // reserve blocks for a new blob and return the first one, the blob is written by the next flush()
+    uint32 stage(const char *pData, size_t nLength, uint32 uType=DBF_MEMO_TYPE_TEXT);
+    int flush(); // write the staged blobs and the new next free block
+    int sync(); // flush() and wait until the file is on the disk
+    int copyTo(string sFile); // flush() and copy the whole file
+
+    bool isOpen() const
+    {
+        return m_pFileHandle != NULL;
+    }
+    int getFormat() const
+    {
+        return m_nFormat;
+    }
+    int getBlockSize() const
+    {
+        return (int) m_uBlockSize;
+    }
+    string getFileName() const
+    {
+        return m_sFileName;
+    }
+
+private:
+    int readAt(void *pBuffer, size_t nBytes, int64 nPos) const;
+    int mapFile();
+    void unmapFile();
+
+    FILE *m_pFileHandle;
+    string m_sFileName;
+    int m_nFormat;
+    bool m_bAllowWrite;
+    uint32 m_uBlockSize;
+    uint32 m_uNextBlock; // next free block, counting the staged blobs
+    int64 m_nFileSize; // bytes written to the file
+    vector<char> m_Staged; // blobs from block m_nFileSize/m_uBlockSize on
+    char *m_pMapping;
+    size_t m_nMapSize;
+};
+
+#endif // DBFMEMO_H
@@ -0,0 +1,276 @@
+#include "dbfnumeric.h"
+
+// Copyright (C) 2012 Ron Ostafichuk
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files
+// (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify,
+// merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR
+// IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define DBF_NUMERIC_SSE2
+#endif
+
+static const int64 s_Pow10[19] = {
+    1LL, 10LL, 100LL, 1000LL, 10000LL, 100000LL, 1000000LL, 10000000LL, 100000000LL, 1000000000LL,
+    10000000000LL, 100000000000LL, 1000000000000LL, 10000000000000LL, 100000000000000LL,
+    1000000000000000LL, 10000000000000000LL, 100000000000000000LL, 1000000000000000000LL
+};
+
+// powers of ten that are exact in a double
+static const double s_dPow10[23] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// convert 16 ASCII characters to their value, returns false if any of them is not a digit
+static inline bool parse16Digits(const char *p, uint64 *pnValue)
+{
+#ifdef DBF_NUMERIC_SSE2
+    __m128i v = _mm_sub_epi8(_mm_loadu_si128((const __m128i *) p),_mm_set1_epi8('0'));
+    // a digit is 0..9 after the subtract, anything else wraps to a bigger unsigned byte
+    __m128i nine = _mm_set1_epi8(9);
+    if( _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(v,nine),nine)) != 0xFFFF )
+        return false;
+
+    // combine neighbours: 16 digits -> 8 pairs -> 4 quads -> 2 groups of 8
+    __m128i zero = _mm_setzero_si128();
+    __m128i w10 = _mm_set_epi16(1,10,1,10,1,10,1,10);
+    __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi8(v,zero),w10);
+    __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi8(v,zero),w10);
+    __m128i pairs = _mm_packs_epi32(lo,hi);
+    __m128i quads = _mm_madd_epi16(pairs,_mm_set_epi16(1,100,1,100,1,100,1,100));
+    quads = _mm_packs_epi32(quads,quads);
+    __m128i eights = _mm_madd_epi16(quads,_mm_set_epi16(1,10000,1,10000,1,10000,1,10000));
+
+    uint64 uHigh = (uint32) _mm_cvtsi128_si32(eights);
+    uint64 uLow = (uint32) _mm_cvtsi128_si32(_mm_srli_si128(eights,4));
+    *pnValue = uHigh*100000000ULL + uLow;
+    return true;
+#else
+    uint64 n = 0;
+    for( int i = 0 ; i < 16 ; i++ )
+    {
+        unsigned int d = (unsigned int) (uint8) p[i] - '0';
+        if( d > 9 )
+            return false;
+        n = n*10 + d;
+    }
+    *pnValue = n;
+    return true;
+#endif
+}
+
+int dbfParseNumeric(const char *pText, int nLen, int64 *pnMantissa, int *pnScale)
+{
+    // fields written by appendRecord are zero filled, stop at the first NUL
+    const char *pNul = (const char *) memchr(pText,0,nLen);
+    const char *p = pText;
+    const char *pEnd = pNul ? pNul : pText + nLen;
+
+    while( p < pEnd && *p == ' ' )
+        p++;
+    while( pEnd > p && pEnd[-1] == ' ' )
+        pEnd--;
+    if( p == pEnd )
+        return DBF_NUM_EMPTY;
+
+    bool bNegative = false;
+    if( *p == '-' || *p == '+' )
+    {
+        bNegative = (*p == '-');
+        p++;
+    }
+
+    // optional exponent, 'F' fields written by other tools sometimes use it
+    int nExponent = 0;
+    const char *pBodyEnd = pEnd;
+    for( const char *q = p ; q < pEnd ; q++ )
+    {
+        if( *q == 'e' || *q == 'E' )
+        {
+            pBodyEnd = q;
+            const char *e = q + 1;
+            bool bExpNegative = false;
+            if( e < pEnd && (*e == '-' || *e == '+') )
+            {
+                bExpNegative = (*e == '-');
+                e++;
+            }
+            if( e == pEnd )
+                return DBF_NUM_INVALID;
+            for( ; e < pEnd ; e++ )
+            {
+                unsigned int d = (unsigned int) (uint8) *e - '0';
+                if( d > 9 || nExponent > 10000 )
+                    return DBF_NUM_INVALID;
+                nExponent = nExponent*10 + d;
+            }
+            if( bExpNegative )
+                nExponent = -nExponent;
+            break;
+        }
+    }
+
+    if( pBodyEnd <= p )
+        return DBF_NUM_INVALID; // sign or exponent without any digits
+    const char *pDot = (const char *) memchr(p,'.',(size_t) (pBodyEnd - p));
+    const char *pIntEnd = pDot ? pDot : pBodyEnd;
+    const char *pFrac = pDot ? pDot + 1 : pBodyEnd;
+
+    // leading zeros do not count towards the 64 bit limit
+    const char *pIntStart = p;
+    while( p < pIntEnd && *p == '0' )
+        p++;
+    int nIntDigits = (int) (pIntEnd - p);
+    int nFracDigits = (int) (pBodyEnd - pFrac);
+    int nDigits = nIntDigits + nFracDigits;
+    if( nDigits == 0 && p == pIntStart )
+        return DBF_NUM_INVALID; // no digits at all, not even a zero
+    if( nDigits > 32 )
+        return DBF_NUM_OVERFLOW;
+
+    // right align the digits in a buffer of '0' so they can be handled 16 at a time
+    char digits[32];
+    memset(digits,'0',sizeof(digits));
+    memcpy(&digits[32 - nDigits],p,nIntDigits);
+    memcpy(&digits[32 - nFracDigits],pFrac,nFracDigits);
+
+    uint64 uHigh = 0;
+    uint64 uLow = 0;
+    if( !parse16Digits(&digits[16],&uLow) )
+        return DBF_NUM_INVALID;
+    if( nDigits > 16 )
+    {
+        if( !parse16Digits(&digits[0],&uHigh) )
+            return DBF_NUM_INVALID;
+        // uHigh*10^16 + uLow must fit in a signed 64 bit value
+        if( uHigh > 922 || (uHigh == 922 && uLow > 3372036854775807ULL) )
+            return DBF_NUM_OVERFLOW;
+    }
+
+    int64 nMantissa = (int64) (uHigh*10000000000000000ULL + uLow);
+    *pnMantissa = bNegative ? -nMantissa : nMantissa;
+    *pnScale = nFracDigits - nExponent;
+    return DBF_NUM_OK;
+}
+
+double dbfScaledToDouble(int64 nMantissa, int nScale)
+{
+    // both the mantissa and the power of ten are exact, so a single multiply or divide is correctly rounded
+    const int64 nExactLimit = 1LL << 53;
+    if( nMantissa > -nExactLimit && nMantissa < nExactLimit )
+    {
+        if( nScale == 0 )
+            return (double) nMantissa;
+        if( nScale > 0 && nScale <= 22 )
+            return (double) nMantissa / s_dPow10[nScale];
+        if( nScale < 0 && nScale >= -22 )
+            return (double) nMantissa * s_dPow10[-nScale];
+    }
+    // rare, use the extra precision of long double
+    return (double) ((long double) nMantissa * powl(10.0L,(long double) -nScale));
+}
+
+// slow path for numbers with too many digits for 64 bits, only the double result is needed
+static int parseLongNumeric(const char *pText, int nLen, double *pdValue)
+{
+    long double dValue = 0;
+    int nScale = 0;
+    bool bNegative = false;
+    bool bDot = false;
+    bool bAny = false;
+    int i = 0;
+    while( i < nLen && pText[i] == ' ' )
+        i++;
+    if( i < nLen && (pText[i] == '-' || pText[i] == '+') )
+        bNegative = (pText[i++] == '-');
+    for( ; i < nLen && pText[i] != 0 && pText[i] != ' ' ; i++ )
+    {
+        char c = pText[i];
+        if( c >= '0' && c <= '9' )
+        {
+            dValue = dValue*10 + (c - '0');
+            if( bDot )
+                nScale++;
+            bAny = true;
+        }
+        else if( c == '.' && !bDot )
+            bDot = true;
+        else
+            return DBF_NUM_INVALID; // exponent with this many digits is not worth supporting
+    }
+    if( !bAny )
+        return DBF_NUM_INVALID;
+    dValue = dValue / powl(10.0L,(long double) nScale);
+    *pdValue = (double) (bNegative ? -dValue : dValue);
+    return DBF_NUM_OK;
+}
+
+int dbfNumericToDouble(const char *pText, int nLen, double *pdValue)
+{
+    int64 nMantissa;
+    int nScale;
+    int nRet = dbfParseNumeric(pText,nLen,&nMantissa,&nScale);
+    if( nRet == DBF_NUM_OVERFLOW )
+        return parseLongNumeric(pText,nLen,pdValue);
+    if( nRet != DBF_NUM_OK )
+        return nRet;
+    *pdValue = dbfScaledToDouble(nMantissa,nScale);
+    return DBF_NUM_OK;
+}
+
+int dbfNumericToScaled(const char *pText, int nLen, int nDecimals, int64 *pnValue)
+{
+    int64 nMantissa;
+    int nScale;
+    int nRet = dbfParseNumeric(pText,nLen,&nMantissa,&nScale);
+    if( nRet != DBF_NUM_OK )
+        return nRet;
+
+    int nShift = nDecimals - nScale;
+    if( nShift > 0 )
+    {
+        // more decimals wanted than stored, multiply up
+        if( nShift > 18 )
+        {
+            if( nMantissa != 0 )
+                return DBF_NUM_OVERFLOW;
+            *pnValue = 0;
+            return DBF_NUM_OK;
+        }
+        int64 nMul = s_Pow10[nShift];
+        int64 nLimit = 0x7FFFFFFFFFFFFFFFLL / nMul;
+        if( nMantissa > nLimit || nMantissa < -nLimit )
+            return DBF_NUM_OVERFLOW;
+        *pnValue = nMantissa * nMul;
+    }
+    else if( nShift < 0 )
+    {
+        // too many decimals, round half away from zero
+        if( -nShift > 18 )
+        {
+            *pnValue = 0;
+            return DBF_NUM_OK;
+        }
+        int64 nDiv = s_Pow10[-nShift];
+        int64 nQuotient = nMantissa / nDiv;
+        int64 nRemainder = nMantissa % nDiv;
+        if( nRemainder*2 >= nDiv )
+            nQuotient++;
+        else if( nRemainder*2 <= -nDiv )
+            nQuotient--;
+        *pnValue = nQuotient;
+    }
+    else
+        *pnValue = nMantissa;
+    return DBF_NUM_OK;
+}
@@ -0,0 +1,46 @@
+#ifndef DBFNUMERIC_H
+#define DBFNUMERIC_H
+
+// Copyright (C) 2012 Ron Ostafichuk
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files
+// (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify,
+// merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR
+// IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+// Fast decoding of the space padded ASCII numbers stored in 'N' and 'F' fields.
+// No locale, no heap, no stringstream.  The digits are validated and accumulated 16 at a time
+// with SSE2 when the compiler targets it, otherwise with a plain loop that gives the same results.
+//
+// A parsed number is an exact integer mantissa plus a decimal scale, value = mantissa / 10^scale,
+// so money columns can be summed as scaled integers without any rounding drift.
+
+#include "dbf.h"
+
+#define DBF_NUM_OK 0
+#define DBF_NUM_EMPTY 1 // field is blank, FoxPro uses this for NULL / not entered
+#define DBF_NUM_INVALID 2 // not a number (bad characters, or the '*' overflow fill)
+#define DBF_NUM_OVERFLOW 3 // more significant digits than fit in 64 bits
+
+// parse the text into mantissa and scale, returns one of the DBF_NUM_ codes
+int dbfParseNumeric(const char *pText, int nLen, int64 *pnMantissa, int *pnScale);
+
+// convenience conversions, all return a DBF_NUM_ code and leave the output untouched on failure
+int dbfNumericToDouble(const char *pText, int nLen, double *pdValue);
+int dbfNumericToScaled(const char *pText, int nLen, int nDecimals, int64 *pnValue); // value*10^nDecimals rounded half away from zero
+inline int dbfNumericToInt64(const char *pText, int nLen, int64 *pnValue)
+{
+    return dbfNumericToScaled(pText,nLen,0,pnValue);
+}
+
+// exact conversion of a mantissa and scale to the nearest double
+double dbfScaledToDouble(int64 nMantissa, int nScale);
+
+#endif // DBFNUMERIC_H
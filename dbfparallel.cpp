@@ -0,0 +1,104 @@
+#include "dbfparallel.h"
+
+// Copyright (C) 2012 Ron Ostafichuk
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files
+// (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify,
+// merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR
+// IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#include <thread>
+#include <mutex>
+#include <vector>
+
+namespace
+{
+    // range of items still owned by one worker, the owner takes from the front and thieves from the back
+    struct WorkRange
+    {
+        std::mutex lock;
+        int nFront;
+        int nBack; // one past the last item
+
+        bool popFront(int *pnItem)
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if( nFront >= nBack )
+                return false;
+            *pnItem = nFront++;
+            return true;
+        }
+        bool stealBack(int *pnItem)
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if( nFront >= nBack )
+                return false;
+            *pnItem = --nBack;
+            return true;
+        }
+    };
+}
+
+int dbfDefaultThreadCount(int nThreads)
+{
+    if( nThreads > 0 )
+        return nThreads;
+    int n = (int) std::thread::hardware_concurrency();
+    return n > 0 ? n : 1;
+}
+
+void dbfParallelFor(int nItems, int nThreads, const std::function<void(int nItem, int nThread)> &fn)
+{
+    if( nItems <= 0 )
+        return;
+    nThreads = dbfDefaultThreadCount(nThreads);
+    if( nThreads > nItems )
+        nThreads = nItems;
+    if( nThreads == 1 )
+    {
+        for( int i = 0 ; i < nItems ; i++ )
+            fn(i,0);
+        return;
+    }
+
+    std::vector<WorkRange> ranges(nThreads);
+    for( int t = 0 ; t < nThreads ; t++ )
+    {
+        ranges[t].nFront = (int) ((long long) nItems*t/nThreads);
+        ranges[t].nBack = (int) ((long long) nItems*(t+1)/nThreads);
+    }
+
+    // no new work is ever added, so a worker that finds every range empty is done
+    auto worker = [&](int nThread)
+    {
+        int nItem;
+        for( ;; )
+        {
+            if( ranges[nThread].popFront(&nItem) )
+            {
+                fn(nItem,nThread);
+                continue;
+            }
+            bool bStole = false;
+            for( int i = 1 ; i < nThreads && !bStole ; i++ )
+                bStole = ranges[(nThread+i) % nThreads].stealBack(&nItem);
+            if( !bStole )
+                return;
+            fn(nItem,nThread);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for( int t = 1 ; t < nThreads ; t++ )
+        threads.push_back(std::thread(worker,t));
+    worker(0); // the calling thread works too
+    for( size_t t = 0 ; t < threads.size() ; t++ )
+        threads[t].join();
+}
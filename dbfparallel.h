@@ -0,0 +1,31 @@
+#ifndef DBFPARALLEL_H
+#define DBFPARALLEL_H
+
+// Copyright (C) 2012 Ron Ostafichuk
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files
+// (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify,
+// merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR
+// IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+// Small work stealing pool used by the parallel scans.
+// The items [0,nItems) are split into one contiguous run per thread, each thread works from the front of
+// its own run and, once it is empty, steals from the back of another thread's run.  Neighbouring items stay
+// on the same thread (good for sequential disk reads) while slow chunks do not leave the other cores idle.
+
+#include <functional>
+
+// returns the number of threads to use for nThreads <= 0 (all cores)
+int dbfDefaultThreadCount(int nThreads);
+
+// run fn(nItem,nThread) for every item on nThreads threads, returns when all items are done
+void dbfParallelFor(int nItems, int nThreads, const std::function<void(int nItem, int nThread)> &fn);
+
+#endif // DBFPARALLEL_H
@@ -0,0 +1,161 @@
+#include "dbfstats.h"
+
+// Copyright (C) 2012 Ron Ostafichuk
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files
+// (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify,
+// merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR
+// IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+DBFStats::DBFStats()
+{
+    memset(this,0,sizeof(DBFStats));
+}
+
+int64 DBFStats::getFieldDecodes(char cType) const
+{
+    return nFieldDecodes[cType >= 'A' && cType <= 'Z' ? cType - 'A' : DBF_STATS_TYPES - 1];
+}
+
+double DBFStats::percentileMicros(const int64 *pHistogram,double dFraction)
+{
+    int64 nTotal = 0;
+    for( int b = 0 ; b < DBF_STATS_BUCKETS ; b++ )
+        nTotal += pHistogram[b];
+    if( nTotal == 0 )
+        return 0;
+    // the sample with this rank falls in the first bucket where the running count reaches it
+    int64 nRank = (int64) ceil(min(max(dFraction,0.0),1.0)*nTotal);
+    if( nRank < 1 )
+        nRank = 1;
+    int64 nSeen = 0;
+    int b = 0;
+    for( ; b < DBF_STATS_BUCKETS - 1 ; b++ )
+    {
+        nSeen += pHistogram[b];
+        if( nSeen >= nRank )
+            break;
+    }
+    return ldexp(1.0,b + 1)/1000.0; // upper bound of bucket b
+}
+
+static void appendJSONString(string &sOut,const string &sText)
+{
+    sOut += '"';
+    for( size_t i = 0 ; i < sText.size() ; i++ )
+    {
+        char c = sText[i];
+        if( c == '"' || c == '\\' )
+        {
+            sOut += '\\';
+            sOut += c;
+        }
+        else if( (unsigned char) c < 0x20 )
+        {
+            char buffer[8];
+            snprintf(buffer,sizeof(buffer),"\\u%04x",(unsigned char) c);
+            sOut += buffer;
+        }
+        else
+            sOut += c;
+    }
+    sOut += '"';
+}
+
+static void appendCounter(string &sOut,const char *pName,int64 nValue)
+{
+    char buffer[64];
+    snprintf(buffer,sizeof(buffer),",\"%s\":%lld",pName,(long long) nValue);
+    sOut += buffer;
+}
+
+static void appendLatency(string &sOut,const char *pName,const int64 *pHistogram)
+{
+    int64 nTotal = 0;
+    int nMax = -1;
+    for( int b = 0 ; b < DBF_STATS_BUCKETS ; b++ )
+    {
+        nTotal += pHistogram[b];
+        if( pHistogram[b] > 0 )
+            nMax = b;
+    }
+    if( nTotal == 0 )
+        return; // not tracked or never called
+    char buffer[192];
+    snprintf(buffer,sizeof(buffer),",\"%s\":{\"count\":%lld,\"p50_us\":%.3f,\"p99_us\":%.3f,\"max_us\":%.3f}",pName,(long long) nTotal,
+             DBFStats::percentileMicros(pHistogram,0.5),DBFStats::percentileMicros(pHistogram,0.99),ldexp(1.0,nMax + 1)/1000.0);
+    sOut += buffer;
+}
+
+string dbfFormatStats(const DBFStats &stats,const string &sTable)
+{
+    string sOut = "{\"table\":";
+    appendJSONString(sOut,sTable);
+    appendCounter(sOut,"records_loaded",stats.nRecordsLoaded);
+    appendCounter(sOut,"records_appended",stats.nRecordsAppended);
+    appendCounter(sOut,"bytes_read",stats.nBytesRead);
+    appendCounter(sOut,"bytes_written",stats.nBytesWritten);
+    appendCounter(sOut,"read_calls",stats.nReadCalls);
+    appendCounter(sOut,"write_calls",stats.nWriteCalls);
+    appendCounter(sOut,"seeks",stats.nSeeks);
+    appendCounter(sOut,"flushes",stats.nFlushes);
+    appendCounter(sOut,"syncs",stats.nSyncs);
+    appendCounter(sOut,"syscalls",stats.getSyscalls());
+    appendCounter(sOut,"header_writes",stats.nHeaderWrites);
+    appendCounter(sOut,"conversion_failures",stats.nConversionFailures);
+    appendCounter(sOut,"cache_hits",stats.nCacheHits);
+    appendCounter(sOut,"cache_misses",stats.nCacheMisses);
+
+    // only the types that were read, by their letter
+    sOut += ",\"decodes\":{";
+    bool bFirst = true;
+    for( int i = 0 ; i < DBF_STATS_TYPES ; i++ )
+    {
+        if( stats.nFieldDecodes[i] == 0 )
+            continue;
+        char cType[2] = { (char) ('A' + i), 0 };
+        char buffer[48];
+        snprintf(buffer,sizeof(buffer),"%s\"%s\":%lld",bFirst ? "" : ",",i < 26 ? cType : "other",(long long) stats.nFieldDecodes[i]);
+        sOut += buffer;
+        bFirst = false;
+    }
+    sOut += "}";
+
+    appendLatency(sOut,"loadrec",stats.nLoadRecNs);
+    appendLatency(sOut,"append",stats.nAppendRecordNs);
+    sOut += "}";
+    return sOut;
+}
+
+DBFStats dbfStatsDelta(const DBFStats &now,const DBFStats &before)
+{
+    DBFStats delta;
+    delta.nRecordsLoaded = now.nRecordsLoaded - before.nRecordsLoaded;
+    delta.nRecordsAppended = now.nRecordsAppended - before.nRecordsAppended;
+    delta.nBytesRead = now.nBytesRead - before.nBytesRead;
+    delta.nBytesWritten = now.nBytesWritten - before.nBytesWritten;
+    delta.nReadCalls = now.nReadCalls - before.nReadCalls;
+    delta.nWriteCalls = now.nWriteCalls - before.nWriteCalls;
+    delta.nSeeks = now.nSeeks - before.nSeeks;
+    delta.nFlushes = now.nFlushes - before.nFlushes;
+    delta.nSyncs = now.nSyncs - before.nSyncs;
+    delta.nHeaderWrites = now.nHeaderWrites - before.nHeaderWrites;
+    delta.nConversionFailures = now.nConversionFailures - before.nConversionFailures;
+    delta.nCacheHits = now.nCacheHits - before.nCacheHits;
+    delta.nCacheMisses = now.nCacheMisses - before.nCacheMisses;
+    for( int i = 0 ; i < DBF_STATS_TYPES ; i++ )
+        delta.nFieldDecodes[i] = now.nFieldDecodes[i] - before.nFieldDecodes[i];
+    for( int b = 0 ; b < DBF_STATS_BUCKETS ; b++ )
+    {
+        delta.nLoadRecNs[b] = now.nLoadRecNs[b] - before.nLoadRecNs[b];
+        delta.nAppendRecordNs[b] = now.nAppendRecordNs[b] - before.nAppendRecordNs[b];
+    }
+    return delta;
+}
@@ -0,0 +1,30 @@
+#ifndef DBFSTATS_H
+#define DBFSTATS_H
+
+// Copyright (C) 2012 Ron Ostafichuk
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files
+// (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify,
+// merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR
+// IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+// Reporting for the per table instrumentation (DBF::getStats, DBFStats in dbf.h).  dbfFormatStats writes one snapshot
+// as a single JSON line: the counters, the field decodes of the types that were read and p50 / p99 / max of the
+// latency histograms that have samples, e.g. as the body of a DBF::setStatsHook that logs every few seconds.
+
+#include "dbf.h"
+
+// one line of JSON without the line break, sTable is written as the "table" member
+string dbfFormatStats(const DBFStats &stats, const string &sTable);
+
+// the difference of two snapshots of the same table, for rates over an interval
+DBFStats dbfStatsDelta(const DBFStats &now, const DBFStats &before);
+
+#endif // DBFSTATS_H
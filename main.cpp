@@ -1,7 +1,243 @@
 #include "dbf.h"
+#include "dbfaggregate.h"
+#include "dbfindex.h"
+#include "dbffilter.h"
+#include <stdexcept>
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
 
 using namespace std;
 
+// read every record of sFile with stdio and again through the memory mapping, returns how many differ (-1 if it can not be opened)
+static int compareReadPaths(string sFile)
+{
+    DBF stdioRead, mappedRead;
+    stdioRead.setVerbose(false);
+    mappedRead.setVerbose(false);
+    if( stdioRead.open(sFile) != 0 || mappedRead.open(sFile,false,true,DBF_ACCESS_SEQUENTIAL) != 0 )
+        return -1;
+    int nDiffer = abs(stdioRead.GetNumRecords() - mappedRead.GetNumRecords());
+    for( int i = 0 ; i < stdioRead.GetNumRecords() && i < mappedRead.GetNumRecords() ; i++ )
+    {
+        bool bSame = stdioRead.loadRec(i) == mappedRead.loadRec(i) && stdioRead.isRecordDeleted() == mappedRead.isRecordDeleted();
+        for( int f = 0 ; f < stdioRead.GetNumFields() && bSame ; f++ )
+            bSame = stdioRead.readField(f) == mappedRead.readField(f);
+        if( !bSame )
+            nDiffer++;
+    }
+    stdioRead.close();
+    mappedRead.close();
+    return nDiffer;
+}
+
+static void check(bool bOK, const char *pWhat, int &nFailed)
+{
+    if( !bOK )
+    {
+        std::cerr << "Check failed: " << pWhat << std::endl;
+        nFailed++;
+    }
+}
+
+// B+tree index on the ID field of TestCreate.dbf: lookups, then appends, deletes and updates kept in the attached index
+static int testIndex()
+{
+    int nFailed = 0;
+    DBF dbf;
+    dbf.setVerbose(false);
+    DBFIndex index;
+    if( dbf.open("TestCreate.dbf",true) != 0 || index.create("TestCreate.idx",dbf,vector<string>(1,"ID")) != 0 )
+        return 1;
+    vector<int> records;
+    check(index.getNumEntries() == dbf.countLiveRecords(),"one index entry per live record",nFailed);
+    check(index.find(vector<string>(1,"20000"),records) == 0 && records == vector<int>(1,2),"find ID 20000",nFailed);
+    check(index.find(vector<string>(1,"1000"),records) == 0 && records.empty(),"deleted record is not indexed",nFailed);
+    DBFIndexIterator it;
+    check(index.seek(vector<string>(1,"300001"),it) == 0 && it.isValid() && it.getRecord() == 4,"seek to the next key",nFailed);
+    records.clear();
+    index.scanRange(vector<string>(1,"2000001"),vector<string>(1,"2000010"),[&](int nRecord) { records.push_back(nRecord); return true; });
+    check(records.size() == 10 && records.front() == 5 && records.back() == 14,"scanRange in key order",nFailed);
+
+    dbf.attachIndex(&index);
+    string sValues[5] = {"7","Indexed","1.5","1","T"};
+    dbf.appendRecord(sValues,5);
+    int nNew = dbf.GetNumRecords() - 1;
+    check(index.find(vector<string>(1,"7"),records) == 0 && records == vector<int>(1,nNew),"appended record is indexed",nFailed);
+    dbf.markAsDeleted(nNew);
+    check(index.find(vector<string>(1,"7"),records) == 0 && records.empty(),"deleted record leaves the index",nFailed);
+    dbf.undelete(nNew);
+    check(index.find(vector<string>(1,"7"),records) == 0 && records == vector<int>(1,nNew),"undeleted record is back",nFailed);
+    dbf.updateField(nNew,0,"8");
+    check(index.find(vector<string>(1,"7"),records) == 0 && records.empty(),"old key gone after an update",nFailed);
+    check(index.find(vector<string>(1,"8"),records) == 0 && records == vector<int>(1,nNew),"new key found after an update",nFailed);
+    dbf.markAsDeleted(nNew);
+    dbf.close();
+    index.close();
+    remove("TestCreate.idx");
+    return nFailed;
+}
+
+// pack TestCreate.dbf into a copy, then pack the copy in place with an attached index and the deletion bitmap
+static int testPack()
+{
+    int nFailed = 0;
+    int64 nLive = 0;
+    {
+        DBF dbf;
+        dbf.setVerbose(false);
+        if( dbf.open("TestCreate.dbf") != 0 )
+            return 1;
+        nLive = dbf.countLiveRecords();
+        check(dbf.pack(NULL,"TestPack.dbf") == 0,"pack into a new file",nFailed);
+        dbf.close();
+    }
+
+    DBF dbf;
+    dbf.setVerbose(false);
+    DBFIndex index;
+    if( dbf.open("TestPack.dbf",true) != 0 || index.create("TestPack.idx",dbf,vector<string>(1,"ID")) != 0 )
+        return nFailed + 1;
+    check(dbf.GetNumRecords() == nLive && dbf.countLiveRecords() == nLive,"the copy holds only the live records",nFailed);
+    dbf.attachIndex(&index);
+    dbf.buildDeletionBitmap();
+    int nRecords = dbf.GetNumRecords();
+    dbf.loadRec(6);
+    string sID = dbf.readField(0);
+    dbf.markAsDeleted(vector<int>{0,5});
+#ifndef _WIN32
+    chmod("TestPack.dbf",0640);
+#endif
+    vector<int> recordMap;
+    check(dbf.pack(&recordMap) == 0,"pack in place",nFailed);
+#ifndef _WIN32
+    struct stat st;
+    check(stat("TestPack.dbf",&st) == 0 && (st.st_mode & 0777) == 0640,"pack keeps the mode of the table",nFailed);
+#endif
+    check(recordMap.size() == (size_t) nRecords && recordMap[0] == -1 && recordMap[5] == -1 && recordMap[1] == 0 && recordMap[6] == 4,
+          "record map of the pack",nFailed);
+    check(dbf.GetNumRecords() == nRecords - 2,"record count after the pack",nFailed);
+    check(dbf.loadRec(4) == 0 && dbf.readField(0) == sID,"records moved to their new numbers",nFailed);
+    vector<int> records;
+    check(index.getNumEntries() == nRecords - 2 && index.find(vector<string>(1,sID),records) == 0 && records == vector<int>(1,4),
+          "index rebuilt for the new numbers",nFailed);
+    check(dbf.hasDeletionBitmap() && dbf.countLiveRecords() == nRecords - 2 && !dbf.isDeleted(0),"deletion bitmap sized again",nFailed);
+    string sValues[5] = {"9","Packed","1","1","F"};
+    check(dbf.appendRecord(sValues,5) == 0 && dbf.countLiveRecords() == nRecords - 1,"append after the pack",nFailed);
+    dbf.close();
+    index.close();
+    remove("TestPack.idx");
+    remove("TestPack.dbf");
+    return nFailed;
+}
+
+// bulk delete and undelete on TestCreate.dbf, everything is undeleted again at the end
+static int testBulkDelete()
+{
+    int nFailed = 0;
+    DBF dbf;
+    dbf.setVerbose(false);
+    if( dbf.open("TestCreate.dbf",true) != 0 )
+        return 1;
+    int64 nLive = dbf.countLiveRecords();
+    int64 nChanged = 0;
+    check(dbf.markAsDeleted(vector<int>{22,20,21,21,1},&nChanged) == 0 && nChanged == 3,"bulk delete counts each new flag once",nFailed);
+    check(dbf.countLiveRecords() == nLive - 3 && dbf.isDeleted(21) && !dbf.isDeleted(23),"bitmap after the bulk delete",nFailed);
+    check(dbf.loadRec(20) == 0 && dbf.isRecordDeleted(),"flag written to the record",nFailed);
+    check(dbf.undelete(vector<int>{20,21,22,23},&nChanged) == 0 && nChanged == 3,"bulk undelete counts each cleared flag once",nFailed);
+    check(dbf.countLiveRecords() == nLive && dbf.loadRec(20) == 0 && !dbf.isRecordDeleted(),"records live again",nFailed);
+
+    DBFFilter filter;
+    filter.addEqual("Age","50");
+    vector<int> matching;
+    if( filter.compile(dbf) != 0 )
+        return nFailed + 1;
+    dbf.scan([&](const char *, int nRecord) { matching.push_back(nRecord); return true; },&filter);
+    int64 nDeleted = 0;
+    check(!matching.empty() && dbf.deleteWhere(filter,&nDeleted) == 0 && nDeleted == (int64) matching.size(),"deleteWhere deletes every match",nFailed);
+    check(dbf.countLiveRecords() == nLive - nDeleted && dbf.isDeleted(matching.front()),"bitmap after deleteWhere",nFailed);
+    check(dbf.undelete(matching,&nChanged) == 0 && nChanged == nDeleted && dbf.countLiveRecords() == nLive,"undelete the matches",nFailed);
+    dbf.close();
+    return nFailed;
+}
+
+static long fileSize(const char *pFile)
+{
+    FILE *pHandle = fopen(pFile,"rb");
+    if( pHandle == NULL )
+        return -1;
+    fseek(pHandle,0,SEEK_END);
+    long nSize = ftell(pHandle);
+    fclose(pHandle);
+    return nSize;
+}
+
+// memo values written, read back with stdio and through the mapping, then updated in place
+static int testMemo()
+{
+    int nFailed = 0;
+    string sMemos[3] = {"a short memo","",string(2000,'m') + "end"};
+    {
+        DBF dbf;
+        dbf.setVerbose(false);
+        if( dbf.create("TestMemo.dbf",2) != 0 )
+            return 1;
+        fieldDefinition fd;
+        memset(&fd,0,sizeof(fd));
+        strncpy(fd.cFieldName,"ID",10);
+        fd.cFieldType = 'I';
+        fd.uLength = 4;
+        dbf.assignField(fd,0);
+        strncpy(fd.cFieldName,"Notes",10);
+        fd.cFieldType = 'M';
+        dbf.assignField(fd,1);
+        check(dbf.hasMemoFile(),"memo field creates the memo file",nFailed);
+        for( int i = 0 ; i < 3 ; i++ )
+        {
+            string sValues[2] = {std::to_string(i),sMemos[i]};
+            dbf.appendRecord(sValues,2);
+        }
+        dbf.close();
+    }
+
+    for( int m = 0 ; m < 2 ; m++ )
+    {
+        DBF dbf;
+        dbf.setVerbose(false);
+        if( dbf.open("TestMemo.dbf",false,m == 1) != 0 )
+            return nFailed + 1;
+        for( int i = 0 ; i < 3 ; i++ )
+        {
+            string_view blob;
+            check(dbf.loadRec(i) == 0 && dbf.readField(1) == sMemos[i],"memo read back with readField",nFailed);
+            check(dbf.readMemo(1,blob) == 0 && blob == sMemos[i],"memo read back with readMemo",nFailed);
+        }
+        dbf.close();
+    }
+
+    DBF dbf;
+    dbf.setVerbose(false);
+    if( dbf.open("TestMemo.dbf",true) != 0 )
+        return nFailed + 1;
+    dbf.updateField(1,1,"filled in later");
+    dbf.commit();
+    long nSize = fileSize("TestMemo.fpt");
+    for( int i = 0 ; i < 3 ; i++ )
+    {
+        string sValues[2] = {"100",sMemos[0]};
+        dbf.updateRecord(0,sValues,2);
+        dbf.updateField(2,1,sMemos[2]);
+        dbf.commit();
+    }
+    check(fileSize("TestMemo.fpt") == nSize,"unchanged memos keep their blocks",nFailed);
+    check(dbf.loadRec(1) == 0 && dbf.readField(1) == "filled in later","updated memo",nFailed);
+    check(dbf.loadRec(0) == 0 && dbf.readField(0) == "100" && dbf.readField(1) == sMemos[0],"update of a row with a memo",nFailed);
+    dbf.close();
+    remove("TestMemo.dbf");
+    remove("TestMemo.fpt");
+    return nFailed;
+}
+
 int main(int argc, char *argv[])
 {
 
@@ -28,6 +264,12 @@ int main(int argc, char *argv[])
             std::cout << "Done Read Test " << std::endl;
 
             mydbf.close();
+
+            // a second pass through the memory mapping must give the same records
+            int nDiffer = compareReadPaths(sFileReadTest);
+            std::cout << "Memory mapped read found " << nDiffer << " records that differ" << std::endl;
+            if( nDiffer != 0 )
+                return 1;
         }
     } else
     {
@@ -157,6 +399,134 @@ int main(int argc, char *argv[])
             std::cout << "Done Test Delete Record DBF! " << std::endl;
 
             readTest.close();
+
+            int nDiffer = compareReadPaths("TestCreate.dbf");
+            std::cout << "Memory mapped read found " << nDiffer << " records that differ" << std::endl;
+            if( nDiffer != 0 )
+                return 1;
+
+            // a memory mapped table must see its own writes whatever the sync policy holds back in the stdio buffer
+            std::cout << "Test Delete and Reload under each sync policy" << std::endl;
+            int nFailed = 0;
+            const int nPolicies[5] = {DBF_SYNC_NONE,DBF_SYNC_FLUSH,DBF_SYNC_INTERVAL,DBF_SYNC_COMMIT,DBF_SYNC_FSYNC_COMMIT};
+            for( int p = 0 ; p < 5 ; p++ )
+            {
+                DBF syncTest;
+                syncTest.setVerbose(false);
+                if( syncTest.open("TestCreate.dbf",true,true) != 0 )
+                {
+                    nFailed++;
+                    continue;
+                }
+                syncTest.setSyncPolicy(nPolicies[p],nPolicies[p] == DBF_SYNC_FLUSH ? 100 : 60000);
+                int nRecord = 10 + p;
+                syncTest.markAsDeleted(nRecord);
+                bool bDeleted = syncTest.loadRec(nRecord) == 0 && syncTest.isRecordDeleted();
+                syncTest.undelete(nRecord);
+                bool bUndeleted = syncTest.loadRec(nRecord) == 0 && !syncTest.isRecordDeleted();
+                syncTest.updateField(nRecord,1,"Synced");
+                syncTest.commit();
+                bool bUpdated = syncTest.loadRec(nRecord) == 0 && syncTest.readField(1) == "Synced";
+                if( !bDeleted || !bUndeleted || !bUpdated )
+                {
+                    std::cerr << "Sync policy " << nPolicies[p] << " reloaded stale data, deleted=" << bDeleted
+                              << " undeleted=" << bUndeleted << " updated=" << bUpdated << std::endl;
+                    nFailed++;
+                }
+                syncTest.close();
+            }
+            std::cout << "Done Test Delete and Reload, " << nFailed << " failed" << std::endl;
+            if( nFailed > 0 )
+                return 1;
+
+            // updates wait in the write-back cache until commit, every reader must see them before that
+            std::cout << "Test Scan, Aggregate and Cursor see uncommitted updates" << std::endl;
+            for( int m = 0 ; m < 2 ; m++ )
+            {
+                DBF updateTest;
+                updateTest.setVerbose(false);
+                if( updateTest.open("TestCreate.dbf",true,m == 1) != 0 )
+                    return 1;
+                DBFAggregate before, after;
+                updateTest.aggregate(3,before);
+                updateTest.updateField(2,3,"99"); // Dean K was 23
+                updateTest.aggregate(3,after);
+                string sScanned;
+                updateTest.scan([&](const char *pRecord, int nRecord)
+                {
+                    if( nRecord == 2 )
+                        sScanned = updateTest.readField(pRecord,3);
+                    return nRecord < 2;
+                });
+                DBFCursor cursor(updateTest);
+                string sCursor = cursor.loadRec(2) == 0 ? cursor.readField(3) : "";
+                bool bOK = after.nScaledSum == before.nScaledSum + 76 && sScanned == "99" && sCursor == "99";
+                updateTest.updateField(2,3,"23");
+                updateTest.close();
+                if( !bOK )
+                {
+                    std::cerr << "Uncommitted update not seen, mapped=" << m << " sum " << before.nScaledSum << " -> " << after.nScaledSum
+                              << " scan=" << sScanned << " cursor=" << sCursor << std::endl;
+                    return 1;
+                }
+            }
+            std::cout << "Done Test uncommitted updates" << std::endl;
+
+            // an exception from the callback must leave scanReadAhead with its reader thread joined
+            std::cout << "Test scanReadAhead with a throwing callback" << std::endl;
+            {
+                DBF throwTest;
+                throwTest.setVerbose(false);
+                if( throwTest.open("TestCreate.dbf") != 0 )
+                    return 1;
+                bool bCaught = false;
+                try
+                {
+                    throwTest.scanReadAhead([](const char *, int nRecord)
+                    {
+                        if( nRecord == 500 )
+                            throw std::runtime_error("stop");
+                        return true;
+                    },NULL,16);
+                } catch( const std::runtime_error & )
+                {
+                    bCaught = true;
+                }
+                int nSeen = 0;
+                throwTest.scanReadAhead([&](const char *, int) { nSeen++; return true; },NULL,16);
+                int nRecords = throwTest.GetNumRecords();
+                throwTest.close();
+                if( !bCaught || nSeen != nRecords )
+                {
+                    std::cerr << "scanReadAhead after a throwing callback, caught=" << bCaught << " records=" << nSeen << std::endl;
+                    return 1;
+                }
+            }
+            std::cout << "Done Test throwing callback" << std::endl;
+
+            std::cout << "Test Index find, seek and scanRange" << std::endl;
+            nFailed = testIndex();
+            std::cout << "Done Test Index, " << nFailed << " failed" << std::endl;
+            if( nFailed > 0 )
+                return 1;
+
+            std::cout << "Test Bulk Delete and Undelete" << std::endl;
+            nFailed = testBulkDelete();
+            std::cout << "Done Test Bulk Delete, " << nFailed << " failed" << std::endl;
+            if( nFailed > 0 )
+                return 1;
+
+            std::cout << "Test Pack" << std::endl;
+            nFailed = testPack();
+            std::cout << "Done Test Pack, " << nFailed << " failed" << std::endl;
+            if( nFailed > 0 )
+                return 1;
+
+            std::cout << "Test Memo" << std::endl;
+            nFailed = testMemo();
+            std::cout << "Done Test Memo, " << nFailed << " failed" << std::endl;
+            if( nFailed > 0 )
+                return 1;
         }
     }
     return 0;